@@ -4,14 +4,177 @@
 #include <stdbool.h>
 #include <time.h>
 #include <unistd.h>
-
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HISTORY_URING 1 // The history writer submits through io_uring, kernels without it fall back to pwrite
+#endif
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#define LOCAL_FUTEX 1 // A side that finds its ring empty sleeps on a futex in the shared memory
+#endif
+#endif
+
+#ifndef _WIN32
+#define Sleep(ms) usleep((ms) * 1000) // Windows Sleep takes milliseconds
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause() // Lets the other hyperthread run while a side spins on a ring
+#else
+#define CPU_RELAX() do { } while (0)
+#endif
 
 #define MAX_NAME_LEN 50
 #define ANSI_COLOR_RED     "\x1b[31m"
 #define ANSI_COLOR_RESET   "\x1b[0m"
 #define MAX_PLAYERS 4
 #define MAX_CARDS 50
-#define MAX_ROUNDS 20
+#define MAX_HANDS 4       // A seat can split up to four hands
+#define MAX_HAND_CARDS 12 // Cards a player hand can hold, small cards from a big shoe can get there under 21 and the hand stands
+#define MAX_DECKS 8       // Largest shoe a rule set may deal from
+#define MAX_STRATEGIES 16
+#define TC_MIN -6 // Lowest true count the decision tables distinguish
+#define TC_MAX 6  // Highest true count the decision tables distinguish
+#define TC_BUCKETS (TC_MAX - TC_MIN + 1)
+#define BOT_BET_UNIT 10 // One betting unit of a house bot
+#define MAX_TABLES 65536
+#define SNAPSHOT_MAGIC "BJSNAP"
+#define SNAPSHOT_VERSION 11 // Bump whenever the layout of Table changes
+#define SNAPSHOT_PATH "tables.snap"
+#define WAL_PATH "chips.wal" // Segments are named chips.wal.0, chips.wal.1, ...
+#define WAL_NO_SEAT 0xFF     // Seat of a record that marks the round of the whole table
+#define WAL_NAME_PIECE 16    // Bytes of an account name one log record carries
+#define HISTORY_MAGIC "BJHIST"
+#define HISTORY_VERSION 1
+#define HISTORY_PATH "hands.hist"
+#define HISTORY_PLAYS 48        // Plays a seat can make in a round, four split hands hitting to 21 stay inside
+// Longest packed round: room in front for its length, table and round varints, the dealer's cards,
+// then for every seat its two header bytes, the plays, every hand's byte and cards and the balance varint
+#define HISTORY_RECORD_MAX (10 + 5 + 10 + 1 + MAX_CARDS + 1 + \
+                            MAX_PLAYERS * (2 + (HISTORY_PLAYS + 3) / 4 + MAX_HANDS * (1 + MAX_HAND_CARDS) + 10))
+#define HISTORY_FLUSH 262144    // Bytes in one history buffer, the writer writes a full one in one go
+#define HISTORY_BUFFERS 8       // Buffers the history writer fills while the kernel empties the others
+#define HISTORY_STAGE 8192      // Bytes a table thread packs its own rounds into before it hands them to the writer
+#define HISTORY_STAGES_MAX 512  // Stages handed off and not taken in by the writer, past that the tables wait
+#define HISTORY_HOLD_MS 1000    // A stage this old is handed off after the next round even when it is not full
+#define HISTORY_ALIGN 4096      // History buffers start on a page so the kernel copies whole pages
+#define HISTORY_BATCH 256       // Rounds the history review decodes at once
+#define TIMER_TICK_MS 10        // Resolution of the turn timers
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4    // 64 slots a level reach about 46 hours with 10 ms ticks
+#define BET_TIMEOUT_MS 30000    // A seat that has not bet by then sits the round out
+#define ACTION_TIMEOUT_MS 20000 // A hand that has not acted by then stands
+#define STAKE_LEVELS 3
+#define TABLE_POOL_CHUNK 64     // Tables the pool allocates at once when it runs dry
+#define LOBBY_BATCH 1024        // Joins the lobby seats before it looks at anything else
+#define LOBBY_SNAPSHOT_MS 10000 // How often the lobby snapshots the online tables and the wallets
+#define SEAT_HOLD_MS 120000     // How long a seat restored after a restart waits for its player
+#define ADMISSION_SOFT_US 20000  // Lobby loop latency above which new players only fill tables already open
+#define ADMISSION_HARD_US 100000 // Lobby loop latency above which every new player is turned away
+#define ADMISSION_QUEUE 4096     // Joins waiting for the lobby before the gateways turn new ones away
+#define ADMISSION_NICE 5         // How far below the table threads the gateways are scheduled
+#define REGISTRY_SLOTS 1024     // First size of the registry hash tables, a power of two kept at most half full
+#define ANALYZER_RING 16384     // Records the tables may queue for the fraud analyzer, a power of two
+#define ANALYZER_PROFILES 16384 // Players the analyzer follows at once, a power of two
+#define ANALYZER_PROBES 8       // Profile slots a player may land in
+#define ANALYZER_WINDOW 64.0f   // Bets over which the bet statistics fade, an older bet weighs less than 1/e
+#define ANALYZER_MIN_BETS 12    // Bets before a player can be flagged as a counter
+#define ANALYZER_CORRELATION 0.6f // Correlation of bet and true count that flags a counter
+#define ANALYZER_SPREAD 3.0f    // Average bet at a true count of +2 over the one at 0 or less that flags a counter
+#define ANALYZER_INDEX_PLAYS 4  // Hi-Lo index plays, taken three times in four, that flag a counter on their own
+#define ANALYZER_SITTINGS 3     // Times two players must sit down together before they are flagged
+#define CMS_DEPTH 4
+#define CMS_WIDTH 65536         // Counters in a row of the pair sketch, a power of two
+#define HLL_REGISTERS 64        // Registers of a tablemate counter, about 13% error
+#define ALERT_PATH "fraud.log"
+#define SERVER_PORT 7777
+#define METRICS_PORT 9464       // Local HTTP port the engine metrics are scraped from
+#define DECISION_BUCKETS 11     // Buckets of the decision latency histogram, the last one has no upper bound
+#define SERVER_GATEWAYS 2       // Threads accepting connections and reading their JOIN line
+#define GATEWAY_PENDING 1024    // Connections a gateway holds until they ask to join
+#define SEAT_LINK_BUFFER 128    // Longest line a client may send
+#define SEAT_SEND_BUFFER 4096   // Kernel send buffer of a player's socket, a client that lets it fill up is dropped
+#define LOCAL_SHM_NAME "/blackjack-local" // Shared memory local clients attach to while the online tables are open
+#define LOCAL_MAGIC "BJLOCAL"
+#define LOCAL_VERSION 2
+#define LOCAL_CHANNELS 64       // Local clients the tables serve at once
+#define LOCAL_RING_SIZE 2048    // Bytes of one direction of a local channel, a power of two
+#define LOCAL_SPINS 4096        // Empty polls of a ring before the waiting side gives up the CPU
+#define LOCAL_CHECK_MS 100      // How often a waiting game side looks whether a quiet client is still alive
+#define BUY_IN_BETS 50          // Chips an online player sits down with, in smallest bets of the stake
+#define SPECTATOR_QUEUE 64      // Events a spectator may fall behind by before it is dropped
+#define BROADCAST_BATCH 32      // Events a table collects before it writes them out
+#define DELTA_HISTORY 256       // Binary deltas a table keeps for sync clients that come back
+#define SYNC_FRAME_MAX 1024     // Longest binary frame, a snapshot of a full table fits
+#define SYNC_SNAPSHOT 0         // Frame type of a full table state
+#define SYNC_EVENT_BASE 1       // Frame type of a delta is this plus its EventKind
+#define LOADGEN_THREADS 4       // Threads the load test spreads its clients over
+#define LOADGEN_BACKOFF_US 100000 // How long a load client waits after the server turned it away as busy
+#define SIM_THREADS 4           // Threads the simulator plays its tables on
+#define SIM_BATCH 10000         // Rounds a simulator thread plays before it merges its results
+#define SIM_MIN_BATCHES 8       // Merged batches before the confidence interval may stop a run
+#define SIM_CHECKPOINT_SECONDS 60 // How often a running simulation saves where it is
+#define SIM_CHECKPOINT_MAGIC "BJSIMCK"
+#define SIM_CHECKPOINT_VERSION 2 // Bump whenever SimulationCheckpoint or SimulationWorker changes
+#define SIM_CHECKPOINT_PATH "simulation.ckpt"
+#define START_CHIPS 250.0       // Bankroll a new seat sits down with
+#define TOURNAMENT_THREADS_MAX 64 // Most threads the tournament plays its tables on, it runs one a processor
+#define TOURNAMENT_CHIPS 1000.0 // Stack every tournament entrant starts with
+#define TOURNAMENT_REFRESH_MS 500 // How often the live leaderboard is printed while a level plays
+#define LEADERBOARD_BUCKETS 524288 // Half chip stacks the leaderboard tells apart, bigger stacks share the top one
+#define BANKROLL_LANES 4        // Bankroll paths one vector instruction advances
+#define OUTCOME_RANGE 640       // Largest net of a round in tenths of a betting unit, four doubled hands at the top of the ramp
+#define OUTCOME_BINS (2 * OUTCOME_RANGE + 1)
+#define OUTCOME_SAMPLE_ROUNDS 1000000 // Rounds the engine plays to learn the outcome distribution of a strategy
+#define HIST_SUB_BITS 6         // 64 buckets per power of two keep latencies within about 1.5%
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (HIST_SUB * 36) // Covers latencies up to 2^41 microseconds
+#define ODDS_MEMO 512           // Dealer hands the odds overlay remembers while it works out one composition, a power of two
+#define ODDS_CACHE 16           // Odds results a table thread keeps, a power of two
+#define EDGE_THREADS_MAX 64     // Most threads the house edge calculator works its jobs out on, it runs one a processor
+#define EDGE_MEMO 16384         // Player hands the calculator remembers while it works out one job, a power of two
+#define EDGE_MAX_DECKS 4095     // Largest shoe the calculator takes, its 16 tens a deck still fit an unsigned short
+
+// Hot paths of the round are copied into every rule set, so the rules are constants inside them
+#define RULES_INLINE static inline __attribute__((always_inline))
+
+#define GAME_PRINT(game, ...) do { if (!(game)->quiet) printf(__VA_ARGS__); } while (0)
+
+// Public events of online tables, the fields are those of a TableEvent
+#define GAME_EVENT(game, ...) do { if ((game)->broadcast != NULL) tableEvent((game), &(TableEvent) {__VA_ARGS__}); } while (0)
+
+// Engine counters of live tables, simulated games are left out like their chips
+#define GAME_METRIC(game, metric, amount) do { if ((game)->tableId != 0) metricAdd((metric), (amount)); } while (0)
+
+// The fraud analyzer follows the online tables, only while it runs
+#define GAME_ANALYZED(game) ((game)->broadcast != NULL && atomic_load_explicit(&analyzer.running, memory_order_relaxed))
 
 typedef enum
 {
@@ -53,35 +216,140 @@ typedef struct
 
 typedef struct
 {
-    Card card[MAX_CARDS];
-    char name[MAX_NAME_LEN];
-    double ChipSum;
+    Card card[MAX_HAND_CARDS];
+    int bet;                 // Chips riding on this hand, doubled by a double down
+    unsigned char countCard;
     bool isLost;
-    int bet;
     bool isTie;
-    int countCard;
+    bool isDoubled;
+} Hand;
+
+typedef struct
+{
+    Hand hands[MAX_HANDS];   // Split hands live inline, hands[0] is the hand that was dealt
+    char name[MAX_NAME_LEN];
+    double ChipSum;
+    int bet;                 // Bet placed before the deal
+    int strategyId;          // STRATEGY_HUMAN for seats that answer through scanf
+    unsigned char handCount;
+    bool showOdds;           // The player bought the odds overlay, shown before every decision
+    unsigned int playerId;   // Account of an online seat, its chip changes are logged under it, 0 at this terminal
 } Player;
 
+// The seat used to hold one 50 card hand in 680 bytes. Four inline hands still fit in that,
+// the 8 bytes over it came with the strategyId of the bot strategies and the account id sits in their padding
+_Static_assert(sizeof(Player) <= 680 + 8, "Player grew past the single hand layout and its strategy id");
+
 typedef struct
 {
     Card* cards;      // Now a pointer to a dynamically allocated array of Cards
     int deckSize;
+    int shoeSize;     // Cards in the full shoe, 52 for every deck
+    unsigned short ranks[10]; // Cards left of every point value, a Two first and an Ace last
+    unsigned long long rngState; // xorshift64* state used by shuffleDeck
 } Deck;
 
 typedef struct
 {
     Deck* deck;
-    Card dealerCards[3];
+    Card dealerCards[MAX_CARDS];
     int dealCardCount;
     Player dealer;
     double sumBetting;
+    int runningCount; // Hi-Lo count of every card shown since the last shuffle
 } Board;
 
+//##########----- STRUCTS FOR THE SEAT CONNECTIONS -----################
+
+// The connection of a seat played from another machine, fd is -1 for a seat at this terminal
+typedef struct
+{
+    int fd;
+    struct LocalChannel* channel; // Shared memory of a client on this machine, NULL for a socket
+    bool gone;         // The player left or the connection broke, the seat is dropped after the round
+    int buffered;
+    char buffer[SEAT_LINK_BUFFER]; // Bytes received after the last full line
+} SeatLink;
+
+//####################################################################
+
+//##########----- STRUCTS FOR THE TURN TIMERS -----################
+
+typedef struct Timer
+{
+    struct Timer* next;        // Timers of one wheel slot form a circular list, NULL when not armed
+    struct Timer* prev;
+    unsigned long long expiresAt; // Wheel tick the timer fires on
+    void (*onExpire)(struct Timer* timer);
+    void* owner;               // The Game of a seat timer
+    int seat;
+    bool expired;
+} Timer;
+
+typedef struct
+{
+    Timer slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // List heads, level n slots are 64^n ticks wide
+    unsigned long long now;    // Current tick
+    unsigned long long startMs;
+    int armedCount;
+} TimerWheel;
+
+_Thread_local TimerWheel turnTimers; // Every thread that runs tables keeps its own deadlines
+
+//####################################################################
+
+typedef enum
+{
+    PHASE_WAITING,
+    PHASE_BETTING,
+    PHASE_DEALING,
+    PHASE_PLAYING,
+    PHASE_DEALER,
+    PHASE_SETTLING
+} RoundPhase;
+
+typedef enum
+{
+    STAKE_LOW,
+    STAKE_MID,
+    STAKE_HIGH
+} StakeLevel;
+
+// Every rule set is one line: id, engine name, decks, dealer hits soft 17, blackjack pays
+// (pays to per), surrender allowed, split pairs split again up to MAX_HANDS, share of the shoe
+// dealt before the reshuffle, and whether a continuous shuffling machine takes the cards back
+// after every round instead
+#define RULE_SET_LIST(X) \
+    X(RULES_SINGLE_DECK, SingleDeck, "Single Deck S17 3:2",  1, false, 3, 2, true,  false, 0.00, false) \
+    X(RULES_SHOE_S17,    ShoeS17,    "Six Deck S17 3:2",     6, false, 3, 2, true,  true,  0.75, false) \
+    X(RULES_SHOE_H17,    ShoeH17,    "Six Deck H17 3:2",     6, true,  3, 2, true,  true,  0.75, false) \
+    X(RULES_SIX_FIVE,    SixFive,    "Double Deck H17 6:5",  2, true,  6, 5, false, false, 0.65, false) \
+    X(RULES_SHOE_CSM,    ShoeCsm,    "Six Deck CSM S17 3:2", 6, false, 3, 2, true,  false, 0.00, true)
+
+#define RULE_SET_ID(id, ...) id,
+typedef enum
+{
+    RULE_SET_LIST(RULE_SET_ID)
+    RULE_SET_COUNT
+} RuleId;
+
 typedef struct
 {
     Player* players;  // Pointer to a dynamically allocated array of Players
     Board* board;
     int numPlayers;
+    bool quiet; // Suppress table output (used by the simulator)
+    RoundPhase phase;
+    unsigned int tableId; // Stable id of a live table, 0 for games that are not logged (the simulator)
+    Timer* seatTimers;    // Turn deadline of every seat, NULL when the seats have no deadlines
+    StakeLevel stake;     // Sets the smallest bet the table takes
+    SeatLink* seatLinks;  // Connection of every seat, NULL when every seat plays at this terminal
+    struct Broadcast* broadcast; // Spectators of an online table, NULL when nobody can watch
+    RuleId rules;         // Picks the engine that plays the rounds of this table
+    unsigned long long roundNumber;          // Rounds the table has played, numbers its hand history
+    double roundStartChips[MAX_PLAYERS];     // Chips of every seat before the bets of this round
+    unsigned char plays[MAX_PLAYERS][HISTORY_PLAYS]; // Decision of every play of this round, for the hand history
+    unsigned char playCount[MAX_PLAYERS];
 } Game;
 
 //##########----- STRUCTS FOR THE HISTORY MOVES -----################
@@ -90,572 +358,9058 @@ typedef enum
 {
     HIT,
     STAND,
-    SURRENDER
+    SURRENDER,
+    DOUBLE,
+    SPLIT
 }Decision;
 
-typedef struct {
-    int roundNumber;
-    Decision playerActions[MAX_PLAYERS][100];  // To hold actions like "Hit" or "Stand"
-    int playerScores[MAX_PLAYERS];          // Scores of players at the end of each round
-    bool playerWins[MAX_PLAYERS];           // Whether the player won this round
-    bool playerTied[MAX_PLAYERS];           // Whether the player tied with the dealer
-    bool playerLost[MAX_PLAYERS];           // Whether the player lost with the dealer
-    double playerBalanceChange[MAX_PLAYERS]; // Change in balance after the round
+typedef enum
+{
+    OUTCOME_WIN,
+    OUTCOME_LOSE,
+    OUTCOME_TIE,
+    OUTCOME_SURRENDER
+} HandOutcome;
+
+// One seat of a round as the code reads it, the hand history keeps it packed (see encodeMove)
+typedef struct
+{
+    unsigned char seat;
+    unsigned char handCount;
+    unsigned char playCount;
+    Decision plays[HISTORY_PLAYS];       // In the order they were made, a split hand plays after the hand it came from
+    unsigned char cardCount[MAX_HANDS];
+    Card cards[MAX_HANDS][MAX_HAND_CARDS];
+    HandOutcome outcomes[MAX_HANDS];
+    double balanceChange;                // Chips after the round minus chips before the bet
+} SeatMove;
 
+typedef struct
+{
+    unsigned int tableId;
+    unsigned long long roundNumber;
+    unsigned char dealerCount;
+    Card dealerCards[MAX_CARDS];         // Every card the dealer drew, the dealer has no cap on its hand
+    unsigned char seatCount;             // Seats that played the round, sitting out seats are left out
+    SeatMove seats[MAX_PLAYERS];
 } Move;
+_Static_assert(MAX_PLAYERS <= 16 && MAX_HANDS <= 15 && MAX_HAND_CARDS <= 15 && HISTORY_PLAYS <= 255,
+               "A packed round keeps seats, hands and card counts in four bits and play counts in a byte");
+_Static_assert(HISTORY_RECORD_MAX <= HISTORY_STAGE && HISTORY_STAGE <= HISTORY_FLUSH,
+               "A packed round must fit a stage and a stage a history buffer");
 
-void StoreMove(Move* move);
+typedef struct
+{
+    char magic[8];
+    unsigned int version;
+} HistoryHeader;
 
-Move movesDB[MAX_ROUNDS];
+// A page aligned buffer of packed rounds, the history writer fills it from the stages and writes it whole
+typedef struct
+{
+    unsigned char* bytes;    // HISTORY_FLUSH bytes
+    size_t length;
+    size_t written;          // Bytes the writer has put in the file so far
+    off_t offset;            // Where the buffer goes in the file, fixed when the writer submits it
+} HistoryBuffer;
+
+// Rounds one table thread packed on its own, handed to the history writer whole
+typedef struct HistoryStage
+{
+    _Atomic(struct HistoryStage*) next;  // The stage handed off before it
+    size_t length;
+    unsigned long long startedAt;        // When the first round went in
+    unsigned char bytes[HISTORY_STAGE];
+} HistoryStage;
+
+#ifdef HISTORY_URING
+// The submission and completion rings the history writer shares with the kernel
+typedef struct
+{
+    int fd;
+    _Atomic unsigned int* sqTail;
+    unsigned int sqMask;
+    unsigned int* sqArray;
+    struct io_uring_sqe* sqes;
+    _Atomic unsigned int* cqHead;
+    _Atomic unsigned int* cqTail;
+    unsigned int cqMask;
+    struct io_uring_cqe* cqes;
+    bool fixed;              // The buffers are registered with the kernel, so no write maps them again
+} HistoryRing;
+#endif
+
+// Every round of a logged table, packed and appended to one file shared by all tables.
+// Each table thread packs its rounds into a stage of its own and pushes a full stage without
+// a lock, the history writer thread copies the stages into its buffers and makes every write
+typedef struct
+{
+    pthread_mutex_t lock;                    // Only for sleeping, flushing, closing and tables held back
+    pthread_cond_t hasWork;                  // A stage reached a sleeping writer, or a flush or close was asked
+    pthread_cond_t emptied;                  // The writer took stages in or finished a flush
+    _Atomic(HistoryStage*) stages;           // Handed off and not taken in yet, newest first
+    _Atomic int stagesPending;
+    _Atomic bool sleeping;                   // The writer waits on hasWork, so a hand off must wake it
+    unsigned long long flushAsked;
+    unsigned long long flushDone;
+    bool closing;
+    HistoryBuffer buffers[HISTORY_BUFFERS];  // The buffers and everything down to fd belong to the writer alone
+    HistoryBuffer* filling;                  // NULL until a stage needs one
+    HistoryBuffer* idle[HISTORY_BUFFERS];
+    int idleCount;
+    int inRing;                              // Submitted to io_uring and not finished
+    int unsubmitted;                         // Queued on the ring and not passed to the kernel yet
+    off_t end;                               // File offset after the last buffer submitted
+    int fd;                                  // -1 until historyOpen and after historyClose
+    _Atomic long long rounds;
+    pthread_t writer;
+    bool uring;                              // False when the writer falls back to pwrite
+#ifdef HISTORY_URING
+    HistoryRing ring;
+#endif
+} HandHistory;
+
+HandHistory handHistory = {.lock = PTHREAD_MUTEX_INITIALIZER, .hasWork = PTHREAD_COND_INITIALIZER, .emptied = PTHREAD_COND_INITIALIZER, .fd = -1};
+_Thread_local HistoryStage* historyStage = NULL; // The rounds this thread packed and has not handed off
+
+// Two bits a play, a surrender is written as a stand and read back from the outcome of the hand
+const unsigned char HISTORY_PLAY_CODES[] = {[HIT] = 0, [STAND] = 1, [SURRENDER] = 1, [DOUBLE] = 2, [SPLIT] = 3};
+const Decision HISTORY_CODE_PLAYS[4] = {HIT, STAND, DOUBLE, SPLIT};
 
 //####################################################################
 
+//##########----- STRUCTS FOR THE LIVE TABLES -----################
 
-// Map values and suits to their string representations
-const char* VALUE_NAMES[] = {"Ace", "Two", "Three", "Four", "Five", "Six", "Seven", "Eight", "Nine", "Ten", "Jack", "Queen", "King"};
-const char* SUIT_NAMES[] = {"Hearts", "Diamonds", "Spades", "Clubs"};
-const char* COLOR_NAMES[] = {"Red", "Black"};
+// A live table keeps every part of its Game in one block with no outside pointers,
+// so a snapshot is the block as it is in memory and a restore only re-aims the pointers.
+// The pointers sit together at the front so re-aiming them touches a single page.
+typedef struct Table
+{
+    Game game;
+    Deck deck;
+    struct Table* next; // Next table with an open seat at its stake, or next free table of the pool
+    int registryIndex;  // Position in liveTables
+    bool fromSnapshot;  // Lives inside the mapped snapshot file, so closeTable must not free it
+    bool online;        // Opened by the lobby, a restart gives it back to the online players instead of the terminal
+    Board board;
+    Player players[MAX_PLAYERS];
+    Card shoe[52 * MAX_DECKS];
+    Timer seatTimers[MAX_PLAYERS]; // Not saved, attachTable disarms them
+    SeatLink seatLinks[MAX_PLAYERS]; // Not saved, a restart drops every connection
+    int seatsClaimed;              // Seats the lobby handed out, some may still be on their way to the table
+    struct TableRunner* runner;    // Thread that plays an online table, NULL otherwise
+} Table;
 
+typedef struct
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int tableSize;  // sizeof(Table) of the writer
+    unsigned int tableCount;
+    unsigned int walSegment;     // First log segment holding changes newer than the snapshot
+    unsigned long long walLsn;   // Last logged change the snapshot already contains
+    long long takenAt;
+    unsigned int accountCount;   // The player registry follows the tables, its accounts and then its name pool
+    unsigned int registryNextId;
+    unsigned long long registryNextSession;
+    unsigned long long namesLength;
+} SnapshotHeader;
+
+Table* liveTables[MAX_TABLES];
+int liveTableCount = 0;
+unsigned int nextTableId = 1;
+
+// Closed tables go back to the pool and openTable takes them from there before it allocates
+typedef struct
+{
+    Table* free;
+    int allocated;
+} TablePool;
 
-printCardLogo(); // This function print the starting of the game
+TablePool tablePool = {NULL, 0};
 
-void showLoadingProgress(); // This is a stylish function to print a progress bar
+//####################################################################
 
-void initializePlayer(Player* player); // This function initializes a player with default values (e.g., name, chips, and other necessary attributes).
+//##########----- STRUCTS FOR THE LOBBY -----################
 
-void initializeBoard(Board* board);// This function initializes the game board, including setting up the dealer's cards and any other board-related data.
+const int STAKE_MIN_BET[STAKE_LEVELS] = {5, 25, 100};
+const char* STAKE_NAMES[STAKE_LEVELS] = {"Low", "Mid", "High"};
 
-void initializeDeck(Deck* deck); // This function initializes the deck, ensuring that all cards are available for use in the game.
+typedef enum
+{
+    LOBBY_JOIN,
+    LOBBY_LEAVE,   // A table thread gives a seat back
+    LOBBY_CLOSED,  // A table thread has stopped and its table can go back to the pool
+    LOBBY_WATCH    // A spectator asks for a table by its id
+} LobbyKind;
 
-void shuffleDeck(Deck* deck); // This function shuffles the deck to ensure randomness before cards are dealt.
+typedef enum
+{
+    LOBBY_QUEUED,
+    LOBBY_SEATED,
+    LOBBY_REJECTED
+} LobbyState;
 
-void freeGame(Game* game); // This function cleans up the game resources (e.g., freeing allocated memory for players, deck, etc.) when the game ends.
+// A join request lives in the memory of the connection that asks, the lobby only links it
+typedef struct LobbyTicket
+{
+    _Atomic(struct LobbyTicket*) next;
+    LobbyKind kind;
+    int fd;                  // Connection of an online player, -1 for a join from this terminal
+    struct LocalChannel* channel; // Shared memory of a local player, NULL otherwise
+    char name[MAX_NAME_LEN];
+    double chips;
+    StakeLevel stake;
+    unsigned int tableId;    // Table a spectator wants to watch
+    bool binary;             // The spectator syncs with binary deltas instead of text lines
+    bool odds;               // The player asked for the odds overlay
+    unsigned long long version; // Last table version a sync client has, 0 for none
+    Table* table;            // Where the player sits, valid once state is LOBBY_SEATED
+    struct TableRunner* runner; // The stopped thread of a LOBBY_CLOSED table, the lobby frees it
+    int seat;
+    unsigned int playerId;   // Account of the player, set when the lobby seats it
+    unsigned long long queuedAt; // When a join was pushed, the lobby learns how far behind it runs from it
+    _Atomic int state;       // LobbyState, the connection polls it
+} LobbyTicket;
+
+// Many connections push joins with a single atomic exchange and no lock,
+// the thread that owns the tables takes them off and seats them
+typedef struct
+{
+    _Atomic(LobbyTicket*) head; // Newest ticket, producers swap themselves in here
+    LobbyTicket* tail;          // Oldest ticket, only the owning thread touches it
+    LobbyTicket stub;           // Keeps the queue from ever being empty of nodes
+    Table* openTables[STAKE_LEVELS]; // Tables with a free seat at each stake, the one filling up first
+    _Atomic bool sleeping;      // The owning thread waits on wakeUp and a producer must signal it
+    pthread_mutex_t lock;
+    pthread_cond_t wakeUp;
+    void (*handOff)(LobbyTicket* ticket); // Passes a seated online player to the table's thread, NULL seats right away
+    void (*retire)(Table* table);         // Stops the thread of a table whose last player left
+    void (*reject)(LobbyTicket* ticket, const char* reason); // Turns an online player away, NULL leaves the ticket to whoever submitted it, which sees LOBBY_REJECTED
+    long seated;
+    long rejected;
+    int tablesOpen;
+    int seatsHeld;              // Seats of restored tables still waiting for their players
+    unsigned long long holdUntil; // When the held seats are given up and their chips go to the wallets
+    unsigned long long nextSnapshot;
+} Lobby;
+
+Lobby lobby = {.lock = PTHREAD_MUTEX_INITIALIZER, .wakeUp = PTHREAD_COND_INITIALIZER};
 
-void dealCards(Game* game); // This function deals cards to all players and the dealer at the start of a round.
+typedef enum
+{
+    ADMIT_OPEN,  // Every join is seated
+    ADMIT_FILL,  // Joins only take free seats, no new table is opened
+    ADMIT_SHED   // Every join is turned away, the rounds being played come first
+} AdmissionLevel;
 
-void RemoveFromDeck(Game* game, Card* card); // This function removes a specific card from the deck after it has been dealt to a player or dealer.
+// The lobby measures how late it runs and sets the level, the gateways read it without a lock
+typedef struct
+{
+    _Atomic int queued;            // Joins pushed and not taken off by the lobby yet
+    unsigned long long lagMicros;  // Smoothed loop latency, only the lobby thread writes it
+    _Atomic int level;             // AdmissionLevel
+} Admission;
 
-void InsertToDeck(Game* game, Card* card); // This function inserts a card back into the deck (useful when reshuffling or returning cards to the deck).
+Admission admission;
 
-void printCard(Card* card); // This function prints out the details of a single card (e.g., the card's rank and suit).
+//####################################################################
 
-void DetermineWinner(Game* game); // This function determines the winner of the round by comparing the scores of all players and the dealer. It will announce the result accordingly.
+//##########----- STRUCTS FOR THE ENGINE METRICS -----################
+
+// Every counter is one line: id, Prometheus name, help text, and the divisor of its exported value
+#define METRIC_LIST(X) \
+    X(METRIC_ROUNDS,        "blackjack_rounds_total",          "Rounds played to the end", 1) \
+    X(METRIC_HANDS,         "blackjack_hands_total",           "Player hands settled, rate() gives hands per second", 1) \
+    X(METRIC_BUSTS,         "blackjack_player_busts_total",    "Player hands that went over 21", 1) \
+    X(METRIC_SURRENDERS,    "blackjack_surrenders_total",      "Player hands surrendered", 1) \
+    X(METRIC_DEALER_BUSTS,  "blackjack_dealer_busts_total",    "Rounds the dealer went over 21", 1) \
+    X(METRIC_WAGERED,       "blackjack_chips_wagered_total",   "Chips riding on the hands settled, doubles and splits included", 100) \
+    X(METRIC_PAID,          "blackjack_chips_paid_total",      "Chips paid back to players, stakes included", 100) \
+    X(METRIC_RESHUFFLES,    "blackjack_shoe_reshuffles_total", "Shoes shuffled, the first shoe of a table included", 1) \
+    X(METRIC_JOINS_SHED,    "blackjack_joins_shed_total",      "Joins turned away because the host was busy", 1) \
+    X(METRIC_FRAUD_ALERTS,  "blackjack_fraud_alerts_total",    "Players flagged as card counters or colluders", 1) \
+    X(METRIC_ANALYZER_LOST, "blackjack_analyzer_dropped_total", "Records the fraud analyzer had no room for", 1)
+
+#define METRIC_ID(id, ...) id,
+typedef enum
+{
+    METRIC_LIST(METRIC_ID)
+    METRIC_COUNT
+} MetricId;
 
-int CalculateScore(Card* card, int cardCount); // This function calculates the score of a hand, based on the cards in the hand. It sums up the values of the cards.
+// Counters of one thread. Only that thread writes them, with a relaxed load and store and no locked
+// instruction, and the scrape sums every block. A block outlives its thread and is taken over by the next one.
+typedef struct EngineMetrics
+{
+    _Alignas(64) _Atomic unsigned long long counters[METRIC_COUNT];
+    _Atomic unsigned long long decisions[DECISION_BUCKETS];
+    _Atomic unsigned long long decisionMicros;
+    struct EngineMetrics* next;
+    _Atomic bool inUse;
+} EngineMetrics;
 
-void placeBet(Player* player, double betAmount); // This function allows a player to place a bet. It checks that the player has enough balance to place the bet.
+// Upper bounds of the decision latency buckets in microseconds, the last bucket takes the rest
+const unsigned long long DECISION_BOUNDS[DECISION_BUCKETS - 1] = {1, 10, 100, 1000, 10000, 100000, 1000000, 5000000, 10000000, 20000000};
 
-void acceptBets(Game* game); // This function iterates over all players and asks them to place their bets, storing the bet amounts for each player.
+typedef struct
+{
+    pthread_mutex_t lock;       // Guards the list, never the counters
+    EngineMetrics* blocks;
+    pthread_key_t threadKey;    // Gives a block back when its thread ends
+    pthread_once_t once;
+    int listenFd;
+    _Atomic bool running;
+    pthread_t thread;
+} MetricsServer;
 
-void resolveBets(Game* game); // After determining the winner, this function resolves the bets, awarding winnings to the player(s) who beat the dealer.
+MetricsServer metrics = {.lock = PTHREAD_MUTEX_INITIALIZER, .once = PTHREAD_ONCE_INIT, .listenFd = -1};
 
-void dealerTurn(Game* game); // This function handles the dealer's behavior, where the dealer reveals their second card and follows the rules to hit or stand.
+_Thread_local EngineMetrics* threadMetrics = NULL;
 
-void playerTurn(Player* player, Game* game); // This function handles the player's turn, allowing them to choose whether to hit, stand, or even surrender.
+//####################################################################
 
-void startRound(Game* game); // This is the main game loop for a round, coordinating the sequence of actions from dealing cards to determining the winner.
+//##########----- STRUCTS FOR THE PLAYER REGISTRY -----################
 
-void handleBetting(Game* game); // This function manages the betting phase, allowing each player to place their bets before the cards are dealt.
+// Everything the server keeps about a player between sessions, the name lives once in the name pool.
+// The name is the only key and nothing proves who sends it, so whoever joins with a known name gets its wallet.
+typedef struct
+{
+    unsigned int id;
+    unsigned int name;          // Offset of the interned name in the name pool
+    double balance;             // Wallet between sessions, the table holds the chips while seated
+    unsigned int tableId;       // Table the player sits at, 0 while away
+    bool held;                  // The seat at tableId came back with a restart and waits for this player
+    unsigned long long sessionId; // Bumped on every join, 0 before the first
+} PlayerAccount;
+
+// key 0 is an empty slot, so ids start at 1 and a name hash of 0 is stored as 1
+typedef struct
+{
+    unsigned int key;
+    unsigned int index;         // Position of the account in the dense array
+} RegistrySlot;
 
-void getPlayersDetails(Game* game); // This function asks players for their details (e.g., name), which are then stored in the game structure.
+// Open addressing with linear probing, one table by id and one by name, both at most half full.
+// A name lookup compares 32 bit hashes and reads a name only when the hashes match.
+// Only the lobby thread touches it.
+typedef struct
+{
+    PlayerAccount* accounts;
+    unsigned int count;
+    unsigned int capacity;
+    RegistrySlot* byId;
+    RegistrySlot* byName;
+    unsigned int slotMask;      // Slots in each table minus one
+    char* names;                // Every name once, each with its terminating zero
+    size_t namesLength;
+    size_t namesCapacity;
+    unsigned int nextId;
+    unsigned long long nextSession;
+} PlayerRegistry;
+
+PlayerRegistry registry = {0};
 
-int getPlayersCount(); // This function asks the user how many players are participating in the game and returns the number of players.
+//####################################################################
 
-void ClearConsole(); // This function clears the console screen, often used to refresh the display during gameplay.
+//##########----- STRUCTS FOR THE FRAUD ANALYZER -----################
 
-void PrintBalance(Player* player); // This function print the chip sum of a player
+typedef enum
+{
+    ANALYZE_SIT,     // A player sat down, with the players already at the table
+    ANALYZE_BET,
+    ANALYZE_PLAY,
+    ANALYZE_RESULT
+} AnalyzeKind;
 
-void printRules(); // This function print the rules of the game
+#define ALERT_COUNTER 1
+#define ALERT_COLLUSION 2
 
-void displayMenu(); //This function display the menu for the game
+// What a table tells the analyzer, the same size whatever the kind so the ring is a plain array
+typedef struct
+{
+    unsigned char kind;          // AnalyzeKind
+    signed char trueCount;
+    unsigned char play;          // Decision of a play, HandOutcome of a result
+    unsigned char total;         // Hand total of a play, the card points for a pair
+    unsigned char handKind;      // HandKind of a play
+    unsigned char upcard;
+    unsigned char mateCount;     // Players already seated when this one sat down
+    unsigned int key;            // registryNameHash of the player's name
+    unsigned int tableId;
+    float units;                 // Bet in smallest bets of the stake
+    unsigned int mates[MAX_PLAYERS - 1];
+    char name[MAX_NAME_LEN];     // Only a sit carries the name
+} AnalyzerRecord;
 
-void initializeRoundReport(Move* move); // This function initializes the round report
+typedef struct
+{
+    _Atomic unsigned long long sequence; // Equal to the position when the slot is free, one past it when it is filled
+    AnalyzerRecord record;
+} AnalyzerSlot;
 
-void sleep_in_seconds(int seconds); // This function sleep in a requested seconds. for any OS
+// Everything the analyzer keeps about one player, the same size however long the player plays
+typedef struct
+{
+    unsigned int key;
+    unsigned int sittings;
+    unsigned long long lastSeen;  // Analyzer clock, the profile unseen the longest makes room for a new player
+    char name[MAX_NAME_LEN];
+    unsigned char alerts;         // ALERT_ bits already written, every alert is raised once
+    unsigned int bets;
+    unsigned int opportunities;   // Plays where a Hi-Lo index departs from basic strategy
+    unsigned int deviations;      // Of those, the plays where the player followed the index
+    // Exponentially decayed sums of the bet against the true count, recent bets weigh the most
+    float weight, sumCount, sumUnits, sumCountUnits, sumCount2, sumUnits2;
+    float highWeight, highUnits;  // Bets at a true count of +2 or more
+    float lowWeight, lowUnits;    // Bets at a true count of 0 or less
+    float hands, wins;            // Decayed the same way
+    unsigned int partner;         // Key of the player it was flagged with
+    unsigned char tablemates[HLL_REGISTERS]; // HyperLogLog of the distinct players it sat down with
+} PlayerProfile;
+
+// The tables push records with one compare and swap each and never wait,
+// a single thread folds them into sketches of fixed size
+typedef struct
+{
+    AnalyzerSlot* ring;
+    _Atomic unsigned long long tail;  // Next position a table claims
+    unsigned long long head;          // Next position the analyzer reads, only its thread touches it
+    PlayerProfile* profiles;
+    unsigned int* pairs;              // Count-min sketch of how often two players sat down together, CMS_DEPTH rows
+    unsigned long long clock;         // Records analyzed
+    FILE* alerts;
+    _Atomic bool running;
+    pthread_t thread;
+} FraudAnalyzer;
+
+FraudAnalyzer analyzer = {0};
 
+//####################################################################
 
-int main() {
-    displayMenu();
-    return 0;
-}
+//##########----- STRUCTS FOR THE SPECTATORS -----################
 
-void PrintBalance(Player* player) {
-    printf("%s Balance: %.2f\n", player->name, player->ChipSum); // Add 'player->name' for the name
-}
+typedef enum
+{
+    EVENT_ROUND,
+    EVENT_SEAT,
+    EVENT_LEAVE,
+    EVENT_MOVE,
+    EVENT_BET,
+    EVENT_DEAL,
+    EVENT_DEALER,
+    EVENT_CARD,
+    EVENT_DOUBLE,
+    EVENT_SPLIT,
+    EVENT_STAND,
+    EVENT_SURRENDER,
+    EVENT_BUST,
+    EVENT_REVEAL,
+    EVENT_DEALER_SCORE,
+    EVENT_RESULT,
+    EVENT_BALANCE,
+    EVENT_CLOSED
+} EventKind;
+
+// One public change of a table, each kind only uses some of the fields
+typedef struct
+{
+    EventKind kind;
+    int seat;
+    int hand;
+    int target;          // Seat a player moves to
+    Card card;
+    Card second;
+    int score;
+    HandOutcome outcome;
+    double amount;
+    const char* name;
+} TableEvent;
+
+#define VIEW_DOUBLED 1
+#define VIEW_LOST 2
+#define VIEW_TIE 4
 
-void initializePlayer(Player* player) {
-    player->ChipSum = 250.0;
-    player->isLost = false;
-    player->isTie = false;
-    player->bet = 0;
-    player->countCard = 2;
-    strcpy(player->name, "Default Name");  // Optional: set a default name
-}
+typedef struct
+{
+    Card cards[MAX_HAND_CARDS];
+    int cardCount;
+    double bet;
+    unsigned char flags;     // VIEW_DOUBLED, VIEW_LOST and VIEW_TIE
+} ViewHand;
 
-void initializeDeck(Deck* deck) {
-    deck->cards = malloc(52 * sizeof(Card));  // Allocate space for 52 cards
-    deck->deckSize = 52;
+typedef struct
+{
+    char name[MAX_NAME_LEN];
+    double balance;
+    ViewHand hands[MAX_HANDS];
+    int handCount;
+} ViewSeat;
 
-    if (deck->cards == NULL) {
-        perror("Failed to allocate memory for deck cards");
-        exit(EXIT_FAILURE);
-    }
+// What a spectator can know about a table, built only from the events so a snapshot
+// never shows a card or a chip before the delta that announces it
+typedef struct
+{
+    Card dealerCards[MAX_CARDS];
+    int dealerCount;
+    ViewSeat seats[MAX_PLAYERS];
+    int seatCount;
+} TableView;
 
-    SUIT suits[4] = {HEARTS, DIAMONDS, SPADES, CLUBS};
-    VALUE values[13] = {ACE, TWO, THREE, FOUR, FIVE, SIX, SEVEN, EIGHT, NINE, TEN, JACK, QUEEN, KING};
+// One public event of a table, formatted once and shared by the queues of every spectator
+typedef struct
+{
+    int refs;        // Queues holding it plus the batch it came in, only the table's thread touches it
+    int length;
+    char data[];
+} BroadcastBuffer;
 
-    for (int i = 0; i < 4; i++) {
-        for (int j = 0; j < 13; j++) {
-            int index = i * 13 + j;
-            deck->cards[index].Suit = suits[i];
-            deck->cards[index].Value = values[j];
-            deck->cards[index].Color = (suits[i] == HEARTS || suits[i] == DIAMONDS) ? RED : BLACK;
-        }
-    }
-}
+typedef struct
+{
+    int fd;
+    int head;        // Oldest event not fully written
+    int count;
+    int offset;      // Bytes of the oldest event already written
+    BroadcastBuffer* queue[SPECTATOR_QUEUE];
+    bool binary;     // Gets binary deltas instead of text lines
+    unsigned long long sentVersion; // Table version the queue brings a binary spectator to
+} Spectator;
 
-void initializeBoard(Board* board) {
-    board->deck = malloc(sizeof(Deck));
-    if (board->deck == NULL) {
-        perror("Failed to allocate memory for deck");
-        exit(EXIT_FAILURE);
-    }
-    initializeDeck(board->deck);  // Initialize the deck within the board
+typedef struct Broadcast
+{
+    Spectator* spectators;
+    int count;
+    int capacity;
+    int textCount;   // Spectators reading text lines
+    BroadcastBuffer* batch[BROADCAST_BATCH]; // Text of the events since the last flush
+    int batchCount;
+    unsigned long long version;        // Every event bumps the table version by one
+    unsigned long long flushedVersion;
+    BroadcastBuffer* history[DELTA_HISTORY]; // Binary delta of each recent version, by version modulo the size
+    unsigned long long deltasFrom;     // Oldest version with a delta kept, events no sync client saw were never encoded
+    BroadcastBuffer* snapshot;         // Full state shared by sync clients too far behind
+    unsigned long long snapshotVersion;
+    TableView view;                    // The table as of the last event
+    Game* game;
+} Broadcast;
+
+const char VALUE_CODES[] = "A23456789TJQK";
+const char SUIT_CODES[] = "HDSC";
 
-    board->sumBetting = 0.0;  // Initialize the betting sum to zero
-    board->dealCardCount = 2;
-}
+//####################################################################
 
-void initializeGame(Game* game, int playerCount) {
-    game->board = malloc(sizeof(Board));
-    if (game->board == NULL) {
-        perror("Failed to allocate memory for board");
-        exit(EXIT_FAILURE);
-    }
-    initializeBoard(game->board);  // Initialize the board
+//##########----- STRUCTS FOR THE GAME SERVER -----################
 
-    game->players = malloc(playerCount * sizeof(Player));
-    game->numPlayers = playerCount;
-    if (game->players == NULL) {
-        perror("Failed to allocate memory for players");
-        exit(EXIT_FAILURE);
-    }
-    for (int i = 0; i < playerCount; i++) {
-        initializePlayer(&game->players[i]);
-    }
-}
+// Every online table is played by its own thread, new players reach it between rounds
+typedef struct TableRunner
+{
+    Table* table;
+    pthread_mutex_t lock;
+    pthread_cond_t arrived;
+    LobbyTicket* arrivals;        // Seated players not at the table yet, newest first
+    LobbyTicket* tickets[MAX_PLAYERS]; // The join ticket of every seat, it carries the seat back to the lobby
+    bool closing;
+    Broadcast broadcast;
+} TableRunner;
 
-void shuffleDeck(Deck* deck) {
-    // Seed the random number generator
-    srand((unsigned) time(NULL));
+typedef struct
+{
+    int listenFd;
+    int port;
+    _Atomic bool running;
+    pthread_t gateways[SERVER_GATEWAYS];
+    pthread_t localGateway;
+    pthread_t lobbyThread;
+} GameServer;
 
-    for (int i = 51; i > 0; i--) {
-        // Generate a random index between 0 and i
-        int j = rand() % (i + 1);
+GameServer server = {.listenFd = -1};
 
-        // Swap deck->card[i] with deck->card[j]
-        Card temp = deck->cards[i];
-        deck->cards[i] = deck->cards[j];
-        deck->cards[j] = temp;
-    }
-}
+//####################################################################
 
-void freeGame(Game* game) {
-    // Free the cards array in the deck
-    if (game->board->deck->cards != NULL) {
-        free(game->board->deck->cards);
-    }
+//##########----- STRUCTS FOR THE LOCAL CLIENTS -----################
 
-    // Free the deck itself
-    if (game->board->deck != NULL) {
-        free(game->board->deck);
-    }
+typedef enum
+{
+    LOCAL_FREE,
+    LOCAL_CLAIMING,  // A client is resetting the rings, the game keeps away
+    LOCAL_OPEN,      // The client may send its JOIN line
+    LOCAL_PLAYING    // The lobby has the player
+} LocalState;
+
+// One direction of a channel, exactly one process writes it and the other reads it.
+// The counters only grow and sit on their own cache lines so the two sides never share one.
+typedef struct
+{
+    _Alignas(64) _Atomic unsigned int tail;  // Bytes ever written, only the writer moves it
+    _Alignas(64) _Atomic unsigned int head;  // Bytes ever read, only the reader moves it
+    _Atomic unsigned int sleeping;           // The reader sleeps on tail in the kernel, the writer has to wake it
+    _Alignas(64) char data[LOCAL_RING_SIZE];
+} LocalRing;
+
+// A client on this machine speaks the same lines as a socket, through two rings in shared memory
+typedef struct LocalChannel
+{
+    _Atomic int state;       // LocalState
+    _Atomic int hangUps;     // Sides that are done, the second one frees the channel
+    _Atomic bool gameDone;   // The game side has hung up, a client that died after that is freed by the gateway
+    int clientPid;           // Looked at when the client goes quiet, a dead client leaves its seat
+    LocalRing toGame;
+    LocalRing toClient;
+} LocalChannel;
 
-    // Free the board
-    if (game->board != NULL) {
-        free(game->board);
-    }
+typedef struct
+{
+    char magic[8];
+    unsigned int version;
+    int serverPid;           // Process that created the object, one left by a dead process may be replaced
+    LocalChannel channels[LOCAL_CHANNELS];
+} LocalTransport;
 
-    // Free the players array
-    if (game->players != NULL) {
-        free(game->players);
-    }
-}
+LocalTransport* localTransport = NULL; // Created by startServer, or attached by a local client
+long localSpins = LOCAL_SPINS;         // 0 on a single CPU, where spinning only keeps the other side from running
 
-void dealCards(Game* game) {
-    // Shuffle the deck before dealing
-    shuffleDeck(game->board->deck);
+//####################################################################
 
-    // Deal two cards to each player
-    for (int i = 0; i < game->numPlayers; i++) {
-        for (int j = 0; j < 2; j++) {
-            game->players[i].card[j] = game->board->deck->cards[0];
-            RemoveFromDeck(game, &game->board->deck->cards[0]);
-        }
-    }
+//##########----- STRUCTS FOR THE LOAD TEST -----################
 
-    // Deal two cards to the dealer
-    for (int j = 0; j < 2; j++) {
-        game->board->dealerCards[j] = game->board->deck->cards[0];
-        RemoveFromDeck(game, &game->board->deck->cards[0]);
-    }
-}
+typedef enum
+{
+    LOAD_JOIN,
+    LOAD_BET,
+    LOAD_HIT,
+    LOAD_STAND,
+    LOAD_SURRENDER,
+    LOAD_LEAVE,
+    LOAD_ACTIONS,
+    LOAD_NONE = LOAD_ACTIONS
+} LoadAction;
+
+const char* LOAD_ACTION_NAMES[LOAD_ACTIONS] = {"JOIN", "BET", "HIT", "STAND", "SURRENDER", "LEAVE"};
+
+// Log-linear buckets in the style of HdrHistogram: exact below 128us, then 64 buckets per power of two
+typedef struct
+{
+    long long counts[HIST_BUCKETS];
+    long long total;
+    long long max;
+} LatencyHistogram;
 
-void RemoveFromDeck(Game* game, Card* card) {
-    Deck* deck = game->board->deck;
-    int cardIndex = -1;
+typedef struct
+{
+    SeatLink link;
+    bool active;
+    LoadAction waiting;          // Action whose reply is still on its way
+    unsigned long long sentAt;   // Microseconds, the planned start for an open loop JOIN
+    unsigned long long retryAt;  // A closed loop client turned away as busy waits until then to join again
+    int roundsLeft;
+} LoadClient;
 
-    // Find the card index in the deck
-    for (int i = 0; i < deck->deckSize; i++) {
-        if (deck->cards[i].Suit == card->Suit && deck->cards[i].Value == card->Value) {
-            cardIndex = i;
-            break;
-        }
-    }
+typedef struct
+{
+    pthread_t thread;
+    LoadClient* clients;
+    int clientCount;
+    double arrivalIntervalUs;    // Open loop only, time between two new sessions of this thread
+    LatencyHistogram histograms[LOAD_ACTIONS];
+    long rounds;
+    long sessions;
+    long errors;
+    long busy;                   // Joins the server turned away because it was overloaded
+    long dropped;                // Open loop arrivals that found every client of the thread busy
+    int firstClientId;           // Keeps the player names of the threads apart
+} LoadWorker;
 
-    // If card was found, shift remaining cards left to fill the gap
-    if (cardIndex != -1) {
-        for (int i = cardIndex; i < deck->deckSize - 1; i++) {
-            deck->cards[i] = deck->cards[i + 1];
+typedef struct
+{
+    int port;
+    bool openLoop;
+    int roundsPerSession;
+    unsigned long long startAt;
+    unsigned long long stopAt;
+} LoadTest;
+
+LoadTest loadTest;
+
+//####################################################################
+
+//##########----- STRUCTS FOR THE CHIPS WRITE AHEAD LOG -----################
+
+typedef enum
+{
+    WAL_BET,
+    WAL_PAYOUT,
+    WAL_SURRENDER,
+    WAL_DOUBLE,
+    WAL_SPLIT,
+    WAL_ROUND_OPEN,     // The table takes its first bet of a round after this
+    WAL_ROUND_SETTLED,  // Every payout of the round is in front of this
+    WAL_ACCOUNT         // A new account, its name in pieces over as many records as it takes
+} WalKind;
+
+typedef struct
+{
+    unsigned long long lsn;  // Log sequence number, one per chip change
+    unsigned int tableId;
+    unsigned char seat;      // WAL_NO_SEAT for the round markers, the piece of the name for WAL_ACCOUNT
+    unsigned char kind;      // WalKind
+    unsigned short reserved;
+    union
+    {
+        struct
+        {
+            double delta;
+            double balance;  // ChipSum after the change, replay sets it directly so it can run twice
+        };
+        char name[WAL_NAME_PIECE];
+    };
+    unsigned int playerId;   // Account of an online seat, 0 for a seat at this terminal
+    unsigned int checksum;   // Catches a record torn by a crash in the middle of a write
+} WalRecord;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t hasWork;   // Signals the flusher
+    pthread_cond_t flushed;   // Signals the tables waiting for their records to be durable
+    WalRecord* pending;       // Records appended since the last flush started
+    int pendingCount;
+    int pendingCapacity;
+    unsigned long long lastLsn;
+    unsigned long long durableLsn;
+    unsigned long long rotateAfterLsn; // Records after this go to the next segment, 0 when no rotation is asked
+    bool rotatePending;
+    unsigned int segment;
+    int fd;
+    bool running;
+    pthread_t flusher;
+} WriteAheadLog;
+
+// What replay knows of the last round of a table, a round the log never saw settle is paid back
+typedef struct
+{
+    bool open;
+    bool changed[MAX_PLAYERS];    // The seat's chips changed during the round
+    double before[MAX_PLAYERS];   // Chips of the seat before its first change of the round
+    unsigned int players[MAX_PLAYERS]; // Account of the seat when it changed, 0 at this terminal
+    unsigned long long lsn[MAX_PLAYERS]; // Last change of the seat in the round
+} WalRound;
+
+// What replay knows of the last logged change of an account
+typedef struct
+{
+    unsigned long long lsn;
+    unsigned int tableId;
+} WalLastChange;
+
+WriteAheadLog wal = {.lock = PTHREAD_MUTEX_INITIALIZER, .hasWork = PTHREAD_COND_INITIALIZER, .flushed = PTHREAD_COND_INITIALIZER};
+
+//####################################################################
+
+//##########----- STRUCTS FOR THE BOT STRATEGIES -----################
+
+typedef enum
+{
+    STRATEGY_HUMAN,
+    STRATEGY_BASIC,
+    STRATEGY_HILO
+} StrategyId;
+
+typedef enum
+{
+    HAND_HARD,
+    HAND_SOFT,
+    HAND_PAIR
+} HandKind;
+
+typedef struct
+{
+    int total;       // Hand total the deviation applies to, the card points for a pair
+    HandKind kind;   // Which chart the deviation overrides
+    int upcard;      // Dealer upcard (2-11, 11 is an Ace)
+    int index;       // True count at which the play changes
+    char below;      // Chart letter to play below the index
+    char atOrAbove;  // Chart letter to play at or above the index
+} Deviation;
+
+typedef struct
+{
+    char name[MAX_NAME_LEN];
+    unsigned char play[TC_BUCKETS][3][22][10]; // PLAY_ENTRY for [true count][hand kind][total][upcard - 2]
+    unsigned char betUnits[TC_BUCKETS];        // Bet ramp in BOT_BET_UNITs per true count
+} Strategy;
+
+Strategy strategies[MAX_STRATEGIES];
+int strategyCount = 0;
+
+// A table entry holds the preferred play and the play to fall back on when it is not allowed
+#define PLAY_ENTRY(preferred, fallback) ((preferred) | ((fallback) << 4))
+#define PLAY_PREFERRED(entry) ((Decision) ((entry) & 0x0F))
+#define PLAY_FALLBACK(entry) ((Decision) ((entry) >> 4))
+
+// One table lookup per decision, the chart was compiled into the table by registerStrategy
+static inline unsigned char strategyDecide(const Strategy* strategy, int total, HandKind kind, int upcard, int trueCount) {
+    return strategy->play[trueCount - TC_MIN][kind][total][upcard - 2];
+}
+
+//####################################################################
+
+//##########----- STRUCTS FOR THE RULE SETS -----################
+
+typedef struct
+{
+    const char* name;
+    int decks;
+    bool hitSoft17;       // The dealer hits a soft 17 instead of standing on it
+    int blackjackPays;    // A natural wins blackjackPays for every blackjackPer bet
+    int blackjackPer;
+    bool surrender;
+    bool resplit;         // A split hand that is a pair again may split, up to MAX_HANDS hands
+    double penetration;   // Share of the shoe dealt before it is reshuffled, 0 shuffles every round
+    bool continuous;      // A continuous shuffling machine, every draw is a random card of what is in it
+    void (*playRound)(Game* game); // The round compiled for these rules
+} RuleSet;
+
+#define RULE_SET_ENGINE_PROTOTYPE(id, engine, ...) void playRound##engine(Game* game);
+RULE_SET_LIST(RULE_SET_ENGINE_PROTOTYPE)
+
+#define RULE_SET_ENTRY(id, engine, name, decks, hitSoft17, pays, per, surrender, resplit, penetration, continuous) \
+    [id] = {name, decks, hitSoft17, pays, per, surrender, resplit, penetration, continuous, playRound##engine},
+const RuleSet RULES[RULE_SET_COUNT] = {
+    RULE_SET_LIST(RULE_SET_ENTRY)
+};
+
+//####################################################################
+
+//##########----- STRUCTS FOR THE ODDS OVERLAY -----################
+
+typedef enum
+{
+    DEALER_17,
+    DEALER_18,
+    DEALER_19,
+    DEALER_20,
+    DEALER_21,
+    DEALER_BLACKJACK,
+    DEALER_BUST,
+    DEALER_OUTCOMES
+} DealerOutcome;
+
+// What a player sees before a decision, worked out from the cards the player has not seen
+typedef struct
+{
+    double bust;                       // Chance the next card busts the hand
+    double dealer[DEALER_OUTCOMES];    // Chance of every way the dealer can finish
+} HandOdds;
+
+// The dealer's future only depends on which cards it drew, not their order,
+// so every set of drawn cards is worked out once per composition
+typedef struct
+{
+    unsigned long long keys[ODDS_MEMO];   // Cards drawn, five bits a rank, 0 marks a free entry
+    double outcomes[ODDS_MEMO][DEALER_OUTCOMES];
+} OddsMemo;
+
+typedef struct
+{
+    unsigned short ranks[10];  // The unseen cards the result was worked out from
+    unsigned char upcard;      // 0 for an empty entry
+    bool hitSoft17;
+    double dealer[DEALER_OUTCOMES];
+} OddsCacheEntry;
+
+// Every table thread keeps its last results, a prompt asked again costs a lookup
+_Thread_local OddsCacheEntry oddsCache[ODDS_CACHE];
+
+//####################################################################
+
+//##########----- STRUCTS FOR THE HOUSE EDGE -----################
+
+// A player hand is worked out once per set of cards it holds, since the shoe it plays on follows from them
+typedef struct
+{
+    unsigned long long keys[EDGE_MEMO];   // Cards the player holds, five bits a rank, 0 marks a free entry
+    double stand[EDGE_MEMO];              // Worth of standing on the hand
+    double best[EDGE_MEMO];               // Worth of the better of standing and hitting on
+} EdgeMemo;
+
+// The shoe a job plays on, less the upcard and every card the player holds
+typedef struct
+{
+    unsigned short ranks[10];
+    int left;
+    int upcard;                // Points of the dealer upcard
+    const RuleSet* rules;
+    EdgeMemo* memo;
+} EdgeShoe;
+
+// A job is one upcard with either every unsplit first two cards or one pair that splits
+typedef struct
+{
+    RuleSet rules;                  // The rule set with the decks the calculator was asked for
+    unsigned short shoe[10];        // Every card of a full shoe of those decks
+    _Atomic int nextJob;
+    double ev[10][10][10];          // Best unsplit EV of every upcard and first two cards, in bets
+    Decision play[10][10][10];      // The play that gets it
+    double split[10][10];           // EV of splitting every pair against every upcard, both hands together
+} HouseEdge;
+
+#define EDGE_JOBS (10 * 11)
+
+const char EDGE_PLAY_LETTERS[] = {[HIT] = 'H', [STAND] = 'S', [SURRENDER] = 'R', [DOUBLE] = 'D', [SPLIT] = 'P'};
+
+//####################################################################
+
+//##########----- STRUCTS FOR THE SIMULATION STATS -----################
+
+// Welford's running mean and variance, stable over billions of samples
+typedef struct
+{
+    long long count;
+    double mean;
+    double m2;       // Sum of squared distances from the mean
+} RunningStats;
+
+typedef struct
+{
+    RunningStats net;  // Chips won or lost by the seat each round
+    double wagered;
+    long long wins;    // Hands, the way Move counts them
+    long long ties;
+    long long losses;
+} SeatStats;
+
+// Welford's running means and co-moments of what each shoe gives two contenders, a shoe holds no fixed
+// number of rounds, so an EV is total net over total rounds and its variance comes from the delta method
+typedef struct
+{
+    long long count;
+    double mean[4];         // Net of A, rounds of A, net of B and rounds of B per shoe
+    double comoment[4][4];  // Sums of products of distances from the means
+} PairedStats;
+
+// Everything a simulator thread carries from one batch to the next, a checkpoint is these blocks as they are in memory
+typedef struct
+{
+    SeatStats seats[MAX_PLAYERS];  // Every batch the thread played, merged in the order it played them
+    Table table;                   // The thread's game, shoe and generator, kept in one block like a live table
+} SimulationWorker;
+
+// The threads play a batch each and wait for each other, so the totals, the stop and every checkpoint
+// fall on the same rounds however the threads were scheduled
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t batchDone;      // Every thread has merged its batch
+    pthread_cond_t checkpointReady;
+    SimulationWorker* workers;     // SIM_THREADS of them
+    SimulationWorker* saved;       // Copy of the workers the checkpoint writer has not written yet
+    bool savePending;
+    unsigned long long savedAt;    // Milliseconds, when the last copy was taken
+    int arrived;                   // Threads done with the current batch
+    int exited;
+    int started;                   // Threads that have taken their worker
+    unsigned long long generation; // Batches every thread has finished
+    SeatStats seats[MAX_PLAYERS];  // The workers merged in thread order
+    int seatCount;
+    RuleId rules;
+    long long rounds;
+    long long savedRounds;         // Rounds the copy in saved stands for
+    long long maxRounds;
+    double targetPercent;  // Stop once every seat's EV is known within this many percent, 0 plays maxRounds
+    _Atomic bool done;
+} SimulationRun;
+
+// Header of a simulation checkpoint, followed by SIM_THREADS workers when the rule set in progress has played rounds
+typedef struct
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int workerSize;       // sizeof(SimulationWorker), another build cannot resume the workers
+    unsigned long long seed;       // Every worker's shoe is seeded from this, the rule set and its thread
+    long long maxRounds;
+    double targetPercent;
+    int seatCount;
+    int ruleSet;                   // Rule set in progress, the ones before it are finished
+    long long rounds;              // Rounds the rule set in progress has played
+    long long finishedRounds[RULE_SET_COUNT];
+    SeatStats finished[RULE_SET_COUNT][MAX_PLAYERS];
+} SimulationCheckpoint;
+
+//####################################################################
+
+//##########----- STRUCTS FOR THE TOURNAMENT -----################
+
+typedef struct
+{
+    double chips;
+    int strategyId;
+    int bucket;          // Leaderboard bucket the entrant is counted in, its chips in half chips
+    int bustedLevel;     // Level the entrant went out in, 0 while still playing
+    unsigned int id;
+} Entrant;
+
+// A stack in the bucket the cut runs through, with its place in the seating
+typedef struct
+{
+    double chips;
+    int seat;
+} CutStack;
+
+// Entrants counted by half chips in a Fenwick tree, the smallest step a payout makes. A hand moves an entrant between two buckets
+// and finding a rank or the stack at a rank is one walk down the tree, so nothing is ever sorted.
+// Tables update it with atomic adds while they play, so the live view is only exact between levels
+typedef struct
+{
+    _Atomic int* tree;   // LEADERBOARD_BUCKETS counters, 1 based
+    int entrants;
+} Leaderboard;
+
+// The tables of a level a thread still has to play, packed as next | end << 32. The owner takes
+// tables from the front, an idle thread steals the back half
+typedef struct
+{
+    _Alignas(64) _Atomic unsigned long long range;
+} TableDeque;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t start;        // A new level is dealt out, or the tournament is over
+    pthread_cond_t finished;     // Every thread ran out of tables
+    unsigned long long level;
+    int started;                 // Threads that have taken their deque
+    int idle;                    // Threads done with the current level
+    bool over;
+    TableDeque deques[TOURNAMENT_THREADS_MAX];
+    int threads;
+    Entrant* entrants;
+    int* seating;                // Entrant indexes, table t seats seating[t], seating[t + tables], ...
+    int seated;
+    int tables;
+    int hands;                   // Hands every table plays in a level
+    RuleId rules;
+    unsigned long long seed;
+    Leaderboard leaderboard;
+    _Atomic int tablesDone;
+    _Atomic unsigned long long longestTable;  // Microseconds the slowest table of the level took
+} Tournament;
+
+//####################################################################
+
+//##########----- STRUCTS FOR THE BANKROLL PATHS -----################
+
+// One lane per bankroll path, the vector types map onto SIMD registers
+typedef double LaneReal __attribute__((vector_size(BANKROLL_LANES * sizeof(double))));
+typedef long long LaneMask __attribute__((vector_size(BANKROLL_LANES * sizeof(long long))));
+typedef unsigned long long LaneBits __attribute__((vector_size(BANKROLL_LANES * sizeof(unsigned long long))));
+typedef int LaneIndex __attribute__((vector_size(BANKROLL_LANES * sizeof(int))));
+
+// Per lane whenSet where the comparison mask is set, a macro since vector arguments change the call ABI
+#define LANE_SELECT(mask, whenSet, otherwise) ((LaneReal) (((LaneMask) (whenSet) & (mask)) | ((LaneMask) (otherwise) & ~(mask))))
+
+// One bin of Walker's alias table, the two outcomes it may give sit on the same cache line
+typedef struct
+{
+    double keepBelow;  // A uniform below this keeps value, otherwise the draw is aliasValue
+    double value;      // Net of the round in betting units
+    double aliasValue;
+} OutcomeBin;
+
+// Any outcome of a round is drawn with one uniform and one lookup
+typedef struct
+{
+    int count;
+    OutcomeBin bins[OUTCOME_BINS];
+    double mean;
+} OutcomeTable;
+
+// Structure of arrays, lane l of block b is path b * BANKROLL_LANES + l in every array
+typedef struct
+{
+    long count;          // A multiple of BANKROLL_LANES
+    double* endChips;
+    double* drawdown;    // Deepest fall from the highest bankroll of the path
+    double* rounds;      // Rounds played before ruin or the end of the session
+    bool* ruined;
+} BankrollPaths;
+
+typedef struct
+{
+    BankrollPaths* paths;
+    const OutcomeTable* outcomes;
+    long firstBlock;
+    long lastBlock;
+    double minBet;       // A bankroll below the table minimum is ruined
+    int sessionRounds;
+    unsigned long long seed;
+} BankrollJob;
+
+//####################################################################
+
+
+// Map values and suits to their string representations
+const char* VALUE_NAMES[] = {"Ace", "Two", "Three", "Four", "Five", "Six", "Seven", "Eight", "Nine", "Ten", "Jack", "Queen", "King"};
+const char* SUIT_NAMES[] = {"Hearts", "Diamonds", "Spades", "Clubs"};
+const char* COLOR_NAMES[] = {"Red", "Black"};
+
+
+printCardLogo(); // This function print the starting of the game
+
+void showLoadingProgress(); // This is a stylish function to print a progress bar
+
+void initializePlayer(Player* player); // This function initializes a player with default values (e.g., name, chips, and other necessary attributes).
+
+void initializeBoard(Board* board);// This function initializes the game board, including setting up the dealer's cards and any other board-related data.
+
+void initializeDeck(Deck* deck, int decks); // This function fills the shoe with the given number of decks, ensuring that all cards are available for use in the game.
+
+void shuffleDeck(Deck* deck); // This function shuffles the deck to ensure randomness before cards are dealt.
+
+void shuffleDeckMirrored(Deck* deck); // This function shuffles with the same random draws as shuffleDeck but mirrors every swap index, the antithetic twin of that shuffle
+
+void freeGame(Game* game); // This function cleans up the game resources (e.g., freeing allocated memory for players, deck, etc.) when the game ends.
+
+RULES_INLINE void dealCards(Game* game, const RuleSet* rules); // This function deals cards to all players and the dealer at the start of a round.
+
+void RemoveFromDeck(Game* game, Card* card); // This function removes a specific card from the deck after it has been dealt to a player or dealer.
+
+void InsertToDeck(Game* game, Card* card); // This function inserts a card back into the deck (useful when reshuffling or returning cards to the deck).
+
+void fillDeckRanks(Deck* deck, int decks); // This function sets the cards left of every point value to those of a full shoe
+
+void returnDiscards(Deck* deck); // This function puts every card a continuous shuffling machine dealt this round back into it
+
+void printCard(Card* card); // This function prints out the details of a single card (e.g., the card's rank and suit).
+
+RULES_INLINE void DetermineWinner(Game* game, const RuleSet* rules); // This function determines the winner of the round by comparing the scores of all players and the dealer. It will announce the result accordingly.
+
+int CalculateScore(Card* card, int cardCount); // This function calculates the score of a hand, based on the cards in the hand. It sums up the values of the cards.
+
+unsigned long long placeBet(Game* game, Player* player, double betAmount); // This function allows a player to place a bet and logs the chips it takes. The bet counts once the returned log record is durable.
+
+void acceptBets(Game* game); // This function iterates over all players and asks them to place their bets, storing the bet amounts for each player.
+
+RULES_INLINE void resolveBets(Game* game, const RuleSet* rules); // After determining the winner, this function resolves the bets, awarding winnings to the player(s) who beat the dealer.
+
+RULES_INLINE void dealerTurn(Game* game, const RuleSet* rules); // This function handles the dealer's behavior, where the dealer reveals their second card and follows the rules to hit or stand.
+
+RULES_INLINE void playerTurn(Player* player, Game* game, const RuleSet* rules); // This function handles the player's turn, allowing them to choose whether to hit, stand, or even surrender.
+
+void startRound(Game* game); // This is the main game loop for a round, coordinating the sequence of actions from dealing cards to determining the winner.
+
+void handleBetting(Game* game); // This function manages the betting phase, allowing each player to place their bets before the cards are dealt.
+
+void getPlayersDetails(Game* game); // This function asks players for their details (e.g., name), which are then stored in the game structure.
+
+int getPlayersCount(); // This function asks the user how many players are participating in the game and returns the number of players.
+
+RuleId getRuleSet(); // This function lists the rule sets and asks the user which one the table plays
+
+void ClearConsole(); // This function clears the console screen, often used to refresh the display during gameplay.
+
+void PrintBalance(Player* player); // This function print the chip sum of a player
+
+void printRules(); // This function print the rules of the game
+
+void displayMenu(); //This function display the menu for the game
+
+void sleep_in_seconds(int seconds); // This function sleep in a requested seconds. for any OS
+
+void seedDeck(Deck* deck, unsigned long long seed); // This function seeds the random generator the deck shuffles with
+
+unsigned int nextRandom(Deck* deck, unsigned int bound); // This function returns a uniform random number in [0, bound) from the deck generator
+
+RULES_INLINE Card drawCard(Game* game, const RuleSet* rules); // This function takes the next card of the deck and adds it to the running count
+
+RULES_INLINE Card takeCard(Game* game, const RuleSet* rules); // This function takes the next card of the deck, the top one of a shoe or a random one of a shuffling machine
+
+void updateRunningCount(Board* board, Card* card); // This function adds a shown card to the Hi-Lo running count
+
+int getTrueCount(Board* board); // This function converts the running count to a true count, clamped to the decision tables range
+
+int cardPoints(Card* card); // This function returns the blackjack points of a single card (2-11, an Ace is 11)
+
+int calculateSoftScore(Card* cards, int cardCount, bool* soft); // This function calculates the score of a hand and reports whether an Ace still counts as 11
+
+void resetRound(Game* game); // This function clears the hands and bets and reshuffles the shoe once the rules say it is dealt deep enough
+
+void playRound(Game* game); // This function plays one full round, from the bets to the payouts, with the engine of the table's rules
+
+RULES_INLINE void playRoundWith(Game* game, const RuleSet* rules); // This function is the round every rule set engine is compiled from
+
+bool isNatural(Card* cards, int cardCount); // This function tells whether a hand is a two card 21
+
+int registerStrategy(const char* name, const char* hardChart[18], const char* softChart[10], const char* pairChart[10], const Deviation* deviations, int deviationCount, const int betUnits[TC_BUCKETS]); // This function compiles a strategy chart into a decision table and returns its id
+
+void initializeStrategies(); // This function compiles the built in house bot strategies
+
+Decision askPlayerDecision(Timer* timer, bool canDouble, bool canSplit, bool canSurrender); // This function asks a human player for one of the plays the hand allows, it stands when the timer runs out first
+
+Decision botDecision(Player* player, Hand* hand, Game* game, bool canDouble, bool canSplit, bool canSurrender); // This function looks up the play of a house bot and falls back when it is not allowed
+
+RULES_INLINE void playHand(Player* player, int handIndex, Game* game, const RuleSet* rules); // This function plays a single hand of a seat until it stands, busts, doubles or surrenders
+
+void splitHand(Player* player, int handIndex); // This function moves the second card of a pair into a new hand with the same bet
+
+double strategyBet(Game* game, Player* player); // This function returns the bet a house bot places for the current count, never below the table minimum
+
+void addHouseBots(Game* game, int firstSeat); // This function turns the seats from firstSeat onwards into house bots
+
+void simulateStrategies(); // This function plays silent bots only tables under every rule set until the EVs are precise enough and reports how each strategy did
+
+void statsAdd(RunningStats* stats, double x); // This function adds one sample to a running mean and variance
+
+void statsMerge(RunningStats* into, const RunningStats* from); // This function folds the samples of one accumulator into another as if they had been added one by one
+
+double statsVariance(const RunningStats* stats); // This function returns the sample variance of the accumulated samples
+
+double statsHalfWidth(const RunningStats* stats); // This function returns the half width of the 95% confidence interval on the mean
+
+void pairedAdd(PairedStats* stats, const double sample[4]); // This function adds the net and rounds of both contenders on one shoe
+
+double pairedRatio(const PairedStats* stats, int contender); // This function returns the net per round of a contender over every shoe
+
+double pairedVariance(const PairedStats* stats, double signA, double signB); // This function returns the delta method variance of signA times the EV of A plus signB times the EV of B
+
+void seatStatsMerge(SeatStats* into, const SeatStats* from); // This function folds the results of a seat from one thread into the totals
+
+void* runSimulationWorker(void* argument); // This function plays rounds on a thread's own table in batches, merges each batch and stops when the run is done
+
+void initializeSimulationWorker(SimulationWorker* worker, int seatCount, RuleId rules, unsigned long long seed); // This function sets up a thread's bots only table with its shoe seeded for the run
+
+int simulationBatchRounds(const SimulationRun* run, int worker); // This function returns the rounds a worker plays in the next batch, the last batch only plays what is left of maxRounds
+
+void simulationBatchDone(SimulationRun* run); // This function waits for every thread to finish its batch, then merges the totals, decides the stop and copies a checkpoint when one is due
+
+void runStrategySimulation(SimulationCheckpoint* checkpoint, SimulationWorker* resumed); // This function plays every rule set from the checkpoint on and saves where it is as it goes
+
+bool writeSimulationCheckpoint(const SimulationCheckpoint* checkpoint, const SimulationWorker* workers); // This function replaces the checkpoint file with the run so far, workers may be NULL between rule sets
+
+bool loadSimulationCheckpoint(SimulationCheckpoint* checkpoint, SimulationWorker** workers); // This function reads the checkpoint file, workers is left NULL when the rule set in progress had not played yet
+
+void printSimulationReport(const SeatStats* seats, int seatCount, long long rounds, RuleId rules, Game* names); // This function prints how every bot did under one rule set
+
+void sampleOutcomes(OutcomeTable* table, int strategyId, RuleId rules); // This function plays a bot through the engine and builds the alias table of its net per round
+
+void buildAliasTable(OutcomeTable* table, const double* weights); // This function turns bin weights into Walker's alias table
+
+void* runBankrollWorker(void* argument); // This function advances a range of bankroll path blocks, a whole SIMD block per step, until ruin or the end of the session
+
+int compareDoubles(const void* a, const void* b); // This function orders doubles for qsort
+
+void simulateBankrolls(); // This function estimates risk of ruin, session length and drawdowns of a strategy at every table limit
+
+bool shoeDue(Game* game); // This function tells whether the shoe has been dealt past the cut card of the table's rules
+
+double playShoe(Game* game, unsigned long long seed, bool mirrored, long* rounds); // This function plays one shoe shuffled from seed until its cut card and returns the seat's net in betting units
+
+unsigned long long mixSeed(unsigned long long x); // This function scrambles a counter into a well spread shoe seed
+
+void dealerOdds(const unsigned short* unseen, int upcard, bool hitSoft17, double* outcomes); // This function works out the exact chance of every dealer outcome from the unseen cards, or takes it from the thread's cache
+
+void handOdds(Game* game, Hand* hand, bool hitSoft17, HandOdds* odds); // This function works out the overlay of a hand from what its player has seen, the hole card stays unknown
+
+void printOdds(const HandOdds* odds); // This function shows the odds overlay on the terminal
+
+double edgeStand(EdgeShoe* shoe, int total, bool natural); // This function works out what standing on a total is worth against every way the dealer can finish
+
+void edgeHand(EdgeShoe* shoe, int hard, bool ace, int cards, unsigned long long drawn, double* stand, double* best); // This function works out what standing on a hand and what playing it on are worth, or takes them from the memo
+
+double edgeDraw(EdgeShoe* shoe, int hard, bool ace, int cards, unsigned long long drawn, bool doubled); // This function works out what one more card is worth, a hit plays on after it and a double stands
+
+double edgeFirstPlay(EdgeShoe* shoe, int first, int second, bool split, Decision* play); // This function finds the best first play of two cards and what it is worth
+
+void* runHouseEdgeWorker(void* argument); // This function works out the jobs of the house edge calculator until none are left
+
+void calculateHouseEdge(); // This function works out the exact house edge of a rule set that splits once, for any number of decks, and prints the EV of every first hand
+
+int getStrategy(); // This function lists the bot strategies and asks the user for one
+
+void compareStrategies(); // This function plays two strategy and rule set pairs on the same shoes and reports their EV difference with a confidence interval
+
+void runTournament(); // This function plays bots only tables in elimination levels until one entrant is left with the most chips
+
+void* runTournamentWorker(void* argument); // This function plays the tables of every level it is handed, stealing from the other threads once its own run out
+
+int tournamentTakeTable(Tournament* tournament, int self); // This function takes the next table of a thread's own deque or steals half of another's, -1 once the level has none left
+
+void playTournamentTable(Tournament* tournament, Table* table, int index); // This function seats one table of the level, plays its hands and puts the stacks back on the entrants
+
+void tournamentSeat(Tournament* tournament); // This function shuffles the entrants still in onto new tables and deals the tables out to the threads
+
+int compareCutStacks(const void* a, const void* b); // This function orders stacks of the cut bucket biggest first, then by seat
+
+int tournamentCut(Tournament* tournament); // This function sends the busted entrants and everyone below the top half home and returns how many go on
+
+void leaderboardAdd(Leaderboard* leaderboard, int bucket, int delta); // This function counts entrants in or out of a bucket
+
+void leaderboardMove(Leaderboard* leaderboard, int from, int to); // This function moves one entrant between buckets
+
+int leaderboardCountBelow(Leaderboard* leaderboard, int bucket); // This function returns how many entrants have a stack below the bucket
+
+int leaderboardStackAt(Leaderboard* leaderboard, int rank); // This function returns the bucket of the entrant with this rank, 1 being the chip leader
+
+int leaderboardBucket(double chips); // This function returns the bucket of a stack
+
+Table* openTable(int playerCount); // This function allocates a live table in one block and registers it
+void attachTable(Table* table); // This function points the Game, Board and Deck of a table at the table's own storage
+
+void closeTable(Table* table); // This function unregisters a live table and gives it back to the pool
+
+void tablePoolReserve(int count); // This function makes sure the pool holds at least count free tables
+
+void lobbyInit(); // This function empties the join queue and offers the open seats of the restored tables
+
+void lobbySubmit(LobbyTicket* ticket); // This function queues a ticket of any kind and wakes the lobby if it sleeps, it is safe from any thread and never blocks
+
+void lobbyJoin(LobbyTicket* ticket); // This function queues a join request, it is safe from any thread and never blocks
+
+void lobbyReject(LobbyTicket* ticket, const char* reason); // This function turns a join away and tells an online player why
+
+void lobbyReleaseHolds(); // This function gives up the seats restored tables still hold, their players keep the chips in their wallets
+
+int lobbyDrain(int max); // This function seats up to max queued players, gives back the seats of leaving players and returns how many tickets it took off the queue
+
+bool lobbyEmpty(); // This function tells the lobby thread whether the join queue holds nothing, the way lobbyPop sees it
+bool lobbyWait(int timeoutMs); // This function sleeps until a join arrives or the timeout passes, it returns true if there is work
+
+void admissionSample(unsigned long long lagMicros); // This function folds one measured lobby delay into the loop latency and sets the admission level
+
+bool admissionBusy(); // This function tells a gateway whether the host is too busy to queue another join
+
+void lowerThreadPriority(); // This function schedules the calling thread below the table threads
+
+Table* findTable(unsigned int tableId); // This function returns the live table with this id, NULL when there is none
+
+PlayerAccount* registryFind(unsigned int id); // This function returns the account with this id, NULL when there is none
+
+PlayerAccount* registryFindName(const char* name); // This function returns the account with this name, NULL when there is none
+
+PlayerAccount* registryAdd(unsigned int id, const char* name); // This function opens an account with a given id and interns its name
+
+PlayerAccount* registryIntern(const char* name); // This function returns the account with this name and opens one with the name interned when there is none
+
+const char* registryName(const PlayerAccount* account); // This function returns the interned name of an account
+
+int syncFile(int fd); // This function flushes the data of a file to disk with the cheapest call the platform has
+
+bool writeAllBytes(int fd, const void* data, size_t length); // This function writes a whole buffer with plain system calls, retrying short writes
+
+bool writeSnapshot(const char* path, const char* tempPath, unsigned long long walLsn, unsigned int walSegment); // This function writes every live table to a versioned snapshot file through tempPath, with system calls only so a forked child can run it
+
+void snapshotTablesInBackground(const char* path); // This function writes the snapshot from a forked copy of the process so play goes on
+
+void saveTables(const char* path); // This function writes the snapshot right away, after any background writer is done
+
+int restoreSnapshot(const char* path, unsigned long long* walLsn, unsigned int* walSegment); // This function maps a snapshot file and brings its tables back to life, it returns how many
+
+void recoverTables(); // This function restores the latest snapshot, replays the chips log on top and opens a new log segment
+
+Table* pickSavedTable(); // This function lists the restored terminal tables and asks the user which one to resume, NULL when there is none
+
+void walOpen(unsigned int segment); // This function opens a log segment for appending and starts the group commit flusher
+
+WalRecord* walNewRecord(); // This function adds an empty record with the next sequence number to the pending batch, the log lock must be held
+
+void walAppendAccount(const PlayerAccount* account); // This function logs a new account and its name, made durable with the first chip change behind it
+
+unsigned long long walAppend(Game* game, Player* player, WalKind kind, double delta); // This function logs a chip change of a seat, or a round marker when player is NULL, and returns its sequence number
+
+void walWaitDurable(unsigned long long lsn); // This function blocks until the record with this sequence number is on disk
+
+bool walIsDurable(unsigned long long lsn); // This function tells whether the record with this sequence number is on disk
+
+void walMarkSnapshot(unsigned long long* lsn, unsigned int* segment); // This function asks the flusher to start a new segment after the current last record
+
+void replayChips(Table* table, unsigned int seat, unsigned int playerId, double chips); // This function applies the chips a logged change left, to the account wallet when the seat is online
+
+unsigned int replayWal(unsigned long long afterLsn, unsigned int segment); // This function applies logged chip changes newer than the snapshot and returns the next free segment
+
+void walDropSegmentsBefore(unsigned int segment); // This function deletes the log segments a completed snapshot made obsolete
+
+off_t historyWholeEnd(int fd); // This function walks the records of a hand history and returns where the last whole one ends
+
+void historyOpen(const char* path); // This function opens the hand history file, writes its header when the file is new and starts the history writer
+
+void historyRecord(Game* game); // This function packs the round a logged table just played onto the hand history
+
+void historyFlush(); // This function hands off the rounds this thread packed and waits until the writer has every stage handed off so far in the file
+
+void historyRelease(); // This function hands off the rounds this thread packed without waiting for them
+
+void historyClose(); // This function flushes the hand history, stops and joins the history writer and closes the file
+
+HistoryStage* historyStageNew(); // This function allocates an empty stage, waiting first when the writer is too far behind
+
+void historyHandOff(HistoryStage* stage); // This function pushes a stage onto the writer's stack without a lock
+
+int historyTakeIn(HistoryStage* stages); // This function copies the handed off stages into the writer's buffers in hand off order and returns how many it took
+
+void historySubmit(HistoryBuffer* buffer); // This function gives a buffer its file offset and writes it, or queues it on the ring
+
+void historyAwaitWrites(int minComplete); // This function waits for that many ring writes to finish and gives their buffers back
+
+void historyWriteAll(HistoryBuffer* buffer); // This function writes what is left of a buffer with plain blocking writes
+
+void* historyWriter(void* unused); // This function is the thread that makes every write to the hand history file
+
+#ifdef HISTORY_URING
+bool historyRingOpen(HistoryRing* ring); // This function sets up an io_uring for the history writer and registers the history buffers with it
+
+void historyRingSubmit(HistoryRing* ring, HistoryBuffer* buffer); // This function queues a write of what is left of a buffer on the ring
+
+int historyRingReap(HistoryRing* ring, HistoryBuffer** finished, int* resubmitted); // This function collects completed writes and returns how many buffers are done
+#endif
+
+void captureMove(Game* game, Move* move); // This function reads the round that was just settled off the table
+
+int encodeMove(const Move* move, unsigned char* record); // This function packs one round into a length prefixed record and returns its length
+
+size_t encodeMoves(const Move* moves, int count, unsigned char* out); // This function packs many rounds back to back and returns the bytes written
+
+const unsigned char* decodeMove(const unsigned char* in, const unsigned char* end, Move* move); // This function unpacks one record and returns where the next begins, NULL when the record is cut short or broken
+
+int decodeMoves(const unsigned char* bytes, size_t length, Move* moves, int max, size_t* used); // This function unpacks records until max rounds or the end of the bytes, a cut short record at the end is left for later
+
+void reviewHandHistory(); // This function decodes the whole hand history file and reports what it holds
+
+unsigned long long nowMilliseconds(); // This function reads a monotonic clock in milliseconds
+
+int processorThreads(int most); // This function returns how many threads a pool should run, one for every processor online, between 1 and most
+
+void timerWheelInit(TimerWheel* wheel); // This function empties every slot of a timer wheel and starts its clock
+
+void timerArm(TimerWheel* wheel, Timer* timer, int delayMs); // This function schedules a timer, in O(1)
+
+void timerCancel(TimerWheel* wheel, Timer* timer); // This function unschedules a timer, in O(1)
+
+void timerWheelAdvance(TimerWheel* wheel, unsigned long long nowMs); // This function moves the wheel up to the given time and fires the timers that expired
+
+int timerWheelNextTimeout(TimerWheel* wheel); // This function returns how many milliseconds the caller can sleep before the wheel needs to move, -1 when nothing is armed
+
+Timer* armSeatTimer(Game* game, int seat, int delayMs); // This function starts the turn deadline of a seat, it returns NULL for games without deadlines
+
+bool stdinBuffered(); // This function tells whether stdio holds terminal input nobody has read yet, poll cannot see it
+
+bool readLineBefore(Timer* timer, char* line, int size); // This function reads a line of input, it returns false if the timer expires first
+
+bool seatIsRemote(Game* game, int seat); // This function tells whether a seat is played over a connection
+
+void seatSend(Game* game, int seat, const char* format, ...); // This function sends one protocol line to an online seat
+
+bool readSeatLineBefore(SeatLink* link, Timer* timer, char* line, int size); // This function reads one line from a connection, it returns false if the timer expires or the connection breaks
+
+double askRemoteBet(Game* game, int seat, Timer* timer); // This function asks an online seat for its bet, it returns 0 when the seat sits out or leaves
+
+Decision askRemoteDecision(Game* game, int seat, Hand* hand, Timer* timer, bool canDouble, bool canSplit, bool canSurrender); // This function asks an online seat for one of the plays the hand allows
+
+const char* cardCode(const Card* card, char* code); // This function writes the two letter code of a card, like AS for the Ace of Spades, and returns it
+
+void tableEvent(Game* game, const TableEvent* event); // This function gives a public event the next table version, keeps its binary delta and formats its text line if anybody reads text
+
+int formatEvent(const TableEvent* event, char* line, int size); // This function writes the text line of an event and returns its length
+
+int encodeEvent(const TableEvent* event, unsigned long long version, unsigned char* frame); // This function writes the binary delta frame of an event and returns its length
+
+void viewApply(TableView* view, const TableEvent* event); // This function plays one event onto the public view of a table
+
+int encodeSnapshot(const TableView* view, unsigned long long version, unsigned char* frame); // This function writes a binary frame with the whole public view of a table and returns its length
+
+void syncCatchUp(Broadcast* broadcast, Spectator* spectator); // This function queues the deltas a sync client misses, or one snapshot when the deltas are gone or too many
+
+void broadcastFlush(Broadcast* broadcast); // This function queues the batch on every spectator and writes as much as each socket takes
+
+void broadcastAdd(Broadcast* broadcast, int fd, bool binary, unsigned long long version); // This function makes a connection a spectator, a text one is told who sits at the table and a sync one is brought up to date from its version
+
+void broadcastClose(Broadcast* broadcast); // This function says goodbye to every spectator and closes their connections
+
+bool startServer(int port, bool everyInterface); // This function opens the online tables on a TCP port, on this machine only unless everyInterface is set
+
+void stopServer(); // This function stops taking players, lets the tables finish their round and waits for them to close
+
+void serverStartRunner(Table* table); // This function gives an online table its own thread and spectator list
+
+void serverAdoptTables(); // This function reopens the online tables a restart restored, their seats wait for their players
+
+bool ringWrite(LocalRing* ring, const char* data, int length); // This function puts bytes on a ring if they all fit, without a syscall or a lock
+
+int ringRead(LocalRing* ring, char* out, int room); // This function takes the bytes waiting on a ring, up to room, and returns how many
+
+bool linkWrite(SeatLink* link, const char* data, int length); // This function sends bytes to a client over its socket or its ring
+
+void linkClose(SeatLink* link); // This function closes the socket of a client or hangs up its channel
+
+int localReceive(SeatLink* link, Timer* timer); // This function waits on the ring of a local seat and returns the bytes it got, 0 when the timer expired or -1 when the client is gone
+
+void ringSleep(LocalChannel* channel, LocalRing* ring, int timeoutMs); // This function sleeps the reader of an empty ring until the writer adds bytes, the channel hangs up or the timeout passes, -1 waits for good
+
+void ringWake(LocalRing* ring); // This function wakes the reader of a ring if it went to sleep
+
+bool localClientAlive(LocalChannel* channel); // This function tells whether the client process of a channel still runs
+
+void localRelease(LocalChannel* channel); // This function hangs up the game's side of a channel, freeing it at once when the client died without hanging up
+
+void localReap(); // This function frees the channels of clients that died while the game side was done with them or before they joined
+
+bool localStale(); // This function tells whether the shared memory of the local clients was left by a process that is gone
+
+void localHangUp(LocalChannel* channel); // This function says one side is done with a channel, the second side frees it
+
+bool localOpen(); // This function creates the shared memory local clients attach to
+
+void localClose(); // This function removes the shared memory once no table uses it
+
+LocalChannel* localConnect(); // This function attaches a client process to the shared memory and claims a free channel
+
+bool localSendLine(LocalChannel* channel, const char* line); // This function sends one line from a local client to the game, false once the game hung up
+
+bool localReadLine(LocalChannel* channel, SeatLink* link, char* line, int size); // This function waits for the next line the game sends to a local client, false once the game hung up
+
+void playLocalKiosk(); // This function plays at the online tables of another process on this machine through shared memory
+
+unsigned long long nowMicroseconds(); // This function reads a monotonic clock in microseconds
+
+EngineMetrics* metricsAttach(); // This function gives the calling thread a metrics block, a free one left by an ended thread or a new one
+
+void metricAdd(MetricId metric, unsigned long long amount); // This function adds to a counter of the calling thread without a locked instruction
+
+void metricDecision(unsigned long long micros); // This function counts one decision in the latency histogram of the calling thread
+
+int metricsRender(char* out, int size); // This function sums the blocks of every thread into the Prometheus text format and returns its length
+
+bool metricsStart(int port); // This function serves GET /metrics over HTTP on the loopback interface
+
+void metricsStop(); // This function stops serving the metrics
+
+void analyzerPush(const AnalyzerRecord* record); // This function hands a record to the fraud analyzer from any table thread, it drops the record when the analyzer is a whole ring behind
+
+bool analyzerPop(AnalyzerRecord* record); // This function takes the oldest record off the ring, only the analyzer thread calls it
+
+void analyzeSit(Game* game, int seat); // This function tells the analyzer who sat down and who was already at the table
+
+void analyzeBet(Game* game, Player* player, double betAmount); // This function tells the analyzer a bet and the true count it was placed at
+
+void analyzePlay(Game* game, Player* player, Hand* hand, bool canSplit, Decision action); // This function tells the analyzer a play with the hand and count it was made on
+
+void analyzeResults(Game* game); // This function tells the analyzer how every hand of the round ended
+
+PlayerProfile* analyzerProfile(unsigned int key); // This function finds the profile of a player, making room for it by forgetting the player unseen the longest
+
+void hllAdd(unsigned char* registers, unsigned int key); // This function adds a player to a HyperLogLog of distinct players
+
+double hllEstimate(const unsigned char* registers); // This function estimates how many distinct players a HyperLogLog has seen
+
+unsigned int pairAdd(unsigned int a, unsigned int b); // This function counts one more sitting of two players in the count-min sketch and returns the estimate
+
+void analyzeRecord(const AnalyzerRecord* record); // This function folds one record into the profiles and sketches and writes an alert when a player crosses a threshold
+
+bool analyzerStart(const char* path); // This function starts the fraud analyzer thread, appending its alerts to path
+
+void analyzerStop(); // This function lets the analyzer finish the ring and frees its sketches
+
+void histogramRecord(LatencyHistogram* histogram, long long valueUs); // This function counts one latency in its bucket
+
+long long histogramPercentile(LatencyHistogram* histogram, double percentile); // This function returns the latency below which the given percent of the values fall
+
+void runLoadTest(); // This function plays many loopback clients against the online tables and reports latency percentiles
+
+
+int main() {
+    initializeStrategies();
+    timerWheelInit(&turnTimers);
+    recoverTables();
+    historyOpen(HISTORY_PATH);
+    displayMenu();
+    historyClose();
+    return 0;
+}
+
+void PrintBalance(Player* player) {
+    printf("%s Balance: %.2f\n", player->name, player->ChipSum); // Add 'player->name' for the name
+}
+
+void initializePlayer(Player* player) {
+    player->ChipSum = START_CHIPS;
+    player->hands[0].isLost = false;
+    player->hands[0].isTie = false;
+    player->hands[0].isDoubled = false;
+    player->hands[0].bet = 0;
+    player->hands[0].countCard = 2;
+    player->handCount = 1;
+    player->bet = 0;
+    player->strategyId = STRATEGY_HUMAN;
+    player->showOdds = false;
+    player->playerId = 0;
+    strcpy(player->name, "Default Name");  // Optional: set a default name
+}
+
+void initializeDeck(Deck* deck, int decks) {
+    if (deck->cards == NULL) {
+        deck->cards = malloc(52 * MAX_DECKS * sizeof(Card));  // Allocate space for the largest shoe once, later rounds reuse it
+    }
+    deck->deckSize = 52 * decks;
+    deck->shoeSize = 52 * decks;
+    fillDeckRanks(deck, decks);
+
+    if (deck->cards == NULL) {
+        perror("Failed to allocate memory for deck cards");
+        exit(EXIT_FAILURE);
+    }
+
+    SUIT suits[4] = {HEARTS, DIAMONDS, SPADES, CLUBS};
+    VALUE values[13] = {ACE, TWO, THREE, FOUR, FIVE, SIX, SEVEN, EIGHT, NINE, TEN, JACK, QUEEN, KING};
+
+    for (int d = 0; d < decks; d++) {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 13; j++) {
+                int index = d * 52 + i * 13 + j;
+                deck->cards[index].Suit = suits[i];
+                deck->cards[index].Value = values[j];
+                deck->cards[index].Color = (suits[i] == HEARTS || suits[i] == DIAMONDS) ? RED : BLACK;
+            }
+        }
+    }
+}
+
+void initializeBoard(Board* board) {
+    // A live table hands in its own deck, otherwise the board allocates one
+    if (board->deck == NULL) {
+        board->deck = malloc(sizeof(Deck));
+        if (board->deck == NULL) {
+            perror("Failed to allocate memory for deck");
+            exit(EXIT_FAILURE);
+        }
+        board->deck->cards = NULL;
+    }
+    initializeDeck(board->deck, 1);  // resetRound builds the shoe of the table's rules
+    seedDeck(board->deck, (unsigned long long) time(NULL) ^ (unsigned long long) (size_t) board);
+
+    board->sumBetting = 0.0;  // Initialize the betting sum to zero
+    board->dealCardCount = 2;
+    board->runningCount = 0;
+}
+
+void initializeGame(Game* game, int playerCount) {
+    game->board = malloc(sizeof(Board));
+    if (game->board == NULL) {
+        perror("Failed to allocate memory for board");
+        exit(EXIT_FAILURE);
+    }
+    game->board->deck = NULL;
+    initializeBoard(game->board);  // Initialize the board
+
+    game->players = malloc(playerCount * sizeof(Player));
+    game->numPlayers = playerCount;
+    if (game->players == NULL) {
+        perror("Failed to allocate memory for players");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < playerCount; i++) {
+        initializePlayer(&game->players[i]);
+    }
+    game->quiet = false;
+    game->phase = PHASE_WAITING;
+    game->tableId = 0;
+    game->seatTimers = NULL;
+    game->stake = STAKE_LOW;
+    game->seatLinks = NULL;
+    game->broadcast = NULL;
+    game->rules = RULES_SINGLE_DECK;
+    game->roundNumber = 0;
+}
+
+void seedDeck(Deck* deck, unsigned long long seed) {
+    // xorshift64* must never be seeded with zero
+    deck->rngState = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+unsigned int nextRandom(Deck* deck, unsigned int bound) {
+    deck->rngState ^= deck->rngState >> 12;
+    deck->rngState ^= deck->rngState << 25;
+    deck->rngState ^= deck->rngState >> 27;
+    unsigned int r = (unsigned int) ((deck->rngState * 0x2545F4914F6CDD1DULL) >> 32);
+
+    // Scale into [0, bound) without the modulo bias of rand() % n
+    return (unsigned int) (((unsigned long long) r * bound) >> 32);
+}
+
+void shuffleDeck(Deck* deck) {
+    // The generator is seeded once per board so quick rounds do not repeat the same order
+    for (int i = deck->deckSize - 1; i > 0; i--) {
+        // Generate a random index between 0 and i
+        int j = nextRandom(deck, i + 1);
+
+        // Swap deck->card[i] with deck->card[j]
+        Card temp = deck->cards[i];
+        deck->cards[i] = deck->cards[j];
+        deck->cards[j] = temp;
+    }
+}
+
+void shuffleDeckMirrored(Deck* deck) {
+    // Draw r becomes i - r, the index the complementary uniform would have picked
+    for (int i = deck->deckSize - 1; i > 0; i--) {
+        int j = i - (int) nextRandom(deck, i + 1);
+
+        Card temp = deck->cards[i];
+        deck->cards[i] = deck->cards[j];
+        deck->cards[j] = temp;
+    }
+}
+
+void freeGame(Game* game) {
+    // Free the cards array in the deck
+    if (game->board->deck->cards != NULL) {
+        free(game->board->deck->cards);
+    }
+
+    // Free the deck itself
+    if (game->board->deck != NULL) {
+        free(game->board->deck);
+    }
+
+    // Free the board
+    if (game->board != NULL) {
+        free(game->board);
+    }
+
+    // Free the players array
+    if (game->players != NULL) {
+        free(game->players);
+    }
+}
+
+RULES_INLINE void dealCards(Game* game, const RuleSet* rules) {
+    // resetRound already shuffled the shoe if it was due
+
+    // Deal two cards to each player
+    for (int i = 0; i < game->numPlayers; i++) {
+        // A seat sitting the round out has no hand
+        if (game->players[i].handCount == 0) {
+            continue;
+        }
+        for (int j = 0; j < 2; j++) {
+            game->players[i].hands[0].card[j] = drawCard(game, rules);
+        }
+    }
+
+    // Deal two cards to the dealer, the hole card is counted once dealerTurn reveals it
+    game->board->dealerCards[0] = drawCard(game, rules);
+    game->board->dealerCards[1] = takeCard(game, rules);
+
+    // Spectators see every hand and the upcard, never the hole card
+    for (int i = 0; i < game->numPlayers; i++) {
+        if (game->players[i].handCount > 0) {
+            GAME_EVENT(game, .kind = EVENT_DEAL, .seat = i, .card = game->players[i].hands[0].card[0], .second = game->players[i].hands[0].card[1]);
+        }
+    }
+    GAME_EVENT(game, .kind = EVENT_DEALER, .card = game->board->dealerCards[0]);
+}
+
+RULES_INLINE Card drawCard(Game* game, const RuleSet* rules) {
+    Card card = takeCard(game, rules);
+    updateRunningCount(game->board, &card);
+    return card;
+}
+
+RULES_INLINE Card takeCard(Game* game, const RuleSet* rules) {
+    Deck* deck = game->board->deck;
+
+    if (!rules->continuous) {
+        Card card = deck->cards[0];
+        RemoveFromDeck(game, &deck->cards[0]);
+        return card;
+    }
+
+    // Every card in the machine is as likely as any other, the drawn one swaps places with the last
+    // and waits behind deckSize until resetRound takes the discards back
+    int index = (int) nextRandom(deck, (unsigned int) deck->deckSize);
+    Card card = deck->cards[index];
+    deck->cards[index] = deck->cards[deck->deckSize - 1];
+    deck->cards[--deck->deckSize] = card;
+    deck->ranks[cardPoints(&card) - 2]--;
+    return card;
+}
+
+void updateRunningCount(Board* board, Card* card) {
+    int points = cardPoints(card);
+
+    if (points <= 6) {
+        board->runningCount++;  // Low cards leaving the deck favor the players
+    } else if (points >= 10) {
+        board->runningCount--;  // Tens and Aces leaving the deck favor the dealer
+    }
+}
+
+int getTrueCount(Board* board) {
+    int cardsLeft = board->deck->deckSize > 0 ? board->deck->deckSize : 1;
+    int trueCount = board->runningCount * 52 / cardsLeft;  // Running count per remaining deck
+
+    if (trueCount < TC_MIN) {
+        return TC_MIN;
+    }
+    if (trueCount > TC_MAX) {
+        return TC_MAX;
+    }
+    return trueCount;
+}
+
+void RemoveFromDeck(Game* game, Card* card) {
+    Deck* deck = game->board->deck;
+    int cardIndex = -1;
+
+    // Find the card index in the deck
+    for (int i = 0; i < deck->deckSize; i++) {
+        if (deck->cards[i].Suit == card->Suit && deck->cards[i].Value == card->Value) {
+            cardIndex = i;
+            break;
+        }
+    }
+
+    // If card was found, shift remaining cards left to fill the gap
+    if (cardIndex != -1) {
+        deck->ranks[cardPoints(&deck->cards[cardIndex]) - 2]--;
+        for (int i = cardIndex; i < deck->deckSize - 1; i++) {
+            deck->cards[i] = deck->cards[i + 1];
+        }
+        deck->deckSize--;  // Reduce the logical size of the deck
+    }
+}
+
+void InsertToDeck(Game* game, Card* card) {
+    Deck* deck = game->board->deck;
+
+    // Insert card at the end of the current deck size
+    deck->cards[deck->deckSize] = *card;
+    deck->deckSize++;  // Increase the logical size of the deck
+    deck->ranks[cardPoints(card) - 2]++;
+}
+
+void fillDeckRanks(Deck* deck, int decks) {
+    for (int r = 0; r < 10; r++) {
+        deck->ranks[r] = (unsigned short) (r == 8 ? 16 * decks : 4 * decks);  // Tens, Jacks, Queens and Kings all count ten
+    }
+}
+
+void returnDiscards(Deck* deck) {
+    // takeCard left every dealt card behind deckSize, so only the size and the counts move
+    deck->deckSize = deck->shoeSize;
+    fillDeckRanks(deck, deck->shoeSize / 52);
+}
+
+void printCard(Card* card){
+    // Check if the card is red or black
+    if (card->Color == RED) {
+        printf(ANSI_COLOR_RED);  // Set text color to red for red cards
+    }
+
+    // Print card information in a box with regular characters
+    printf("+---------------+\n");
+    printf("| %-13s |\n", VALUE_NAMES[card->Value]);
+    printf("| %-13s |\n", SUIT_NAMES[card->Suit]);
+    printf("| Color: %-6s |\n", COLOR_NAMES[card->Color]);
+    printf("+---------------+\n");
+
+    // Reset the color for subsequent text
+    printf(ANSI_COLOR_RESET);
+}
+
+int cardPoints(Card* card) {
+    if (card->Value == ACE) {
+        return 11;
+    }
+    if (card->Value >= JACK) {
+        return 10;
+    }
+    return card->Value + 1;
+}
+
+int calculateSoftScore(Card* cards, int cardCount, bool* soft) {
+    int score = 0;
+    int aces = 0;
+
+    for (int i = 0; i < cardCount; i++) {
+        score += cardPoints(&cards[i]);
+        if (cards[i].Value == ACE) {
+            aces++;
+        }
+    }
+
+    while (score > 21 && aces > 0) {
+        score -= 10;
+        aces--;
+    }
+
+    *soft = aces > 0;  // An Ace still counted as 11 makes the hand soft
+    return score;
+}
+
+int calculateScore(Card* cards, int cardCount) {
+    int score = 0;
+    int aces = 0;  // Track number of Aces to adjust value as 1 or 11
+
+    for (int i = 0; i < cardCount; i++) {
+        if (cards[i].Value >= TWO && cards[i].Value <= TEN) {
+            score += cards[i].Value + 1;  // Add face value of cards (TWO is 1, etc.)
+        } else if (cards[i].Value >= JACK && cards[i].Value <= KING) {
+            score += 10;  // Face cards are worth 10 points
+        } else if (cards[i].Value == ACE) {
+            score += 11;  // Initially, count Ace as 11
+            aces++;
+        }
+    }
+
+    // Adjust score for Aces if score > 21
+    while (score > 21 && aces > 0) {
+        score -= 10;  // Reduce 11 to 1 for an Ace
+        aces--;
+    }
+
+    return score;
+}
+
+bool isNatural(Card* cards, int cardCount) {
+    return cardCount == 2 && calculateScore(cards, cardCount) == 21;
+}
+
+RULES_INLINE void DetermineWinner(Game* game, const RuleSet* rules) {
+
+    int dealerScore = calculateScore(game->board->dealerCards, game->board->dealCardCount);  // Using dealer's actual card count
+    bool dealerNatural = isNatural(game->board->dealerCards, game->board->dealCardCount);
+    GAME_PRINT(game, "Dealer Score: %d\n", dealerScore);
+    GAME_EVENT(game, .kind = EVENT_DEALER_SCORE, .score = dealerScore);
+
+    bool dealerBust = (dealerScore > 21);
+
+    if(dealerScore > 21)
+        {
+            GAME_PRINT(game, "Dealer Busts!!! \n");
+            GAME_METRIC(game, METRIC_DEALER_BUSTS, 1);
+        }
+
+    // Loop through each player and each of their hands to determine the result
+    for (int i = 0; i < game->numPlayers; i++) {
+        Player* player = &game->players[i];
+
+        for (int h = 0; h < player->handCount; h++) {
+            Hand* hand = &player->hands[h];
+
+            // Use the actual card count for each hand
+            int playerScore = calculateScore(hand->card, hand->countCard);
+
+            if (player->handCount > 1) {
+                GAME_PRINT(game, "%s Hand %d Score: %d\n", player->name, h + 1, playerScore);
+            } else {
+                GAME_PRINT(game, "%s Score: %d\n", player->name, playerScore);
+            }
+
+            bool playerBust = (playerScore > 21);
+            bool playerNatural = player->handCount == 1 && isNatural(hand->card, hand->countCard);
+            GAME_METRIC(game, METRIC_HANDS, 1);
+
+            // A hand that already lost without busting surrendered, keep that result
+            if (hand->isLost && !playerBust) {
+                GAME_PRINT(game, "%s surrendered.\n", player->name);
+                GAME_EVENT(game, .kind = EVENT_RESULT, .seat = i, .hand = h, .outcome = OUTCOME_SURRENDER);
+                GAME_METRIC(game, METRIC_SURRENDERS, 1);
+                continue;
+            }
+
+            // Determine the result for the hand against the dealer
+            if (playerBust) {
+                GAME_PRINT(game, "%s busts!\n", player->name);
+                GAME_EVENT(game, .kind = EVENT_RESULT, .seat = i, .hand = h, .outcome = OUTCOME_LOSE);
+                GAME_METRIC(game, METRIC_BUSTS, 1);
+            } else if (playerNatural && !dealerNatural) {
+                GAME_PRINT(game, "%s has Blackjack, paid %d to %d!\n", player->name, rules->blackjackPays, rules->blackjackPer);
+                GAME_EVENT(game, .kind = EVENT_RESULT, .seat = i, .hand = h, .outcome = OUTCOME_WIN);
+            } else if (dealerNatural && !playerNatural) {
+                GAME_PRINT(game, "Dealer has Blackjack against %s!\n", player->name);
+                GAME_EVENT(game, .kind = EVENT_RESULT, .seat = i, .hand = h, .outcome = OUTCOME_LOSE);
+                hand->isLost = true;
+                continue;
+            } else if (dealerBust || playerScore > dealerScore) {
+                GAME_PRINT(game, "%s wins against Dealer!\n", player->name);
+                GAME_EVENT(game, .kind = EVENT_RESULT, .seat = i, .hand = h, .outcome = OUTCOME_WIN);
+            } else if (playerScore == dealerScore) {
+                GAME_PRINT(game, "%s ties with Dealer!\n", player->name);
+                GAME_EVENT(game, .kind = EVENT_RESULT, .seat = i, .hand = h, .outcome = OUTCOME_TIE);
+                hand->isTie = true;
+            } else {
+                GAME_PRINT(game, "Dealer wins against %s!\n", player->name);
+                GAME_EVENT(game, .kind = EVENT_RESULT, .seat = i, .hand = h, .outcome = OUTCOME_LOSE);
+            }
+
+            // Update the hand's lost status
+            hand->isLost = playerBust || (!dealerBust && dealerScore > playerScore);
+        }
+    }
+    if (GAME_ANALYZED(game)) {
+        analyzeResults(game);
+    }
+}
+
+unsigned long long placeBet(Game* game, Player* player, double betAmount) {
+    player->bet = betAmount;
+    player->hands[0].bet = betAmount;
+    player->ChipSum -= betAmount;
+    if (GAME_ANALYZED(game)) {
+        analyzeBet(game, player, betAmount);
+    }
+    return walAppend(game, player, WAL_BET, -betAmount);
+}
+
+void acceptBets(Game* game) {
+    unsigned long long lastLsn = 0;
+
+    for (int i = 0; i < game->numPlayers; i++) {
+        double betAmount;
+
+        GAME_PRINT(game, "%s Balance: %.2f\n",game->players[i].name,game->players[i].ChipSum);
+
+        if (game->players[i].strategyId != STRATEGY_HUMAN) {
+            betAmount = strategyBet(game, &game->players[i]);
+            if (betAmount <= 0) {
+                GAME_PRINT(game, "%s is out of chips and sits out.\n", game->players[i].name);
+                game->players[i].handCount = 0;
+                continue;
+            }
+            lastLsn = placeBet(game, &game->players[i], betAmount);
+            GAME_PRINT(game, "%s bets %.2f\n", game->players[i].name, betAmount);
+            GAME_EVENT(game, .kind = EVENT_BET, .seat = i, .amount = betAmount);
+            continue;
+        }
+
+        // Continuously ask for a valid bet until the seat's deadline
+        Timer* timer = armSeatTimer(game, i, BET_TIMEOUT_MS);
+        char line[64];
+        bool timedOut = false;
+
+        if (seatIsRemote(game, i)) {
+            betAmount = askRemoteBet(game, i, timer);
+            timedOut = betAmount <= 0;
+        } else {
+            printf("Player %d, enter your bet: ", i + 1);
+            betAmount = 0;
+            if (!readLineBefore(timer, line, sizeof(line))) {
+                timedOut = true;
+            } else {
+                sscanf(line, "%lf", &betAmount);
+            }
+        }
+
+        while (!timedOut && (betAmount > game->players[i].ChipSum || betAmount <= 0 || betAmount < STAKE_MIN_BET[game->stake])) {
+            if (betAmount > game->players[i].ChipSum) {
+                printf("Bet is higher than your chip amount, lower the bet.\n");
+            } else if (betAmount <= 0) {
+                printf("Bet must be greater than zero.\n");
+            } else {
+                printf("The smallest bet at this table is %d.\n", STAKE_MIN_BET[game->stake]);
+            }
+            printf("Player %d, enter your bet: ", i + 1);
+            betAmount = 0;
+            if (!readLineBefore(timer, line, sizeof(line))) {
+                timedOut = true;
+            } else {
+                sscanf(line, "%lf", &betAmount);
+            }
+        }
+        if (timer != NULL) {
+            timerCancel(&turnTimers, timer);
+        }
+
+        // A seat that let its deadline pass sits this round out
+        if (timedOut) {
+            GAME_PRINT(game, "\n%s took too long and sits out this round.\n", game->players[i].name);
+            game->players[i].handCount = 0;
+            continue;
+        }
+
+        walWaitDurable(placeBet(game, &game->players[i], betAmount));
+        GAME_EVENT(game, .kind = EVENT_BET, .seat = i, .amount = betAmount);
+        if (seatIsRemote(game, i)) {
+            seatSend(game, i, "OK %.2f\n", game->players[i].ChipSum);
+        }
+        GAME_PRINT(game, "Bet Placed: %.2f\n", betAmount);
+        GAME_PRINT(game, "Balance Left After The Bet: %.2f \n",game->players[i].ChipSum);
+    }
+
+    // The bots bets share one wait before the cards go out
+    walWaitDurable(lastLsn);
+}
+
+RULES_INLINE void resolveBets(Game* game, const RuleSet* rules){
+    unsigned long long lastLsn = 0;
+
+    for(int i=0; i<game->numPlayers; i++)
+    {
+        Player* player = &game->players[i];
+
+        // Every hand of the seat is settled on its own bet
+        for (int h = 0; h < player->handCount; h++)
+        {
+            Hand* hand = &player->hands[h];
+            double paid = 0;
+
+            if(!hand->isLost)
+            {
+                if(hand->isTie)
+                {
+                paid = hand->bet;
+                player->ChipSum += hand->bet;
+                lastLsn = walAppend(game, player, WAL_PAYOUT, hand->bet);
+                GAME_PRINT(game, "Player %s Tie And Split Amount Of: %d \n",player->name, hand->bet);
+
+                }
+                else if(player->handCount == 1 && isNatural(hand->card, hand->countCard))
+                {
+                // The ratio is a constant of the engine, so this folds into one multiply
+                double payout = hand->bet + (double) hand->bet * rules->blackjackPays / rules->blackjackPer;
+                paid = payout;
+                player->ChipSum += payout;
+                lastLsn = walAppend(game, player, WAL_PAYOUT, payout);
+                GAME_PRINT(game, "Player %s Wins Amount Of: %.2f \n",player->name, payout);
+
+                }
+                else
+                {
+                paid = 2 * hand->bet;
+                player->ChipSum += 2 * hand->bet;
+                lastLsn = walAppend(game, player, WAL_PAYOUT, 2 * hand->bet);
+                GAME_PRINT(game, "Player %s Wins Amount Of: %d \n",player->name, hand->bet * 2);
+
+                }
+            }
+            else
+            {
+                GAME_PRINT(game, "Player %s loses their bet of %d.\n", player->name, hand->bet);
+            }
+
+            // Chips are counted in cents so the blackjack halves are not lost
+            GAME_METRIC(game, METRIC_WAGERED, (unsigned long long) hand->bet * 100);
+            GAME_METRIC(game, METRIC_PAID, (unsigned long long) (paid * 100 + 0.5));
+        }
+    }
+
+    // One wait covers every payout of the round and the marker that settles it, the balances are shown once they are durable.
+    // The phase drops first, so a snapshot that already has the marker in its log never sees the round as open
+    game->phase = PHASE_WAITING;
+    lastLsn = walAppend(game, NULL, WAL_ROUND_SETTLED, 0);
+    walWaitDurable(lastLsn);
+    for (int i = 0; i < game->numPlayers; i++) {
+        if (seatIsRemote(game, i) && game->players[i].handCount > 0) {
+            seatSend(game, i, "RESULT %.2f\n", game->players[i].ChipSum);
+        }
+        GAME_EVENT(game, .kind = EVENT_BALANCE, .seat = i, .amount = game->players[i].ChipSum);
+    }
+    for (int i = 0; i < game->numPlayers && !game->quiet; i++) {
+        PrintBalance(&game->players[i]);
+    }
+}
+
+Decision askPlayerDecision(Timer* timer, bool canDouble, bool canSplit, bool canSurrender) {
+    char line[64];
+    char choice;
+
+    while (1) {
+        printf("Choose an action: (h)it, (s)tand");
+        if (canDouble) {
+            printf(", (d)ouble");
+        }
+        if (canSplit) {
+            printf(", s(p)lit");
+        }
+        if (canSurrender) {
+            printf(", or (r)surrender");
+        }
+        printf(": ");
+
+        // When the deadline passes the hand stands
+        if (!readLineBefore(timer, line, sizeof(line))) {
+            printf("\nTime is up, standing.\n");
+            return STAND;
+        }
+        if (sscanf(line, " %c", &choice) != 1) {
+            continue;
+        }
+
+        if (choice == 'h') {
+            return HIT;
+        } else if (choice == 's') {
+            return STAND;
+        } else if (choice == 'd' && canDouble) {
+            return DOUBLE;
+        } else if (choice == 'p' && canSplit) {
+            return SPLIT;
+        } else if (choice == 'r' && canSurrender) {
+            return SURRENDER;
+        }
+        printf("Invalid choice. Please choose again.\n");
+    }
+}
+
+Decision botDecision(Player* player, Hand* hand, Game* game, bool canDouble, bool canSplit, bool canSurrender) {
+    const Strategy* strategy = &strategies[player->strategyId];
+    int upcard = cardPoints(&game->board->dealerCards[0]);
+    int trueCount = getTrueCount(game->board);
+    unsigned char entry;
+
+    if (canSplit) {
+        entry = strategyDecide(strategy, cardPoints(&hand->card[0]), HAND_PAIR, upcard, trueCount);
+    } else {
+        bool soft;
+        int total = calculateSoftScore(hand->card, hand->countCard, &soft);
+        entry = strategyDecide(strategy, total, soft ? HAND_SOFT : HAND_HARD, upcard, trueCount);
+    }
+
+    Decision action = PLAY_PREFERRED(entry);
+    if ((action == DOUBLE && !canDouble) || (action == SURRENDER && !canSurrender) || (action == SPLIT && !canSplit)) {
+        action = PLAY_FALLBACK(entry);
+    }
+    if ((action == DOUBLE && !canDouble) || (action == SURRENDER && !canSurrender)) {
+        action = HIT;
+    }
+    return action;
+}
+
+void splitHand(Player* player, int handIndex) {
+    Hand* hand = &player->hands[handIndex];
+    Hand* newHand = &player->hands[player->handCount++];
+
+    // The new hand gets its second card once its turn comes
+    newHand->card[0] = hand->card[1];
+    newHand->countCard = 1;
+    newHand->bet = hand->bet;
+    newHand->isLost = false;
+    newHand->isTie = false;
+    newHand->isDoubled = false;
+
+    hand->countCard = 1;
+    player->ChipSum -= hand->bet;
+}
+
+RULES_INLINE void playHand(Player* player, int handIndex, Game* game, const RuleSet* rules) {
+    int seat = (int) (player - game->players);
+    Hand* hand = &player->hands[handIndex];
+    bool splitAces = player->handCount > 1 && hand->card[0].Value == ACE;
+
+    // A split hand is one card short when its turn comes
+    if (hand->countCard == 1) {
+        hand->card[hand->countCard++] = drawCard(game, rules);
+        GAME_EVENT(game, .kind = EVENT_CARD, .seat = seat, .hand = handIndex, .card = hand->card[1]);
+    }
+
+    int playerScore = calculateScore(hand->card, hand->countCard);
+
+    if (player->handCount > 1) {
+        GAME_PRINT(game, "%s's hand %d:\n", player->name, handIndex + 1);
+    } else {
+        GAME_PRINT(game, "Initial hand:\n");
+    }
+    for (int i = 0; i < hand->countCard && !game->quiet; i++) {
+        printCard(&hand->card[i]);
+    }
+    GAME_PRINT(game, "%s's initial score: %d\n", player->name, playerScore);
+
+    // Split Aces get a single card each
+    if (splitAces) {
+        GAME_PRINT(game, "%s stands on split Aces with a score of %d.\n", player->name, playerScore);
+        if (seatIsRemote(game, seat)) {
+            seatSend(game, seat, "DONE %d\n", playerScore);
+        }
+        return;
+    }
+
+    // Player decides to hit, stand, double, split or surrender
+    while (playerScore < 21 && hand->countCard < MAX_HAND_CARDS) {
+        bool firstDecision = hand->countCard == 2;
+        bool canDouble = firstDecision && player->ChipSum >= hand->bet;
+        bool canSplit = canDouble && (rules->resplit ? player->handCount < MAX_HANDS : player->handCount == 1) &&
+                        cardPoints(&hand->card[0]) == cardPoints(&hand->card[1]);
+        bool canSurrender = rules->surrender && firstDecision && player->handCount == 1;
+        Decision action;
+        unsigned long long asked = game->tableId != 0 ? nowMicroseconds() : 0;
+
+        if (player->strategyId == STRATEGY_HUMAN) {
+            Timer* timer = armSeatTimer(game, seat, ACTION_TIMEOUT_MS);
+            if (player->showOdds) {
+                HandOdds odds;
+                handOdds(game, hand, rules->hitSoft17, &odds);
+                if (seatIsRemote(game, seat)) {
+                    seatSend(game, seat, "ODDS %.4f %.4f %.4f %.4f %.4f %.4f %.4f %.4f\n", odds.bust, odds.dealer[DEALER_17],
+                             odds.dealer[DEALER_18], odds.dealer[DEALER_19], odds.dealer[DEALER_20], odds.dealer[DEALER_21],
+                             odds.dealer[DEALER_BLACKJACK], odds.dealer[DEALER_BUST]);
+                } else {
+                    printOdds(&odds);
+                }
+            }
+            if (seatIsRemote(game, seat)) {
+                action = askRemoteDecision(game, seat, hand, timer, canDouble, canSplit, canSurrender);
+            } else {
+                action = askPlayerDecision(timer, canDouble, canSplit, canSurrender);
+            }
+            if (timer != NULL) {
+                timerCancel(&turnTimers, timer);
+            }
+        } else {
+            action = botDecision(player, hand, game, canDouble, canSplit, canSurrender);
+        }
+        if (game->tableId != 0) {
+            metricDecision(nowMicroseconds() - asked);
+        }
+        if (GAME_ANALYZED(game)) {
+            analyzePlay(game, player, hand, canSplit, action);
+        }
+        if (game->playCount[seat] < HISTORY_PLAYS) {
+            game->plays[seat][game->playCount[seat]++] = (unsigned char) action;
+        }
+
+        if (action == HIT || action == DOUBLE) {
+            if (action == DOUBLE) {
+                player->ChipSum -= hand->bet;
+                walWaitDurable(walAppend(game, player, WAL_DOUBLE, -hand->bet));
+                GAME_PRINT(game, "%s doubles down.\n", player->name);
+                GAME_EVENT(game, .kind = EVENT_DOUBLE, .seat = seat, .hand = handIndex);
+                hand->bet *= 2;
+                hand->isDoubled = true;
+            } else {
+                GAME_PRINT(game, "%s hits.\n", player->name);
+            }
+            hand->card[hand->countCard] = drawCard(game, rules);  // Add a new card
+            if (!game->quiet) {
+                printCard(&hand->card[hand->countCard]);
+            }
+            GAME_EVENT(game, .kind = EVENT_CARD, .seat = seat, .hand = handIndex, .card = hand->card[hand->countCard]);
+            hand->countCard++;  // Increment countCard to reflect new card
+            playerScore = calculateScore(hand->card, hand->countCard);  // Update player score with new card count
+            GAME_PRINT(game, "%s's new score: %d\n", player->name, playerScore);
+
+            // A doubled hand takes exactly one card
+            if (hand->isDoubled) {
+                break;
+            }
+
+        } else if (action == SPLIT) {
+            splitHand(player, handIndex);
+            walWaitDurable(walAppend(game, player, WAL_SPLIT, -hand->bet));
+            GAME_PRINT(game, "%s splits.\n", player->name);
+            GAME_EVENT(game, .kind = EVENT_SPLIT, .seat = seat, .hand = handIndex);
+            splitAces = hand->card[0].Value == ACE;
+
+            hand->card[hand->countCard++] = drawCard(game, rules);
+            if (!game->quiet) {
+                printCard(&hand->card[1]);
+            }
+            GAME_EVENT(game, .kind = EVENT_CARD, .seat = seat, .hand = handIndex, .card = hand->card[1]);
+            playerScore = calculateScore(hand->card, hand->countCard);
+            GAME_PRINT(game, "%s's new score: %d\n", player->name, playerScore);
+
+            if (splitAces) {
+                break;
+            }
+
+        } else if (action == STAND) {
+            GAME_PRINT(game, "%s stands with a score of %d.\n", player->name, playerScore);
+            GAME_EVENT(game, .kind = EVENT_STAND, .seat = seat, .hand = handIndex, .score = playerScore);
+            break;
+
+        } else {
+            hand->isLost = true;
+            player->ChipSum += hand->bet / 2.0;  // The bet was already taken, give back half of it
+            walWaitDurable(walAppend(game, player, WAL_SURRENDER, hand->bet / 2.0));
+            GAME_PRINT(game, "%s surrenders.\n", player->name);
+            GAME_EVENT(game, .kind = EVENT_SURRENDER, .seat = seat, .hand = handIndex);
+            break;
+        }
+    }
+
+    // A hand with no room for another card stands, and is recorded and announced like any other stand
+    if (playerScore < 21 && hand->countCard == MAX_HAND_CARDS) {
+        if (game->playCount[seat] < HISTORY_PLAYS) {
+            game->plays[seat][game->playCount[seat]++] = (unsigned char) STAND;
+        }
+        GAME_PRINT(game, "%s holds %d cards and stands with a score of %d.\n", player->name, MAX_HAND_CARDS, playerScore);
+        GAME_EVENT(game, .kind = EVENT_STAND, .seat = seat, .hand = handIndex, .score = playerScore);
+    }
+
+    if (playerScore > 21) {
+        GAME_PRINT(game, "%s busts with a score of %d!\n", player->name, playerScore);
+        GAME_EVENT(game, .kind = EVENT_BUST, .seat = seat, .hand = handIndex, .score = playerScore);
+        hand->isLost = true;
+    }
+
+    // Answers the last play of the hand, or tells the seat about a hand it had no say in
+    if (seatIsRemote(game, seat)) {
+        seatSend(game, seat, "DONE %d\n", playerScore);
+    }
+}
+
+RULES_INLINE void playerTurn(Player* player, Game* game, const RuleSet* rules) {
+    GAME_PRINT(game, "%s's turn:\n", player->name);
+    GAME_PRINT(game, "Dealer shows: %s of %s\n", VALUE_NAMES[game->board->dealerCards[0].Value], SUIT_NAMES[game->board->dealerCards[0].Suit]);
+
+    // Splits append hands, so the count is read again after every hand
+    for (int h = 0; h < player->handCount; h++) {
+        playHand(player, h, game, rules);
+    }
+}
+
+RULES_INLINE void dealerTurn(Game *game, const RuleSet* rules) {
+    bool soft;
+    int dealerScore = calculateSoftScore(game->board->dealerCards, 2, &soft);
+    int cardCount = 2;
+
+    // Dealer reveals their hidden card
+    updateRunningCount(game->board, &game->board->dealerCards[1]);
+    GAME_EVENT(game, .kind = EVENT_REVEAL, .card = game->board->dealerCards[1]);
+    GAME_PRINT(game, "Dealer's cards:\n");
+    for (int i = 0; i < cardCount && !game->quiet; i++) {
+        printCard(&game->board->dealerCards[i]);
+    }
+    GAME_PRINT(game, "Dealer's initial score: %d\n", dealerScore);
+
+    // Dealer hits until reaching at least 17, and on a soft 17 too when the rules say so
+    while (dealerScore < 17 || (rules->hitSoft17 && dealerScore == 17 && soft)) {
+        GAME_PRINT(game, "Dealer hits.\n");
+        // Draw a new card
+        game->board->dealerCards[cardCount] = drawCard(game, rules);
+        GAME_EVENT(game, .kind = EVENT_DEALER, .card = game->board->dealerCards[cardCount]);
+
+        if (!game->quiet) {
+            printCard(&game->board->dealerCards[cardCount]);
+        }
+        cardCount++;
+        game->board->dealCardCount = cardCount;
+
+        // Recalculate dealer's score with new card
+        dealerScore = calculateSoftScore(game->board->dealerCards, cardCount, &soft);
+        if(dealerScore<=21)
+            {
+                GAME_PRINT(game, "Dealer's new score: %d\n", dealerScore);
+            }
+    }
+
+    // Dealer stands if score is 17 or higher
+    if (dealerScore >= 17) {
+            if(dealerScore<=21)
+                {
+                    GAME_PRINT(game, "Dealer stands with a score of %d.\n", dealerScore);
+                }
+    }
+}
+
+void playRound(Game* game) {
+    // One indirect call a round, everything below it runs with the rules folded in
+    RULES[game->rules].playRound(game);
+}
+
+RULES_INLINE void playRoundWith(Game* game, const RuleSet* rules) {
+    // 1. Accept player bets
+    GAME_EVENT(game, .kind = EVENT_ROUND);
+    game->roundNumber++;
+    for (int i = 0; i < game->numPlayers; i++) {
+        game->roundStartChips[i] = game->players[i].ChipSum;
+        game->playCount[i] = 0;
+    }
+    game->phase = PHASE_BETTING;
+    walAppend(game, NULL, WAL_ROUND_OPEN, 0);  // Made durable by the first bet behind it
+    acceptBets(game);
+
+    // 2. Deal initial cards to players and dealer
+    game->phase = PHASE_DEALING;
+    dealCards(game, rules);
+
+    // 3. Player turns
+    game->phase = PHASE_PLAYING;
+    for (int i = 0; i < game->numPlayers; i++) {
+        if (game->players[i].handCount > 0) {
+            playerTurn(&game->players[i], game, rules);
+        }
+    }
+
+    // 4. Dealer turn
+    game->phase = PHASE_DEALER;
+    GAME_PRINT(game, "Dealer's turn:\n");
+    dealerTurn(game, rules);
+
+    // 5. Determine the winner(s)
+    game->phase = PHASE_SETTLING;
+    DetermineWinner(game, rules);
+
+    // 6. Resolve bets
+    resolveBets(game, rules);
+    historyRecord(game);
+    GAME_METRIC(game, METRIC_ROUNDS, 1);
+}
+
+// Each engine is its own copy of the round with one rule set folded in
+#define RULE_SET_ENGINE(id, engine, ...) void playRound##engine(Game* game) { playRoundWith(game, &RULES[id]); }
+RULE_SET_LIST(RULE_SET_ENGINE)
+
+void resetRound(Game* game) {
+    // Reset player states and game board for the next round
+    for (int i = 0; i < game->numPlayers; i++) {
+        Hand* hand = &game->players[i].hands[0];
+
+        game->players[i].bet = 0;
+        game->players[i].handCount = 1;
+        hand->bet = 0;
+        hand->isLost = false;
+        hand->isTie = false;
+        hand->isDoubled = false;
+        hand->countCard = 2;
+    }
+    game->board->dealCardCount = 2;
+
+    // The shoe and its count carry over between rounds until the cut card comes out
+    if (shoeDue(game)) {
+        initializeDeck(game->board->deck, RULES[game->rules].decks);
+        shuffleDeck(game->board->deck);
+        game->board->runningCount = 0;
+        GAME_METRIC(game, METRIC_RESHUFFLES, 1);
+    } else if (RULES[game->rules].continuous) {
+        // The machine takes the discards back before the next deal, so no count carries over
+        returnDiscards(game->board->deck);
+        game->board->runningCount = 0;
+    }
+    game->phase = PHASE_WAITING;
+}
+
+bool shoeDue(Game* game) {
+    const RuleSet* rules = &RULES[game->rules];
+    Deck* deck = game->board->deck;
+
+    // A shuffling machine is only ever filled once, when the table starts or changes its rules
+    return deck->shoeSize != 52 * rules->decks ||
+           (!rules->continuous && deck->shoeSize - deck->deckSize >= rules->penetration * deck->shoeSize);
+}
+
+void startGame(Game* game) {
+    bool gameOver = false;
+
+    while (!gameOver) {
+        ClearConsole();
+        printf("Starting a new round!\n");
+        playRound(game);
+
+        // 7. Check if players want to continue or end the game
+        printf("Do you want to play another round? (y/n): ");
+        char choice;
+        scanf(" %c", &choice);
+        if (choice == 'n' || choice == 'N') {
+            gameOver = true;
+        } else {
+            resetRound(game);
+            snapshotTablesInBackground(SNAPSHOT_PATH);  // A restart picks the table up from here
+        }
+    }
+
+
+    historyFlush();
+    printf("Game Over! Thanks for playing.\n");
+}
+
+void handleBetting(Game *game) {
+    for (int i = 0; i < game->numPlayers; i++) {
+        int betAmount;
+        printf("%s, enter your bet amount (Balance: %d): ", game->players[i].name, game->players[i].ChipSum);
+        scanf("%d", &betAmount);
+
+        // Validate bet
+        while (betAmount <= 0 || betAmount > game->players[i].ChipSum) {
+            if (betAmount <= 0) {
+                printf("Bet must be a positive amount. Try again: ");
+            } else {
+                printf("Bet exceeds available balance. Try again: ");
+            }
+            scanf("%d", &betAmount);
+        }
+
+        // Place the bet and update balance
+        walWaitDurable(placeBet(game, &game->players[i], betAmount));
+        printf("%s placed a bet of %d. Remaining balance: %d\n", game->players[i].name, betAmount, game->players[i].ChipSum);
+    }
+}
+
+int getPlayersCount(){
+    int playerAmount;
+
+    printf("insert the number of players: ");
+    scanf("%d",&playerAmount);
+
+    // A table has MAX_PLAYERS seats, more players wait in the lobby for the next one
+    while (playerAmount < 1 || playerAmount > MAX_PLAYERS) {
+        printf("A table seats 1 to %d players, try again: ", MAX_PLAYERS);
+        scanf("%d",&playerAmount);
+    }
+
+    return playerAmount;
+
+}
+
+RuleId getRuleSet(){
+    int choice;
+
+    for (int r = 0; r < RULE_SET_COUNT; r++) {
+        printf("%d. %s%s%s\n", r + 1, RULES[r].name, RULES[r].surrender ? ", surrender" : "", RULES[r].resplit ? ", resplit" : "");
+    }
+    printf("choose the table rules: ");
+    scanf("%d",&choice);
+
+    while (choice < 1 || choice > RULE_SET_COUNT) {
+        printf("Pick a rule set from 1 to %d, try again: ", RULE_SET_COUNT);
+        scanf("%d",&choice);
+    }
+
+    return (RuleId) (choice - 1);
+}
+
+void getPlayersDetails(Game *game) {
+    for (int i = 0; i < game->numPlayers; i++) {
+        printf("Player %d, please enter your name: ", i + 1);
+
+        // Limit input to MAX_NAME_LEN-1 to leave space for null terminator
+        if (scanf("%49s", game->players[i].name) != 1) {
+            printf("Error reading name for player %d\n", i + 1);
+            game->players[i].name[0] = '\0';  // Set an empty name in case of error
+        }
+
+        // Clear remaining input buffer in case the name was too long
+        int ch;
+        while ((ch = getchar()) != '\n' && ch != EOF) {}
+
+        char choice = 'n';
+        printf("%s, show the odds overlay before every decision? (y/n): ", game->players[i].name);
+        scanf(" %c", &choice);
+        game->players[i].showOdds = choice == 'y' || choice == 'Y';
+    }
+}
+
+// Basic strategy for multi deck, dealer stands on soft 17, double after split and late surrender.
+// Columns are the dealer upcard 2-9, T, A. H hit, S stand, D double or hit, d double or stand,
+// R surrender or hit, P split and - play the pair as a total.
+const char* BASIC_HARD_CHART[18] = {
+    "HHHHHHHHHH", // 4
+    "HHHHHHHHHH", // 5
+    "HHHHHHHHHH", // 6
+    "HHHHHHHHHH", // 7
+    "HHHHHHHHHH", // 8
+    "HDDDDHHHHH", // 9
+    "DDDDDDDDHH", // 10
+    "DDDDDDDDDH", // 11
+    "HHSSSHHHHH", // 12
+    "SSSSSHHHHH", // 13
+    "SSSSSHHHHH", // 14
+    "SSSSSHHHRH", // 15
+    "SSSSSHHRRR", // 16
+    "SSSSSSSSSS", // 17
+    "SSSSSSSSSS", // 18
+    "SSSSSSSSSS", // 19
+    "SSSSSSSSSS", // 20
+    "SSSSSSSSSS"  // 21
+};
+
+const char* BASIC_SOFT_CHART[10] = {
+    "HHHHHHHHHH", // 12
+    "HHHDDHHHHH", // 13
+    "HHHDDHHHHH", // 14
+    "HHDDDHHHHH", // 15
+    "HHDDDHHHHH", // 16
+    "HDDDDHHHHH", // 17
+    "SddddSSHHH", // 18
+    "SSSSSSSSSS", // 19
+    "SSSSSSSSSS", // 20
+    "SSSSSSSSSS"  // 21
+};
+
+const char* BASIC_PAIR_CHART[10] = {
+    "PPPPPPHHHH", // 2,2
+    "PPPPPPHHHH", // 3,3
+    "---PP-----", // 4,4
+    "----------", // 5,5
+    "PPPPP-----", // 6,6
+    "PPPPPP----", // 7,7
+    "PPPPPPPPPP", // 8,8
+    "PPPPP-PP--", // 9,9
+    "----------", // T,T
+    "PPPPPPPPPP"  // A,A
+};
+
+// Hi-Lo index plays (Illustrious 18 and Fab 4 without insurance)
+const Deviation HILO_DEVIATIONS[] = {
+    {16, HAND_HARD, 10, 0, 'R', 'S'},
+    {15, HAND_HARD, 10, 4, 'R', 'S'},
+    {14, HAND_HARD, 10, 3, 'H', 'R'},
+    {15, HAND_HARD, 9, 2, 'H', 'R'},
+    {15, HAND_HARD, 11, 1, 'H', 'R'},
+    {16, HAND_HARD, 9, 5, 'R', 'S'},
+    {12, HAND_HARD, 2, 3, 'H', 'S'},
+    {12, HAND_HARD, 3, 2, 'H', 'S'},
+    {12, HAND_HARD, 4, 0, 'H', 'S'},
+    {12, HAND_HARD, 5, -2, 'H', 'S'},
+    {12, HAND_HARD, 6, -1, 'H', 'S'},
+    {13, HAND_HARD, 2, -1, 'H', 'S'},
+    {13, HAND_HARD, 3, -2, 'H', 'S'},
+    {11, HAND_HARD, 11, 1, 'H', 'D'},
+    {10, HAND_HARD, 10, 4, 'H', 'D'},
+    {10, HAND_HARD, 11, 4, 'H', 'D'},
+    {9, HAND_HARD, 2, 1, 'H', 'D'},
+    {9, HAND_HARD, 7, 3, 'H', 'D'},
+    {10, HAND_PAIR, 5, 5, '-', 'P'},
+    {10, HAND_PAIR, 6, 4, '-', 'P'}
+};
+
+const int FLAT_BET_RAMP[TC_BUCKETS] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+
+// Bet one unit up to a true count of 1, then spread to eight units
+const int HILO_BET_RAMP[TC_BUCKETS] = {1, 1, 1, 1, 1, 1, 1, 1, 2, 4, 6, 8, 8};
+
+unsigned char chartLetterToEntry(char letter) {
+    switch (letter) {
+        case 'S':
+            return PLAY_ENTRY(STAND, STAND);
+        case 'D':
+            return PLAY_ENTRY(DOUBLE, HIT);
+        case 'd':
+            return PLAY_ENTRY(DOUBLE, STAND);
+        case 'R':
+            return PLAY_ENTRY(SURRENDER, HIT);
+        default:
+            return PLAY_ENTRY(HIT, HIT);
+    }
+}
+
+int registerStrategy(const char* name, const char* hardChart[18], const char* softChart[10], const char* pairChart[10], const Deviation* deviations, int deviationCount, const int betUnits[TC_BUCKETS]) {
+    if (strategyCount >= MAX_STRATEGIES) {
+        printf("Too many strategies, %s was not added\n", name);
+        return STRATEGY_BASIC;
+    }
+
+    Strategy* strategy = &strategies[strategyCount];
+    strncpy(strategy->name, name, MAX_NAME_LEN - 1);
+    strategy->name[MAX_NAME_LEN - 1] = '\0';
+    memset(strategy->play, 0, sizeof(strategy->play));
+
+    for (int tc = 0; tc < TC_BUCKETS; tc++) {
+        // Every true count starts from the same hard and soft charts
+        for (int total = 4; total < 22; total++) {
+            for (int up = 0; up < 10; up++) {
+                strategy->play[tc][HAND_HARD][total][up] = chartLetterToEntry(hardChart[total - 4][up]);
+                if (total >= 12) {
+                    strategy->play[tc][HAND_SOFT][total][up] = chartLetterToEntry(softChart[total - 12][up]);
+                }
+            }
+        }
+
+        // Then the index plays overwrite their cell on their side of the index
+        for (int d = 0; d < deviationCount; d++) {
+            const Deviation* deviation = &deviations[d];
+            char letter = tc + TC_MIN >= deviation->index ? deviation->atOrAbove : deviation->below;
+            if (deviation->kind != HAND_PAIR) {
+                strategy->play[tc][deviation->kind][deviation->total][deviation->upcard - 2] = chartLetterToEntry(letter);
+            }
+        }
+
+        // A pair either splits or plays like its total, so it is compiled last
+        for (int points = 2; points <= 11; points++) {
+            for (int up = 0; up < 10; up++) {
+                char letter = pairChart[points - 2][up];
+                for (int d = 0; d < deviationCount; d++) {
+                    const Deviation* deviation = &deviations[d];
+                    if (deviation->kind == HAND_PAIR && deviation->total == points && deviation->upcard - 2 == up) {
+                        letter = tc + TC_MIN >= deviation->index ? deviation->atOrAbove : deviation->below;
+                    }
+                }
+
+                unsigned char asTotal = points == 11 ? strategy->play[tc][HAND_SOFT][12][up]
+                                                     : strategy->play[tc][HAND_HARD][points * 2][up];
+                strategy->play[tc][HAND_PAIR][points][up] = letter == 'P' ? PLAY_ENTRY(SPLIT, PLAY_FALLBACK(asTotal)) : asTotal;
+            }
+        }
+
+        strategy->betUnits[tc] = betUnits[tc];
+    }
+
+    return strategyCount++;
+}
+
+void initializeStrategies() {
+    strategyCount = STRATEGY_BASIC;  // Slot 0 stands for the human seats
+    strcpy(strategies[STRATEGY_HUMAN].name, "Human");
+
+    registerStrategy("Basic Strategy", BASIC_HARD_CHART, BASIC_SOFT_CHART, BASIC_PAIR_CHART, NULL, 0, FLAT_BET_RAMP);
+    registerStrategy("Hi-Lo Counter", BASIC_HARD_CHART, BASIC_SOFT_CHART, BASIC_PAIR_CHART, HILO_DEVIATIONS,
+                     sizeof(HILO_DEVIATIONS) / sizeof(HILO_DEVIATIONS[0]), HILO_BET_RAMP);
+}
+
+double strategyBet(Game* game, Player* player) {
+    double bet = BOT_BET_UNIT * strategies[player->strategyId].betUnits[getTrueCount(game->board) - TC_MIN];
+    int minimum = STAKE_MIN_BET[game->stake];
+
+    // The ramp is in units smaller than any table minimum, so it starts at the minimum
+    if (bet < minimum) {
+        bet = minimum;
+    }
+
+    // A bot short on chips bets what it has left, and one below the minimum sits out
+    if (bet > player->ChipSum) {
+        bet = (int) player->ChipSum;
+    }
+    if (bet < minimum) {
+        bet = 0;
+    }
+    return bet;
+}
+
+void addHouseBots(Game* game, int firstSeat) {
+    for (int i = firstSeat; i < game->numPlayers; i++) {
+        // Alternate the built in strategies around the table
+        game->players[i].strategyId = STRATEGY_BASIC + (i - firstSeat) % (strategyCount - STRATEGY_BASIC);
+        snprintf(game->players[i].name, MAX_NAME_LEN, "Bot %d (%s)", i + 1, strategies[game->players[i].strategyId].name);
+    }
+}
+
+void statsAdd(RunningStats* stats, double x) {
+    double delta = x - stats->mean;
+
+    stats->count++;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (x - stats->mean);
+}
+
+void statsMerge(RunningStats* into, const RunningStats* from) {
+    if (from->count == 0) {
+        return;
+    }
+
+    // Chan's pairwise update, the same answer as adding the samples one at a time
+    long long count = into->count + from->count;
+    double delta = from->mean - into->mean;
+    into->mean += delta * from->count / count;
+    into->m2 += from->m2 + delta * delta * ((double) into->count * from->count / count);
+    into->count = count;
+}
+
+double statsVariance(const RunningStats* stats) {
+    return stats->count > 1 ? stats->m2 / (stats->count - 1) : 0.0;
+}
+
+double statsHalfWidth(const RunningStats* stats) {
+    return stats->count > 1 ? 1.96 * sqrt(statsVariance(stats) / stats->count) : INFINITY;
+}
+
+void pairedAdd(PairedStats* stats, const double sample[4]) {
+    double before[4];
+
+    stats->count++;
+    for (int i = 0; i < 4; i++) {
+        before[i] = sample[i] - stats->mean[i];
+        stats->mean[i] += before[i] / stats->count;
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            stats->comoment[i][j] += before[i] * (sample[j] - stats->mean[j]);
+        }
+    }
+}
+
+double pairedRatio(const PairedStats* stats, int contender) {
+    return stats->mean[2 * contender + 1] > 0 ? stats->mean[2 * contender] / stats->mean[2 * contender + 1] : 0.0;
+}
+
+double pairedVariance(const PairedStats* stats, double signA, double signB) {
+    double weights[4];
+    double sum = 0;
+
+    if (stats->count < 2) {
+        return 0.0;
+    }
+
+    // A contender's EV moves with net - EV * rounds of a shoe, over the mean rounds of a shoe
+    for (int c = 0; c < 2; c++) {
+        double sign = c == 0 ? signA : signB;
+        double rounds = stats->mean[2 * c + 1];
+        weights[2 * c] = rounds > 0 ? sign / rounds : 0.0;
+        weights[2 * c + 1] = -pairedRatio(stats, c) * weights[2 * c];
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            sum += weights[i] * weights[j] * stats->comoment[i][j];
+        }
+    }
+    return sum / (stats->count - 1) / stats->count;
+}
+
+void seatStatsMerge(SeatStats* into, const SeatStats* from) {
+    statsMerge(&into->net, &from->net);
+    into->wagered += from->wagered;
+    into->wins += from->wins;
+    into->ties += from->ties;
+    into->losses += from->losses;
+}
+
+void initializeSimulationWorker(SimulationWorker* worker, int seatCount, RuleId rules, unsigned long long seed) {
+    Table* table = &worker->table;
+    Game* game = &table->game;
+
+    memset(worker, 0, sizeof(SimulationWorker));
+    attachTable(table);
+    initializeBoard(&table->board);
+    seedDeck(&table->deck, seed);  // Not the clock, a resumed run has to deal the same shoes as one that never stopped
+
+    game->numPlayers = seatCount;
+    game->quiet = true;
+    game->phase = PHASE_WAITING;
+    game->stake = STAKE_LOW;
+    game->rules = rules;
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        initializePlayer(&table->players[i]);
+    }
+    addHouseBots(game, 0);
+    for (int i = 0; i < seatCount; i++) {
+        table->players[i].ChipSum = 1e12;  // Research bankroll, the bots should never go broke
+    }
+    resetRound(game);
+}
+
+void* runSimulationWorker(void* argument) {
+    SimulationRun* run = argument;
+    SeatStats batch[MAX_PLAYERS];
+    double before[MAX_PLAYERS];
+
+    // Which thread plays which table does not matter, everything a table needs is in its block
+    pthread_mutex_lock(&run->lock);
+    SimulationWorker* worker = &run->workers[run->started++];
+    pthread_mutex_unlock(&run->lock);
+    Game* game = &worker->table.game;
+
+    while (!atomic_load_explicit(&run->done, memory_order_relaxed)) {
+        int batchRounds = simulationBatchRounds(run, (int) (worker - run->workers));
+        memset(batch, 0, sizeof(batch));
+
+        for (int r = 0; r < batchRounds; r++) {
+            for (int i = 0; i < run->seatCount; i++) {
+                before[i] = game->players[i].ChipSum;
+            }
+            playRound(game);
+            for (int i = 0; i < run->seatCount; i++) {
+                Player* player = &game->players[i];
+                statsAdd(&batch[i].net, player->ChipSum - before[i]);
+                for (int h = 0; h < player->handCount; h++) {
+                    Hand* hand = &player->hands[h];
+                    batch[i].wagered += hand->bet;
+                    if (hand->isLost) {
+                        batch[i].losses++;
+                    } else if (hand->isTie) {
+                        batch[i].ties++;
+                    } else {
+                        batch[i].wins++;
+                    }
+                }
+            }
+            resetRound(game);
+        }
+
+        for (int i = 0; i < run->seatCount; i++) {
+            seatStatsMerge(&worker->seats[i], &batch[i]);
+        }
+        simulationBatchDone(run);
+    }
+
+    pthread_mutex_lock(&run->lock);
+    run->exited++;
+    pthread_cond_signal(&run->checkpointReady);
+    pthread_mutex_unlock(&run->lock);
+    return NULL;
+}
+
+int simulationBatchRounds(const SimulationRun* run, int worker) {
+    long long left = run->maxRounds - run->rounds;
+
+    if (left >= (long long) SIM_BATCH * SIM_THREADS) {
+        return SIM_BATCH;
+    }
+
+    // What is left is shared out in worker order, so the split is the same on every run and every resume
+    if (left <= 0) {
+        return 0;
+    }
+    return (int) (left / SIM_THREADS + (worker < left % SIM_THREADS ? 1 : 0));
+}
+
+void simulationBatchDone(SimulationRun* run) {
+    pthread_mutex_lock(&run->lock);
+    unsigned long long generation = run->generation;
+    if (++run->arrived < SIM_THREADS) {
+        while (run->generation == generation) {
+            pthread_cond_wait(&run->batchDone, &run->lock);
+        }
+        pthread_mutex_unlock(&run->lock);
+        return;
+    }
+
+    // The last thread to arrive merges for everyone, always in thread order, so the sums come out the same every run
+    bool precise = run->targetPercent > 0;
+    memset(run->seats, 0, sizeof(run->seats));
+    for (int i = 0; i < run->seatCount; i++) {
+        SeatStats* seat = &run->seats[i];
+        for (int t = 0; t < SIM_THREADS; t++) {
+            seatStatsMerge(seat, &run->workers[t].seats[i]);
+        }
+
+        // The interval on the net per round, as a share of the average bet of a round
+        double betPerRound = seat->wagered / seat->net.count;
+        precise = precise && betPerRound > 0 && 100.0 * statsHalfWidth(&seat->net) / betPerRound <= run->targetPercent;
+    }
+    long long played = 0;
+    for (int t = 0; t < SIM_THREADS; t++) {
+        played += simulationBatchRounds(run, t);
+    }
+    run->rounds += played;
+
+    if (run->rounds >= run->maxRounds || (precise && run->rounds >= (long long) SIM_BATCH * SIM_MIN_BATCHES)) {
+        atomic_store_explicit(&run->done, true, memory_order_relaxed);
+    } else if (!run->savePending && nowMilliseconds() - run->savedAt >= SIM_CHECKPOINT_SECONDS * 1000ULL) {
+        // The workers only wait for the copy, the simulation's own thread writes it while they play on
+        memcpy(run->saved, run->workers, SIM_THREADS * sizeof(SimulationWorker));
+        run->savedRounds = run->rounds;
+        run->savedAt = nowMilliseconds();
+        run->savePending = true;
+        pthread_cond_signal(&run->checkpointReady);
+    }
+
+    run->arrived = 0;
+    run->generation++;
+    pthread_cond_broadcast(&run->batchDone);
+    pthread_mutex_unlock(&run->lock);
+}
+
+bool writeSimulationCheckpoint(const SimulationCheckpoint* checkpoint, const SimulationWorker* workers) {
+    char tempPath[256];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", SIM_CHECKPOINT_PATH);
+
+    FILE* file = fopen(tempPath, "wb");
+    if (file == NULL) {
+        perror("Failed to open simulation checkpoint");
+        return false;
+    }
+
+    bool ok = fwrite(checkpoint, sizeof(SimulationCheckpoint), 1, file) == 1;
+    if (workers != NULL) {
+        ok = ok && fwrite(workers, sizeof(SimulationWorker), SIM_THREADS, file) == SIM_THREADS;
+    }
+    ok = fflush(file) == 0 && ok;
+#ifndef _WIN32
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    ok = fclose(file) == 0 && ok;
+
+    // Like the snapshot, a node taken away in the middle of a write leaves the previous checkpoint in place
+    if (!ok || rename(tempPath, SIM_CHECKPOINT_PATH) != 0) {
+        perror("Failed to write simulation checkpoint");
+        remove(tempPath);
+        return false;
+    }
+    return true;
+}
+
+bool loadSimulationCheckpoint(SimulationCheckpoint* checkpoint, SimulationWorker** workers) {
+    *workers = NULL;
+
+    FILE* file = fopen(SIM_CHECKPOINT_PATH, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool ok = fread(checkpoint, sizeof(SimulationCheckpoint), 1, file) == 1 &&
+              memcmp(checkpoint->magic, SIM_CHECKPOINT_MAGIC, sizeof(SIM_CHECKPOINT_MAGIC)) == 0 && checkpoint->version == SIM_CHECKPOINT_VERSION &&
+              checkpoint->workerSize == sizeof(SimulationWorker) && checkpoint->ruleSet >= 0 &&
+              checkpoint->ruleSet <= RULE_SET_COUNT && checkpoint->seatCount > 0 && checkpoint->seatCount <= MAX_PLAYERS;
+    if (ok && checkpoint->rounds > 0) {
+        *workers = malloc(SIM_THREADS * sizeof(SimulationWorker));
+        if (*workers == NULL) {
+            perror("Failed to allocate memory for simulation checkpoint");
+            exit(EXIT_FAILURE);
+        }
+        ok = fread(*workers, sizeof(SimulationWorker), SIM_THREADS, file) == SIM_THREADS;
+    }
+    fclose(file);
+
+    if (!ok) {
+        printf("Simulation checkpoint %s does not match this version of the game\n", SIM_CHECKPOINT_PATH);
+        free(*workers);
+        *workers = NULL;
+    }
+    return ok;
+}
+
+void printSimulationReport(const SeatStats* seats, int seatCount, long long rounds, RuleId rules, Game* names) {
+    printf("\n****** STRATEGY SIMULATION (%lld rounds, %s) ******\n", rounds, RULES[rules].name);
+    for (int i = 0; i < seatCount; i++) {
+        const SeatStats* seat = &seats[i];
+        double net = seat->net.mean * seat->net.count;
+        double betPerRound = seat->wagered / seat->net.count;
+        printf("%-30s W/T/L: %lld/%lld/%lld wagered: %.0f net: %.0f EV: %+.3f%% +/- %.3f%%\n", names->players[i].name,
+               seat->wins, seat->ties, seat->losses, seat->wagered, net,
+               seat->wagered > 0 ? 100.0 * net / seat->wagered : 0.0,
+               betPerRound > 0 ? 100.0 * statsHalfWidth(&seat->net) / betPerRound : 0.0);
+    }
+    printf("*********************************************\n");
+}
+
+void runStrategySimulation(SimulationCheckpoint* checkpoint, SimulationWorker* resumed) {
+    Game names;  // Only lends the bots their names for the report
+
+    initializeGame(&names, checkpoint->seatCount);
+    addHouseBots(&names, 0);
+
+    // A resumed run shows the rule sets it had finished before it was stopped
+    for (int r = 0; r < checkpoint->ruleSet; r++) {
+        printSimulationReport(checkpoint->finished[r], checkpoint->seatCount, checkpoint->finishedRounds[r], (RuleId) r, &names);
+    }
+
+    // The workers and the copy the checkpoint writer takes from them
+    SimulationWorker* workers = malloc(2 * SIM_THREADS * sizeof(SimulationWorker));
+    if (workers == NULL) {
+        perror("Failed to allocate memory for simulator tables");
+        exit(EXIT_FAILURE);
+    }
+
+    // Every rule set plays on its own engine until its EVs are precise enough
+    for (int r = checkpoint->ruleSet; r < RULE_SET_COUNT; r++) {
+        SimulationRun run;
+        pthread_t threads[SIM_THREADS];
+
+        memset(&run, 0, sizeof(run));
+        pthread_mutex_init(&run.lock, NULL);
+        pthread_cond_init(&run.batchDone, NULL);
+        pthread_cond_init(&run.checkpointReady, NULL);
+        run.workers = workers;
+        run.saved = workers + SIM_THREADS;
+        run.savedAt = nowMilliseconds();
+        run.seatCount = checkpoint->seatCount;
+        run.rules = (RuleId) r;
+        run.maxRounds = checkpoint->maxRounds;
+        run.targetPercent = checkpoint->targetPercent;
+
+        if (resumed != NULL) {
+            memcpy(workers, resumed, SIM_THREADS * sizeof(SimulationWorker));
+            for (int t = 0; t < SIM_THREADS; t++) {
+                attachTable(&workers[t].table);
+            }
+            run.rounds = checkpoint->rounds;
+            resumed = NULL;
+        } else {
+            for (int t = 0; t < SIM_THREADS; t++) {
+                initializeSimulationWorker(&workers[t], run.seatCount, run.rules,
+                                           mixSeed(checkpoint->seed + (unsigned long long) (r * SIM_THREADS + t)));
+            }
+        }
+
+        for (int t = 0; t < SIM_THREADS; t++) {
+            if (pthread_create(&threads[t], NULL, runSimulationWorker, &run) != 0) {
+                perror("Failed to start simulator thread");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // This thread writes every checkpoint the workers copy out
+        pthread_mutex_lock(&run.lock);
+        while (run.exited < SIM_THREADS) {
+            if (run.savePending) {
+                checkpoint->rounds = run.savedRounds;
+                pthread_mutex_unlock(&run.lock);
+                writeSimulationCheckpoint(checkpoint, run.saved);
+                pthread_mutex_lock(&run.lock);
+                run.savePending = false;
+            } else {
+                pthread_cond_wait(&run.checkpointReady, &run.lock);
+            }
+        }
+        pthread_mutex_unlock(&run.lock);
+
+        for (int t = 0; t < SIM_THREADS; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        pthread_cond_destroy(&run.checkpointReady);
+        pthread_cond_destroy(&run.batchDone);
+        pthread_mutex_destroy(&run.lock);
+
+        memcpy(checkpoint->finished[r], run.seats, sizeof(run.seats));
+        checkpoint->finishedRounds[r] = run.rounds;
+        checkpoint->ruleSet = r + 1;
+        checkpoint->rounds = 0;
+        writeSimulationCheckpoint(checkpoint, NULL);
+        printSimulationReport(run.seats, run.seatCount, run.rounds, run.rules, &names);
+    }
+
+    remove(SIM_CHECKPOINT_PATH);  // Finished, there is nothing left to resume
+    free(workers);
+    freeGame(&names);
+}
+
+void simulateStrategies() {
+    SimulationCheckpoint checkpoint;
+    SimulationWorker* resumed = NULL;
+    char choice = 'n';
+
+    // A run that was stopped, by a preempted node or anything else, picks up at its last checkpoint
+    if (loadSimulationCheckpoint(&checkpoint, &resumed)) {
+        printf("A simulation was stopped after %lld rounds of %s, resume it? (y/n): ", checkpoint.rounds,
+               checkpoint.ruleSet < RULE_SET_COUNT ? RULES[checkpoint.ruleSet].name : "its last rule set");
+        scanf(" %c", &choice);
+    }
+
+    if (choice != 'y' && choice != 'Y') {
+        free(resumed);
+        resumed = NULL;
+
+        memset(&checkpoint, 0, sizeof(checkpoint));
+        memcpy(checkpoint.magic, SIM_CHECKPOINT_MAGIC, sizeof(SIM_CHECKPOINT_MAGIC));
+        checkpoint.version = SIM_CHECKPOINT_VERSION;
+        checkpoint.workerSize = sizeof(SimulationWorker);
+        checkpoint.seed = (unsigned long long) time(NULL);
+        checkpoint.seatCount = strategyCount - STRATEGY_BASIC;
+        if (checkpoint.seatCount > MAX_PLAYERS) {
+            checkpoint.seatCount = MAX_PLAYERS;
+        }
+
+        printf("insert the largest number of rounds to simulate: ");
+        scanf("%lld", &checkpoint.maxRounds);
+        printf("stop once every EV is known within +/- how many %% (0 plays every round): ");
+        scanf("%lf", &checkpoint.targetPercent);
+    }
+
+    runStrategySimulation(&checkpoint, resumed);
+    free(resumed);
+    printf("\n");
+}
+
+void buildAliasTable(OutcomeTable* table, const double* weights) {
+    int small[OUTCOME_BINS], large[OUTCOME_BINS];
+    int alias[OUTCOME_BINS];
+    int smallCount = 0, largeCount = 0;
+    double total = 0;
+
+    table->count = 0;
+    table->mean = 0;
+    for (int b = 0; b < OUTCOME_BINS; b++) {
+        total += weights[b];
+    }
+
+    // Only outcomes that happened get a bin, scaled so the average bin holds 1
+    for (int b = 0; b < OUTCOME_BINS; b++) {
+        if (weights[b] > 0) {
+            OutcomeBin* bin = &table->bins[table->count++];
+            bin->value = (b - OUTCOME_RANGE) / 10.0;
+            bin->keepBelow = weights[b] / total;
+            table->mean += bin->value * bin->keepBelow;
+        }
+    }
+    for (int b = 0; b < table->count; b++) {
+        table->bins[b].keepBelow *= table->count;
+        alias[b] = b;
+        if (table->bins[b].keepBelow < 1.0) {
+            small[smallCount++] = b;
+        } else {
+            large[largeCount++] = b;
+        }
+    }
+
+    // Vose: every short bin is topped up from a tall one, which may become short itself
+    while (smallCount > 0 && largeCount > 0) {
+        int shortBin = small[--smallCount];
+        int tallBin = large[largeCount - 1];
+        alias[shortBin] = tallBin;
+        table->bins[tallBin].keepBelow -= 1.0 - table->bins[shortBin].keepBelow;
+        if (table->bins[tallBin].keepBelow < 1.0) {
+            largeCount--;
+            small[smallCount++] = tallBin;
+        }
+    }
+    while (largeCount > 0) {
+        table->bins[large[--largeCount]].keepBelow = 1.0;
+    }
+    while (smallCount > 0) {
+        table->bins[small[--smallCount]].keepBelow = 1.0;  // Only rounding left these short
+    }
+    for (int b = 0; b < table->count; b++) {
+        table->bins[b].aliasValue = table->bins[alias[b]].value;
+    }
+}
+
+void sampleOutcomes(OutcomeTable* table, int strategyId, RuleId rules) {
+    static double weights[OUTCOME_BINS];
+    Game game;
+
+    memset(weights, 0, sizeof(weights));
+    initializeGame(&game, 1);
+    game.quiet = true;
+    game.rules = rules;
+    game.players[0].strategyId = strategyId;
+    game.players[0].ChipSum = 1e12;  // Research bankroll, the ramp must never be cut short
+    resetRound(&game);
+
+    for (long r = 0; r < OUTCOME_SAMPLE_ROUNDS; r++) {
+        double before = game.players[0].ChipSum;
+        playRound(&game);
+        int bin = (int) lround((game.players[0].ChipSum - before) * 10.0 / BOT_BET_UNIT);
+        if (bin < -OUTCOME_RANGE) {
+            bin = -OUTCOME_RANGE;
+        } else if (bin > OUTCOME_RANGE) {
+            bin = OUTCOME_RANGE;
+        }
+        weights[bin + OUTCOME_RANGE]++;
+        resetRound(&game);
+    }
+    freeGame(&game);
+
+    buildAliasTable(table, weights);
+}
+
+void* runBankrollWorker(void* argument) {
+    BankrollJob* job = argument;
+    const OutcomeTable* outcomes = job->outcomes;
+    BankrollPaths* paths = job->paths;
+    LaneReal zero = {0}, one = zero + 1.0;
+    LaneReal minBet = zero + job->minBet;
+    double binScale = 0x1.0p-31 * outcomes->count;
+
+    for (long block = job->firstBlock; block < job->lastBlock; block++) {
+        long first = block * BANKROLL_LANES;
+        LaneReal chips = zero + START_CHIPS, peak = chips, drawdown = zero, rounds = zero, alive = one;
+        LaneBits rng;
+
+        for (int l = 0; l < BANKROLL_LANES; l++) {
+            rng[l] = mixSeed(job->seed + (unsigned long long) (first + l)) | 1;  // xorshift must not start at zero
+        }
+
+        // The block stays in registers for its whole session and stops once every lane is ruined
+        for (int r = 0; r < job->sessionRounds; r++) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+
+            // The whole part of one uniform picks the bin and its fraction decides between the bin's two outcomes,
+            // 31 bits go through int lanes since few vector units convert 64 bit integers
+            LaneReal u = __builtin_convertvector(__builtin_convertvector(rng >> 33, LaneIndex), LaneReal) * binScale;
+            LaneIndex bin = __builtin_convertvector(u, LaneIndex);
+            LaneReal keep = u - __builtin_convertvector(bin, LaneReal);
+
+            // The table lookup is the only step without a vector form, one cache line per lane
+            LaneReal keepBelow, value, aliasValue;
+            for (int l = 0; l < BANKROLL_LANES; l++) {
+                const OutcomeBin* drawn = &outcomes->bins[bin[l]];
+                keepBelow[l] = drawn->keepBelow;
+                value[l] = drawn->value;
+                aliasValue[l] = drawn->aliasValue;
+            }
+            LaneReal outcome = LANE_SELECT(keep < keepBelow, value, aliasValue);
+
+            chips += outcome * job->minBet * alive;
+            chips = LANE_SELECT(chips < zero, zero, chips);  // A lost double or split can not take more than the seat has
+            peak = LANE_SELECT(chips > peak, chips, peak);
+            drawdown = LANE_SELECT(peak - chips > drawdown, peak - chips, drawdown);
+            rounds += alive;
+            alive = LANE_SELECT(chips < minBet, zero, alive);
+
+            if (r % 64 == 63) {
+                double living = 0;
+                for (int l = 0; l < BANKROLL_LANES; l++) {
+                    living += alive[l];
+                }
+                if (living == 0) {
+                    break;
+                }
+            }
+        }
+
+        for (int l = 0; l < BANKROLL_LANES; l++) {
+            paths->endChips[first + l] = chips[l];
+            paths->drawdown[first + l] = drawdown[l];
+            paths->rounds[first + l] = rounds[l];
+            paths->ruined[first + l] = alive[l] == 0;
+        }
+    }
+    return NULL;
+}
+
+int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+void simulateBankrolls() {
+    OutcomeTable* outcomes = malloc(sizeof(OutcomeTable));
+    BankrollPaths paths;
+    long count;
+    int sessionRounds;
+
+    if (outcomes == NULL) {
+        perror("Failed to allocate memory for outcome table");
+        exit(EXIT_FAILURE);
+    }
+    int strategyId = getStrategy();
+    RuleId rules = getRuleSet();
+    printf("insert the number of bankroll paths: ");
+    scanf("%ld", &count);
+    printf("insert the longest session in rounds: ");
+    scanf("%d", &sessionRounds);
+    if (count < BANKROLL_LANES || sessionRounds <= 0) {
+        printf("Nothing to simulate.\n");
+        free(outcomes);
+        return;
+    }
+    count -= count % BANKROLL_LANES;
+
+    // Paths draw whole rounds from what the engine really pays, one bot at one seat
+    printf("Learning the outcomes of %s from %d rounds...\n", strategies[strategyId].name, OUTCOME_SAMPLE_ROUNDS);
+    sampleOutcomes(outcomes, strategyId, rules);
+
+    paths.count = count;
+    paths.endChips = malloc(count * sizeof(double));
+    paths.drawdown = malloc(count * sizeof(double));
+    paths.rounds = malloc(count * sizeof(double));
+    paths.ruined = malloc(count * sizeof(bool));
+    double* sorted = malloc(count * sizeof(double));
+    if (paths.endChips == NULL || paths.drawdown == NULL || paths.rounds == NULL || paths.ruined == NULL || sorted == NULL) {
+        perror("Failed to allocate memory for bankroll paths");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("\n****** BANKROLL PATHS (%ld paths, %d rounds, %s, %s, EV %+.4f units/round) ******\n", count, sessionRounds,
+           strategies[strategyId].name, RULES[rules].name, outcomes->mean);
+
+    // Every table limit is one run over the same outcome table, spread over the simulator threads
+    for (int stake = STAKE_LOW; stake <= STAKE_HIGH; stake++) {
+        BankrollJob jobs[SIM_THREADS];
+        pthread_t threads[SIM_THREADS];
+        long blocks = count / BANKROLL_LANES;
+        unsigned long long seed = (unsigned long long) time(NULL) ^ ((unsigned long long) stake << 56);
+
+        for (int t = 0; t < SIM_THREADS; t++) {
+            jobs[t] = (BankrollJob) {&paths, outcomes, blocks * t / SIM_THREADS, blocks * (t + 1) / SIM_THREADS,
+                                     STAKE_MIN_BET[stake], sessionRounds, seed};
+            if (pthread_create(&threads[t], NULL, runBankrollWorker, &jobs[t]) != 0) {
+                perror("Failed to start bankroll thread");
+                exit(EXIT_FAILURE);
+            }
+        }
+        for (int t = 0; t < SIM_THREADS; t++) {
+            pthread_join(threads[t], NULL);
+        }
+
+        long ruined = 0;
+        for (long i = 0; i < count; i++) {
+            if (paths.ruined[i]) {
+                sorted[ruined++] = paths.rounds[i];
+            }
+        }
+        printf("%s table (min bet %d, start %.0f chips):\n", STAKE_NAMES[stake], STAKE_MIN_BET[stake], START_CHIPS);
+        printf("  risk of ruin: %.3f%%\n", 100.0 * ruined / count);
+        if (ruined > 0) {
+            qsort(sorted, ruined, sizeof(double), compareDoubles);
+            printf("  rounds until ruin p10/p50/p90: %.0f / %.0f / %.0f\n", sorted[ruined / 10], sorted[ruined / 2], sorted[ruined * 9 / 10]);
+        }
+
+        memcpy(sorted, paths.rounds, count * sizeof(double));
+        qsort(sorted, count, sizeof(double), compareDoubles);
+        printf("  session length p10/p50/p90: %.0f / %.0f / %.0f rounds\n", sorted[count / 10], sorted[count / 2], sorted[count * 9 / 10]);
+
+        memcpy(sorted, paths.drawdown, count * sizeof(double));
+        qsort(sorted, count, sizeof(double), compareDoubles);
+        printf("  max drawdown p50/p90/p99: %.0f / %.0f / %.0f chips\n", sorted[count / 2], sorted[count * 9 / 10], sorted[count * 99 / 100]);
+    }
+    printf("*********************************************\n\n");
+
+    free(sorted);
+    free(paths.endChips);
+    free(paths.drawdown);
+    free(paths.rounds);
+    free(paths.ruined);
+    free(outcomes);
+}
+
+unsigned long long mixSeed(unsigned long long x) {
+    // splitmix64, consecutive counters give unrelated seeds
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Expands the dealer hand that drew the cards in drawn, adding the chance of every outcome to outcomes
+void dealerOddsFrom(unsigned short* ranks, int left, int hard, bool ace, int cards, bool hitSoft17,
+                    unsigned long long drawn, OddsMemo* memo, double* outcomes) {
+    unsigned int slot = (unsigned int) ((drawn * 0x9E3779B97F4A7C15ULL) >> 55) & (ODDS_MEMO - 1);
+    double sum[DEALER_OUTCOMES] = {0};
+
+    while (memo->keys[slot] != 0) {
+        if (memo->keys[slot] == drawn) {
+            memcpy(outcomes, memo->outcomes[slot], sizeof(sum));
+            return;
+        }
+        slot = (slot + 1) & (ODDS_MEMO - 1);
+    }
+
+    for (int r = 0; r < 10; r++) {
+        if (ranks[r] == 0) {
+            continue;
+        }
+        double chance = (double) ranks[r] / left;
+        int nextHard = hard + (r == 9 ? 1 : r + 2);
+        bool nextAce = ace || r == 9;
+        bool soft = nextAce && nextHard + 10 <= 21;
+        int score = soft ? nextHard + 10 : nextHard;
+
+        // Hands that end here are counted on the spot, only a hand that hits again goes deeper
+        if (cards == 1 && score == 21) {
+            sum[DEALER_BLACKJACK] += chance;
+        } else if (score > 21) {
+            sum[DEALER_BUST] += chance;
+        } else if (cards >= 1 && (score > 17 || (score == 17 && !(hitSoft17 && soft)))) {
+            sum[DEALER_17 + score - 17] += chance;
+        } else {
+            double next[DEALER_OUTCOMES];
+            ranks[r]--;
+            dealerOddsFrom(ranks, left - 1, nextHard, nextAce, cards + 1, hitSoft17, drawn + (1ULL << (5 * r)), memo, next);
+            ranks[r]++;
+            for (int o = 0; o < DEALER_OUTCOMES; o++) {
+                sum[o] += chance * next[o];
+            }
+        }
+    }
+
+    memcpy(outcomes, sum, sizeof(sum));
+    memo->keys[slot] = drawn;
+    memcpy(memo->outcomes[slot], sum, sizeof(sum));
+}
+
+void dealerOdds(const unsigned short* unseen, int upcard, bool hitSoft17, double* outcomes) {
+    unsigned long long hash = upcard * 2 + hitSoft17;
+    unsigned short ranks[10];
+    int left = 0;
+
+    for (int r = 0; r < 10; r++) {
+        hash = hash * 131 + unseen[r];
+        left += unseen[r];
+    }
+    OddsCacheEntry* entry = &oddsCache[mixSeed(hash) & (ODDS_CACHE - 1)];
+    if (entry->upcard == upcard && entry->hitSoft17 == hitSoft17 && memcmp(entry->ranks, unseen, sizeof(entry->ranks)) == 0) {
+        memcpy(outcomes, entry->dealer, sizeof(entry->dealer));
+        return;
+    }
+
+    // The memo lives on the stack, only its keys need clearing
+    OddsMemo memo;
+    memset(memo.keys, 0, sizeof(memo.keys));
+    memcpy(ranks, unseen, sizeof(ranks));
+    int r = upcard - 2;
+    dealerOddsFrom(ranks, left, r == 9 ? 1 : upcard, r == 9, 1, hitSoft17, 1ULL << (5 * r), &memo, outcomes);
+
+    memcpy(entry->ranks, unseen, sizeof(entry->ranks));
+    entry->upcard = (unsigned char) upcard;
+    entry->hitSoft17 = hitSoft17;
+    memcpy(entry->dealer, outcomes, sizeof(entry->dealer));
+}
+
+void handOdds(Game* game, Hand* hand, bool hitSoft17, HandOdds* odds) {
+    unsigned short unseen[10];
+    bool soft;
+    int total = calculateSoftScore(hand->card, hand->countCard, &soft);
+    int left = 0;
+
+    // The player has not seen the hole card, it is as unknown as the shoe
+    memcpy(unseen, game->board->deck->ranks, sizeof(unseen));
+    unseen[cardPoints(&game->board->dealerCards[1]) - 2]++;
+    for (int r = 0; r < 10; r++) {
+        left += unseen[r];
+    }
+
+    // A soft hand counts its Ace as one instead of busting, a hard hand busts on anything above 21 - total
+    int busting = 0;
+    if (!soft) {
+        for (int r = 0; r < 10; r++) {
+            if (total + (r == 9 ? 1 : r + 2) > 21) {
+                busting += unseen[r];
+            }
+        }
+    }
+    odds->bust = left > 0 ? (double) busting / left : 0;
+    dealerOdds(unseen, cardPoints(&game->board->dealerCards[0]), hitSoft17, odds->dealer);
+}
+
+void printOdds(const HandOdds* odds) {
+    printf("Odds: bust on a hit %.1f%% | dealer 17 %.1f%%, 18 %.1f%%, 19 %.1f%%, 20 %.1f%%, 21 %.1f%%, blackjack %.1f%%, bust %.1f%%\n",
+           100 * odds->bust, 100 * odds->dealer[DEALER_17], 100 * odds->dealer[DEALER_18], 100 * odds->dealer[DEALER_19],
+           100 * odds->dealer[DEALER_20], 100 * odds->dealer[DEALER_21], 100 * odds->dealer[DEALER_BLACKJACK],
+           100 * odds->dealer[DEALER_BUST]);
+}
+
+double edgeStand(EdgeShoe* shoe, int total, bool natural) {
+    double dealer[DEALER_OUTCOMES];
+    dealerOdds(shoe->ranks, shoe->upcard, shoe->rules->hitSoft17, dealer);
+
+    // Only a dealer Blackjack stops a player Blackjack from being paid, and then it is a tie
+    if (natural) {
+        return (1 - dealer[DEALER_BLACKJACK]) * shoe->rules->blackjackPays / shoe->rules->blackjackPer;
+    }
+
+    // The dealer never peeks, so a dealer Blackjack beats every other hand once it is played out
+    double ev = dealer[DEALER_BUST] - dealer[DEALER_BLACKJACK];
+    for (int score = 17; score <= 21; score++) {
+        double chance = dealer[DEALER_17 + score - 17];
+        if (total > score) {
+            ev += chance;
+        } else if (total < score) {
+            ev -= chance;
+        }
+    }
+    return ev;
+}
+
+void edgeHand(EdgeShoe* shoe, int hard, bool ace, int cards, unsigned long long drawn, double* stand, double* best) {
+    EdgeMemo* memo = shoe->memo;
+    unsigned int slot = (unsigned int) ((drawn * 0x9E3779B97F4A7C15ULL) >> 50) & (EDGE_MEMO - 1);
+
+    while (memo->keys[slot] != 0) {
+        if (memo->keys[slot] == drawn) {
+            *stand = memo->stand[slot];
+            *best = memo->best[slot];
+            return;
+        }
+        slot = (slot + 1) & (EDGE_MEMO - 1);
+    }
+
+    int total = ace && hard + 10 <= 21 ? hard + 10 : hard;
+    *stand = edgeStand(shoe, total, false);
+    *best = *stand;
+
+    // The hand stands by itself on 21 and once it holds as many cards as a hand can
+    if (total < 21 && cards < MAX_HAND_CARDS) {
+        double hit = edgeDraw(shoe, hard, ace, cards, drawn, false);
+        if (hit > *best) {
+            *best = hit;
+        }
+    }
+
+    memo->keys[slot] = drawn;
+    memo->stand[slot] = *stand;
+    memo->best[slot] = *best;
+}
+
+double edgeDraw(EdgeShoe* shoe, int hard, bool ace, int cards, unsigned long long drawn, bool doubled) {
+    double ev = 0;
+
+    for (int r = 0; r < 10; r++) {
+        if (shoe->ranks[r] == 0) {
+            continue;
+        }
+        double chance = (double) shoe->ranks[r] / shoe->left;
+        int nextHard = hard + (r == 9 ? 1 : r + 2);
+        double stand;
+        double best;
+
+        if (nextHard > 21) {
+            ev -= chance;
+            continue;
+        }
+        shoe->ranks[r]--;
+        shoe->left--;
+        edgeHand(shoe, nextHard, ace || r == 9, cards + 1, drawn + (1ULL << (5 * r)), &stand, &best);
+        shoe->ranks[r]++;
+        shoe->left++;
+        ev += chance * (doubled ? stand : best);
+    }
+    return ev;
+}
+
+double edgeFirstPlay(EdgeShoe* shoe, int first, int second, bool split, Decision* play) {
+    int hard = (first == 9 ? 1 : first + 2) + (second == 9 ? 1 : second + 2);
+    bool ace = first == 9 || second == 9;
+    int total = ace && hard + 10 <= 21 ? hard + 10 : hard;
+    unsigned long long drawn = (1ULL << (5 * first)) + (1ULL << (5 * second));
+
+    // Only an unsplit hand can be a Blackjack, and split Aces take no more cards
+    double best = edgeStand(shoe, total, !split && total == 21);
+    *play = STAND;
+    if (total == 21 || (split && first == 9)) {
+        return best;
+    }
+
+    double hit = edgeDraw(shoe, hard, ace, 2, drawn, false);
+    if (hit > best) {
+        best = hit;
+        *play = HIT;
+    }
+    double doubled = 2 * edgeDraw(shoe, hard, ace, 2, drawn, true);
+    if (doubled > best) {
+        best = doubled;
+        *play = DOUBLE;
+    }
+    if (shoe->rules->surrender && !split && -0.5 > best) {
+        best = -0.5;
+        *play = SURRENDER;
+    }
+    return best;
+}
+
+void* runHouseEdgeWorker(void* argument) {
+    HouseEdge* edge = argument;
+    EdgeMemo* memo = malloc(sizeof(EdgeMemo));
+    int job;
+
+    if (memo == NULL) {
+        perror("Failed to allocate memory for house edge memo");
+        exit(EXIT_FAILURE);
+    }
+
+    while ((job = edge->nextJob++) < EDGE_JOBS) {
+        int up = job % 10;
+        int pair = job / 10 - 1;
+        EdgeShoe shoe = {.upcard = up + 2, .rules = &edge->rules, .memo = memo};
+        Decision play;
+
+        memcpy(shoe.ranks, edge->shoe, sizeof(shoe.ranks));
+        shoe.ranks[up]--;
+        for (int r = 0; r < 10; r++) {
+            shoe.left += shoe.ranks[r];
+        }
+        memset(memo->keys, 0, sizeof(memo->keys));
+
+        if (pair < 0) {
+            // The unsplit hands of an upcard share one memo, the cards a hand holds say what is left of the shoe
+            for (int a = 0; a < 10; a++) {
+                for (int b = a; b < 10; b++) {
+                    if (shoe.ranks[a] == 0 || shoe.ranks[b] < 1 + (a == b)) {
+                        continue;
+                    }
+                    shoe.ranks[a]--;
+                    shoe.ranks[b]--;
+                    shoe.left -= 2;
+                    edge->ev[up][a][b] = edgeFirstPlay(&shoe, a, b, false, &play);
+                    edge->play[up][a][b] = play;
+                    edge->ev[up][b][a] = edge->ev[up][a][b];
+                    edge->play[up][b][a] = play;
+                    shoe.ranks[a]++;
+                    shoe.ranks[b]++;
+                    shoe.left += 2;
+                }
+            }
+            continue;
+        }
+
+        // Each split hand is worth the same on its own cards, the other hand's cards are as unseen as the shoe.
+        // The pair card of the other hand is gone, this hand draws its second card and is never split again.
+        if (shoe.ranks[pair] < 2) {
+            continue;
+        }
+        shoe.ranks[pair] -= 2;
+        shoe.left -= 2;
+        double ev = 0;
+        for (int r = 0; r < 10; r++) {
+            if (shoe.ranks[r] == 0) {
+                continue;
+            }
+            double chance = (double) shoe.ranks[r] / shoe.left;
+            shoe.ranks[r]--;
+            shoe.left--;
+            ev += chance * edgeFirstPlay(&shoe, pair, r, true, &play);
+            shoe.ranks[r]++;
+            shoe.left++;
+        }
+        edge->split[up][pair] = 2 * ev;
+    }
+
+    free(memo);
+    return NULL;
+}
+
+void calculateHouseEdge() {
+    static const char* RANK_NAMES[10] = {"2", "3", "4", "5", "6", "7", "8", "9", "10", "A"};
+    pthread_t threads[EDGE_THREADS_MAX];
+    int threadCount = processorThreads(EDGE_THREADS_MAX);
+    int decks;
+
+    HouseEdge* edge = calloc(1, sizeof(HouseEdge));
+    if (edge == NULL) {
+        perror("Failed to allocate memory for house edge");
+        exit(EXIT_FAILURE);
+    }
+    RuleId rules = getRuleSet();
+    // The calculator plays every split hand once, so it only vouches for the rule sets the tables play that way
+    while (RULES[rules].resplit) {
+        printf("%s splits pairs again, which the calculator does not model. Pick a rule set that splits once.\n", RULES[rules].name);
+        rules = getRuleSet();
+    }
+    edge->rules = RULES[rules];
+    printf("insert the number of decks (0 for the rule set's own): ");
+    scanf("%d", &decks);
+    while (decks < 0 || decks > EDGE_MAX_DECKS) {
+        printf("Pick 0 to %d decks, try again: ", EDGE_MAX_DECKS);
+        scanf("%d", &decks);
+    }
+    if (decks > 0) {
+        edge->rules.decks = decks;
+    }
+    for (int r = 0; r < 10; r++) {
+        edge->shoe[r] = (unsigned short) (r == 8 ? 16 * edge->rules.decks : 4 * edge->rules.decks);
+    }
+
+    unsigned long long began = nowMicroseconds();
+    for (int t = 0; t < threadCount; t++) {
+        if (pthread_create(&threads[t], NULL, runHouseEdgeWorker, edge) != 0) {
+            perror("Failed to start house edge thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int t = 0; t < threadCount; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    // Every first two cards and upcard in the order they are dealt, each taken from what the cards before it left
+    int cards = 52 * edge->rules.decks;
+    double total = 0;
+    for (int a = 0; a < 10; a++) {
+        for (int b = 0; b < 10; b++) {
+            for (int up = 0; up < 10; up++) {
+                double chance = (double) edge->shoe[a] / cards * (edge->shoe[b] - (b == a)) / (cards - 1) *
+                                (edge->shoe[up] - (up == a) - (up == b)) / (cards - 2);
+                if (chance <= 0) {
+                    continue;
+                }
+                double ev = edge->ev[up][a][b];
+                if (a == b && edge->split[up][a] > ev) {
+                    ev = edge->split[up][a];
+                }
+                total += chance * ev;
+            }
+        }
+    }
+    double seconds = (nowMicroseconds() - began) / 1e6;
+
+    printf("\n****** HOUSE EDGE (%s, %d deck%s) ******\n", edge->rules.name, edge->rules.decks, edge->rules.decks == 1 ? "" : "s");
+    printf("EV of the best play of every first hand against every upcard, in bets:\n");
+    printf("Hand  ");
+    for (int up = 0; up < 10; up++) {
+        printf(" %7s", RANK_NAMES[up]);
+    }
+    printf("\n");
+    for (int b = 0; b < 10; b++) {
+        for (int a = 0; a <= b; a++) {
+            char hand[8];
+            snprintf(hand, sizeof(hand), "%s,%s", RANK_NAMES[b], RANK_NAMES[a]);
+            printf("%-6s", hand);
+            for (int up = 0; up < 10; up++) {
+                double ev = edge->ev[up][a][b];
+                char play = EDGE_PLAY_LETTERS[edge->play[up][a][b]];
+                if (a == b && edge->split[up][a] > ev) {
+                    ev = edge->split[up][a];
+                    play = EDGE_PLAY_LETTERS[SPLIT];
+                }
+                printf(" %+6.3f%c", ev, play);
+            }
+            printf("\n");
+        }
+    }
+    printf("S stand, H hit, D double, P split, R surrender. Every hand is played on its own cards, and like at the table a split pair is never split again.\n");
+    printf("Player EV: %+.4f%% of the first bet\n", 100 * total);
+    printf("House edge: %.4f%%\n", -100 * total);
+    printf("Worked out in %.2f seconds on %d threads\n", seconds, threadCount);
+    printf("*************************************\n\n");
+    free(edge);
+}
+
+double playShoe(Game* game, unsigned long long seed, bool mirrored, long* rounds) {
+    Deck* deck = game->board->deck;
+    double startChips = game->players[0].ChipSum;
+    int dealt = 0;
+    bool due;
+
+    initializeDeck(deck, RULES[game->rules].decks);
+    seedDeck(deck, seed);
+    if (mirrored) {
+        shuffleDeckMirrored(deck);
+    } else {
+        shuffleDeck(deck);
+    }
+    game->board->runningCount = 0;
+
+    // The last round checks the cut card before resetRound would reshuffle on its own,
+    // a shuffling machine never comes due and counts as a shoe once it has dealt as many cards as it holds
+    do {
+        playRound(game);
+        dealt += deck->shoeSize - deck->deckSize;
+        due = RULES[game->rules].continuous ? dealt >= deck->shoeSize : shoeDue(game);
+        resetRound(game);
+        (*rounds)++;
+    } while (!due);
+
+    return (game->players[0].ChipSum - startChips) / BOT_BET_UNIT;
+}
+
+int getStrategy() {
+    int choice;
+
+    for (int i = STRATEGY_BASIC; i < strategyCount; i++) {
+        printf("%d. %s\n", i - STRATEGY_BASIC + 1, strategies[i].name);
+    }
+    printf("choose the strategy: ");
+    scanf("%d", &choice);
+
+    while (choice < 1 || choice > strategyCount - STRATEGY_BASIC) {
+        printf("Pick a strategy from 1 to %d, try again: ", strategyCount - STRATEGY_BASIC);
+        scanf("%d", &choice);
+    }
+
+    return STRATEGY_BASIC + choice - 1;
+}
+
+void compareStrategies() {
+    Game games[2];
+    long shoes;
+    char choice;
+    bool antithetic;
+    long rounds[2] = {0, 0};
+    PairedStats stats = {0};  // Net and rounds of A and of B, one sample per shoe
+
+    for (int c = 0; c < 2; c++) {
+        printf("\n*** Contender %c ***\n", 'A' + c);
+        initializeGame(&games[c], 1);
+        games[c].quiet = true;
+        games[c].players[0].strategyId = getStrategy();
+        games[c].rules = getRuleSet();
+
+        // The same seed only shuffles the same shoe out of the same number of decks
+        while (c == 1 && RULES[games[1].rules].decks != RULES[games[0].rules].decks) {
+            printf("Contender A plays %d deck(s), pick a rule set with as many so both see the same shoes.\n",
+                   RULES[games[0].rules].decks);
+            games[c].rules = getRuleSet();
+        }
+        games[c].players[0].ChipSum = 1e12;  // Research bankroll, the bots should never go broke
+        snprintf(games[c].players[0].name, MAX_NAME_LEN, "%s", strategies[games[c].players[0].strategyId].name);
+        resetRound(&games[c]);
+    }
+    printf("insert the number of shoes to play: ");
+    scanf("%ld", &shoes);
+    printf("add the antithetic twin of every shoe? (y/n): ");
+    scanf(" %c", &choice);
+    antithetic = choice == 'y' || choice == 'Y';
+
+    unsigned long long baseSeed = (unsigned long long) time(NULL);
+
+    // Both contenders see exactly the same shoes, so the luck of the cards cancels in A - B
+    for (long s = 0; s < shoes; s++) {
+        unsigned long long seed = mixSeed(baseSeed + (unsigned long long) s);
+        double sample[4];
+
+        for (int c = 0; c < 2; c++) {
+            long shoeRounds = 0;
+            double net = playShoe(&games[c], seed, false, &shoeRounds);
+            if (antithetic) {
+                net += playShoe(&games[c], seed, true, &shoeRounds);
+            }
+            sample[2 * c] = net;
+            sample[2 * c + 1] = shoeRounds;
+            rounds[c] += shoeRounds;
+        }
+        pairedAdd(&stats, sample);
+    }
+
+    // Averaging the EV of every shoe would weigh a short shoe's rounds more, the ratio of the totals does not
+    double mean[3] = {pairedRatio(&stats, 0), pairedRatio(&stats, 1), pairedRatio(&stats, 0) - pairedRatio(&stats, 1)};
+    double variance[3] = {pairedVariance(&stats, 1, 0), pairedVariance(&stats, 0, 1), pairedVariance(&stats, 1, -1)};
+    double halfWidth = 1.96 * sqrt(variance[2]);
+
+    printf("\n****** PAIRED COMPARISON (%ld shoes%s) ******\n", shoes, antithetic ? " and their antithetic twins" : "");
+    for (int c = 0; c < 2; c++) {
+        printf("%c: %-16s %-22s rounds: %ld EV: %+.4f units/round\n", 'A' + c, games[c].players[0].name,
+               RULES[games[c].rules].name, rounds[c], mean[c]);
+    }
+    printf("A - B: %+.4f units/round, 95%% CI [%+.4f, %+.4f]\n", mean[2], mean[2] - halfWidth, mean[2] + halfWidth);
+
+    // Independent runs would see the variance of A plus the variance of B
+    if (variance[2] > 0) {
+        printf("Pairing cut the variance %.1fx, as many times fewer shoes as independent runs need\n",
+               (variance[0] + variance[1]) / variance[2]);
+    }
+    printf("*********************************************\n\n");
+
+    freeGame(&games[0]);
+    freeGame(&games[1]);
+}
+
+int leaderboardBucket(double chips) {
+    double halves = chips * 2;
+    return halves >= LEADERBOARD_BUCKETS - 1 ? LEADERBOARD_BUCKETS - 1 : halves > 0 ? (int) halves : 0;
+}
+
+void leaderboardAdd(Leaderboard* leaderboard, int bucket, int delta) {
+    for (int i = bucket + 1; i <= LEADERBOARD_BUCKETS; i += i & -i) {
+        atomic_fetch_add_explicit(&leaderboard->tree[i], delta, memory_order_relaxed);
+    }
+}
+
+void leaderboardMove(Leaderboard* leaderboard, int from, int to) {
+    int out = from + 1, in = to + 1;
+
+    // Both paths end in the same nodes once they meet, those keep their count and are never written,
+    // so the top of the tree that every table shares is left alone
+    while (out != in && (out <= LEADERBOARD_BUCKETS || in <= LEADERBOARD_BUCKETS)) {
+        if (in > LEADERBOARD_BUCKETS || (out <= LEADERBOARD_BUCKETS && out < in)) {
+            atomic_fetch_sub_explicit(&leaderboard->tree[out], 1, memory_order_relaxed);
+            out += out & -out;
+        } else {
+            atomic_fetch_add_explicit(&leaderboard->tree[in], 1, memory_order_relaxed);
+            in += in & -in;
+        }
+    }
+}
+
+int leaderboardCountBelow(Leaderboard* leaderboard, int bucket) {
+    int count = 0;
+
+    for (int i = bucket; i > 0; i -= i & -i) {
+        count += atomic_load_explicit(&leaderboard->tree[i], memory_order_relaxed);
+    }
+    return count;
+}
+
+int leaderboardStackAt(Leaderboard* leaderboard, int rank) {
+    // The rank-th biggest stack is the (entrants - rank + 1)-th smallest, found by one walk down the tree
+    int wanted = leaderboard->entrants - rank + 1;
+    int position = 0;
+
+    for (int step = LEADERBOARD_BUCKETS; step > 0; step >>= 1) {
+        if (position + step <= LEADERBOARD_BUCKETS) {
+            int count = atomic_load_explicit(&leaderboard->tree[position + step], memory_order_relaxed);
+            if (count < wanted) {
+                position += step;
+                wanted -= count;
+            }
+        }
+    }
+    // Counts read while tables move them may not add up, the walk then runs off the end
+    return position < LEADERBOARD_BUCKETS ? position : LEADERBOARD_BUCKETS - 1;
+}
+
+int tournamentTakeTable(Tournament* tournament, int self) {
+    _Atomic unsigned long long* own = &tournament->deques[self].range;
+    unsigned long long range = atomic_load(own);
+
+    for (;;) {
+        unsigned int next = (unsigned int) range, end = (unsigned int) (range >> 32);
+        if (next >= end) {
+            break;
+        }
+        if (atomic_compare_exchange_weak(own, &range, ((unsigned long long) end << 32) | (next + 1))) {
+            return (int) next;
+        }
+    }
+
+    // Only this thread refills its own deque and it is empty, so a thief can never be part way through it
+    for (int v = 1; v < tournament->threads; v++) {
+        _Atomic unsigned long long* victim = &tournament->deques[(self + v) % tournament->threads].range;
+        range = atomic_load(victim);
+
+        for (;;) {
+            unsigned int next = (unsigned int) range, end = (unsigned int) (range >> 32);
+            if (next >= end) {
+                break;
+            }
+            unsigned int split = end - (end - next + 1) / 2;
+            if (atomic_compare_exchange_weak(victim, &range, ((unsigned long long) split << 32) | next)) {
+                // The first stolen table is played now, the rest can be stolen again from here
+                atomic_store(own, ((unsigned long long) end << 32) | (split + 1));
+                return (int) split;
+            }
+        }
+    }
+    return -1;
+}
+
+void playTournamentTable(Tournament* tournament, Table* table, int index) {
+    Game* game = &table->game;
+    Entrant* seated[MAX_PLAYERS];
+    int seats = 0;
+    unsigned long long started = nowMicroseconds();
+
+    memset(table, 0, sizeof(Table));
+    attachTable(table);
+    initializeBoard(&table->board);
+    // Every table of every level has its own shoe, so no result depends on the thread that played it
+    seedDeck(&table->deck, mixSeed(tournament->seed + (tournament->level << 32) + (unsigned long long) index));
+    game->quiet = true;
+    game->phase = PHASE_WAITING;
+    game->stake = STAKE_LOW;
+    game->rules = tournament->rules;
+
+    for (int s = index; s < tournament->seated; s += tournament->tables) {
+        Entrant* entrant = &tournament->entrants[tournament->seating[s]];
+        Player* player = &table->players[seats];
+        initializePlayer(player);
+        player->ChipSum = entrant->chips;
+        player->strategyId = entrant->strategyId;
+        snprintf(player->name, MAX_NAME_LEN, "Entrant %u", entrant->id);
+        seated[seats++] = entrant;
+    }
+    game->numPlayers = seats;
+    resetRound(game);
+
+    for (int h = 0; h < tournament->hands; h++) {
+        playRound(game);
+        for (int i = 0; i < seats; i++) {
+            int bucket = leaderboardBucket(table->players[i].ChipSum);
+            if (bucket != seated[i]->bucket) {
+                leaderboardMove(&tournament->leaderboard, seated[i]->bucket, bucket);
+                seated[i]->bucket = bucket;
+            }
+        }
+        resetRound(game);
+    }
+    for (int i = 0; i < seats; i++) {
+        seated[i]->chips = table->players[i].ChipSum;
+    }
+
+    unsigned long long took = nowMicroseconds() - started;
+    unsigned long long longest = atomic_load(&tournament->longestTable);
+    while (took > longest && !atomic_compare_exchange_weak(&tournament->longestTable, &longest, took)) {
+    }
+    atomic_fetch_add(&tournament->tablesDone, 1);
+}
+
+void* runTournamentWorker(void* argument) {
+    Tournament* tournament = argument;
+    unsigned long long seen = 0;
+    Table* table = malloc(sizeof(Table));  // Every table this thread plays is dealt into the same block
+
+    if (table == NULL) {
+        perror("Failed to allocate memory for tournament table");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&tournament->lock);
+    int self = tournament->started++;
+    for (;;) {
+        while (tournament->level == seen && !tournament->over) {
+            pthread_cond_wait(&tournament->start, &tournament->lock);
+        }
+        if (tournament->over) {
+            break;
+        }
+        seen = tournament->level;
+        pthread_mutex_unlock(&tournament->lock);
+
+        int index;
+        while ((index = tournamentTakeTable(tournament, self)) >= 0) {
+            playTournamentTable(tournament, table, index);
+        }
+
+        pthread_mutex_lock(&tournament->lock);
+        if (++tournament->idle == tournament->threads) {
+            pthread_cond_signal(&tournament->finished);
+        }
+    }
+    pthread_mutex_unlock(&tournament->lock);
+
+    free(table);
+    return NULL;
+}
+
+void tournamentSeat(Tournament* tournament) {
+    int* seating = tournament->seating;
+
+    // Fisher-Yates from the tournament seed, so every level deals new tablemates
+    for (int i = tournament->seated - 1; i > 0; i--) {
+        unsigned long long r = mixSeed(tournament->seed ^ (tournament->level << 40) ^ (unsigned long long) i);
+        int j = (int) (((r >> 32) * (unsigned long long) (i + 1)) >> 32);
+        int swap = seating[i];
+        seating[i] = seating[j];
+        seating[j] = swap;
+    }
+
+    // Table t seats every tables-th entrant from t, so no table is more than one seat short
+    tournament->tables = (tournament->seated + MAX_PLAYERS - 1) / MAX_PLAYERS;
+    for (int t = 0; t < tournament->threads; t++) {
+        unsigned long long first = (unsigned long long) tournament->tables * t / tournament->threads;
+        unsigned long long last = (unsigned long long) tournament->tables * (t + 1) / tournament->threads;
+        atomic_store(&tournament->deques[t].range, (last << 32) | first);
+    }
+}
+
+int compareCutStacks(const void* a, const void* b) {
+    const CutStack* x = a;
+    const CutStack* y = b;
+
+    if (x->chips != y->chips) {
+        return x->chips > y->chips ? -1 : 1;
+    }
+    return x->seat - y->seat;
+}
+
+int tournamentCut(Tournament* tournament) {
+    Leaderboard* leaderboard = &tournament->leaderboard;
+    int alive = 0;
+
+    for (int s = 0; s < tournament->seated; s++) {
+        if (tournament->entrants[tournament->seating[s]].chips >= 1) {
+            alive++;
+        }
+    }
+
+    // Half of those with chips go on, never fewer than a full final table
+    int keep = alive;
+    if (alive > MAX_PLAYERS) {
+        keep = (alive + 1) / 2 > MAX_PLAYERS ? (alive + 1) / 2 : MAX_PLAYERS;
+    }
+    int cut = LEADERBOARD_BUCKETS, atCut = 0;
+    if (keep > 0) {
+        cut = leaderboardStackAt(leaderboard, keep);
+        atCut = keep - (leaderboard->entrants - leaderboardCountBelow(leaderboard, cut + 1));
+    }
+
+    // The places left in the cut bucket go to its biggest stacks, equal stacks keep the shuffled seating order
+    CutStack last = {INFINITY, -1};
+    if (atCut > 0) {
+        CutStack* tied = malloc(tournament->seated * sizeof(CutStack));
+        if (tied == NULL) {
+            perror("Failed to allocate memory for tournament");
+            exit(EXIT_FAILURE);
+        }
+        int count = 0;
+        for (int s = 0; s < tournament->seated; s++) {
+            Entrant* entrant = &tournament->entrants[tournament->seating[s]];
+            if (entrant->bucket == cut) {
+                tied[count++] = (CutStack) {entrant->chips, s};
+            }
+        }
+        qsort(tied, count, sizeof(CutStack), compareCutStacks);
+        last = tied[(atCut < count ? atCut : count) - 1];
+        free(tied);
+    }
+
+    int kept = 0;
+    for (int s = 0; s < tournament->seated; s++) {
+        Entrant* entrant = &tournament->entrants[tournament->seating[s]];
+
+        if (entrant->bucket > cut || (entrant->bucket == cut &&
+            (entrant->chips > last.chips || (entrant->chips == last.chips && s <= last.seat)))) {
+            tournament->seating[kept++] = tournament->seating[s];
+        } else {
+            entrant->bustedLevel = (int) tournament->level;
+            leaderboardAdd(leaderboard, entrant->bucket, -1);
+            leaderboard->entrants--;
+        }
+    }
+    tournament->seated = kept;
+    return kept;
+}
+
+void runTournament() {
+    Tournament tournament;
+    pthread_t threads[TOURNAMENT_THREADS_MAX];
+    int entrants;
+
+    memset(&tournament, 0, sizeof(tournament));
+    tournament.threads = processorThreads(TOURNAMENT_THREADS_MAX);
+    printf("insert the number of entrants: ");
+    scanf("%d", &entrants);
+    if (entrants < 2) {
+        printf("A tournament needs at least two entrants.\n");
+        return;
+    }
+    printf("insert the number of hands every table plays in a level: ");
+    scanf("%d", &tournament.hands);
+    tournament.rules = getRuleSet();
+
+    pthread_mutex_init(&tournament.lock, NULL);
+    pthread_cond_init(&tournament.start, NULL);
+    pthread_cond_init(&tournament.finished, NULL);
+    tournament.seed = (unsigned long long) time(NULL);
+    tournament.entrants = malloc(entrants * sizeof(Entrant));
+    tournament.seating = malloc(entrants * sizeof(int));
+    tournament.leaderboard.tree = calloc(LEADERBOARD_BUCKETS + 1, sizeof(_Atomic int));
+    if (tournament.entrants == NULL || tournament.seating == NULL || tournament.leaderboard.tree == NULL) {
+        perror("Failed to allocate memory for tournament");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < entrants; i++) {
+        Entrant* entrant = &tournament.entrants[i];
+        entrant->chips = TOURNAMENT_CHIPS;
+        entrant->strategyId = STRATEGY_BASIC + i % (strategyCount - STRATEGY_BASIC);
+        entrant->bucket = leaderboardBucket(entrant->chips);
+        entrant->bustedLevel = 0;
+        entrant->id = (unsigned int) i + 1;
+        leaderboardAdd(&tournament.leaderboard, entrant->bucket, 1);
+        tournament.seating[i] = i;
+    }
+    tournament.leaderboard.entrants = entrants;
+    tournament.seated = entrants;
+
+    for (int t = 0; t < tournament.threads; t++) {
+        if (pthread_create(&threads[t], NULL, runTournamentWorker, &tournament) != 0) {
+            perror("Failed to start tournament thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("\n****** TOURNAMENT (%d entrants, %d hands a level, %s) ******\n", entrants, tournament.hands, RULES[tournament.rules].name);
+    unsigned long long began = nowMicroseconds();
+    bool finalTable = false;
+    while (tournament.seated > 0 && !finalTable) {
+        finalTable = tournament.seated <= MAX_PLAYERS;
+
+        pthread_mutex_lock(&tournament.lock);
+        tournament.level++;
+        tournamentSeat(&tournament);
+        tournament.idle = 0;
+        atomic_store(&tournament.tablesDone, 0);
+        atomic_store(&tournament.longestTable, 0);
+        pthread_cond_broadcast(&tournament.start);
+        unsigned long long levelStart = nowMicroseconds();
+
+        // The live leaderboard is read while the tables are still moving it
+        while (tournament.idle < tournament.threads) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += TOURNAMENT_REFRESH_MS / 1000;
+            deadline.tv_nsec += (long) (TOURNAMENT_REFRESH_MS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            if (pthread_cond_timedwait(&tournament.finished, &tournament.lock, &deadline) == ETIMEDOUT &&
+                tournament.idle < tournament.threads) {
+                printf("  level %llu: %d of %d tables played, chip leader %.1f, tenth %.1f\n", tournament.level,
+                       atomic_load(&tournament.tablesDone), tournament.tables,
+                       leaderboardStackAt(&tournament.leaderboard, 1) / 2.0,
+                       leaderboardStackAt(&tournament.leaderboard, tournament.seated < 10 ? tournament.seated : 10) / 2.0);
+            }
+        }
+        pthread_mutex_unlock(&tournament.lock);
+
+        int played = tournament.seated;
+        double levelMs = (nowMicroseconds() - levelStart) / 1000.0;
+        double leader = leaderboardStackAt(&tournament.leaderboard, 1) / 2.0;
+        if (finalTable) {
+            printf("Level %llu, the final table: %d entrants, %.1f ms\n", tournament.level, played, levelMs);
+            break;
+        }
+        int kept = tournamentCut(&tournament);
+        printf("Level %llu: %d entrants at %d tables, %.1f ms (slowest table %.1f ms), chip leader %.1f, %d go on\n",
+               tournament.level, played, tournament.tables, levelMs, atomic_load(&tournament.longestTable) / 1000.0, leader, kept);
+    }
+
+    pthread_mutex_lock(&tournament.lock);
+    tournament.over = true;
+    pthread_cond_broadcast(&tournament.start);
+    pthread_mutex_unlock(&tournament.lock);
+    for (int t = 0; t < tournament.threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    // At most a final table is left, the standings are its stacks
+    int* standing = tournament.seating;
+    for (int i = 1; i < tournament.seated; i++) {
+        for (int j = i; j > 0 && tournament.entrants[standing[j]].chips > tournament.entrants[standing[j - 1]].chips; j--) {
+            int swap = standing[j];
+            standing[j] = standing[j - 1];
+            standing[j - 1] = swap;
+        }
+    }
+    if (tournament.seated == 0) {
+        printf("Every entrant went broke, nobody is left to win.\n");
+    }
+    for (int i = 0; i < tournament.seated; i++) {
+        Entrant* entrant = &tournament.entrants[standing[i]];
+        printf("%d. Entrant %u (%s) with %.2f chips\n", i + 1, entrant->id, strategies[entrant->strategyId].name, entrant->chips);
+    }
+    printf("Played %llu levels in %.2f s\n", tournament.level, (nowMicroseconds() - began) / 1e6);
+    printf("*********************************************\n\n");
+
+    pthread_cond_destroy(&tournament.finished);
+    pthread_cond_destroy(&tournament.start);
+    pthread_mutex_destroy(&tournament.lock);
+    free(tournament.leaderboard.tree);
+    free(tournament.seating);
+    free(tournament.entrants);
+}
+
+Table* openTable(int playerCount) {
+    if (liveTableCount >= MAX_TABLES) {
+        printf("No room for another table\n");
+        return NULL;
+    }
+    if (playerCount > MAX_PLAYERS) {
+        printf("A table seats at most %d players\n", MAX_PLAYERS);
+        playerCount = MAX_PLAYERS;
+    }
+
+    tablePoolReserve(1);
+    Table* table = tablePool.free;
+    tablePool.free = table->next;
+
+    attachTable(table);
+    initializeBoard(&table->board);
+
+    table->game.numPlayers = playerCount;
+    table->game.quiet = false;
+    table->game.phase = PHASE_WAITING;
+    table->game.tableId = nextTableId++;
+    table->game.stake = STAKE_LOW;
+    table->game.rules = RULES_SINGLE_DECK;
+    table->game.roundNumber = 0;
+    table->seatsClaimed = playerCount;
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        initializePlayer(&table->players[i]);
+    }
+
+    table->fromSnapshot = false;
+    table->online = false;
+    table->registryIndex = liveTableCount;
+    liveTables[liveTableCount++] = table;
+    return table;
+}
+
+void attachTable(Table* table) {
+    table->game.board = &table->board;
+    table->game.players = table->players;
+    table->board.deck = &table->deck;
+    table->deck.cards = table->shoe;
+    table->next = NULL;
+    table->runner = NULL;
+    table->seatsClaimed = table->game.numPlayers;
+
+    // Deadlines do not survive a restart, the seat gets a fresh one on its next turn
+    table->game.seatTimers = table->seatTimers;
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        table->seatTimers[i].next = NULL;
+        table->seatTimers[i].prev = NULL;
+        table->seatTimers[i].expired = false;
+    }
+
+    table->game.seatLinks = table->seatLinks;
+    table->game.broadcast = NULL;
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        table->seatLinks[i].fd = -1;
+        table->seatLinks[i].channel = NULL;
+        table->seatLinks[i].gone = false;
+        table->seatLinks[i].buffered = 0;
+    }
+}
+
+void closeTable(Table* table) {
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        timerCancel(&turnTimers, &table->seatTimers[i]);
+    }
+
+    // Move the last table into the hole so the registry stays packed
+    Table* last = liveTables[--liveTableCount];
+    liveTables[table->registryIndex] = last;
+    last->registryIndex = table->registryIndex;
+
+    if (!table->fromSnapshot) {
+        table->next = tablePool.free;
+        tablePool.free = table;
+    }
+}
+
+void tablePoolReserve(int count) {
+    int available = 0;
+
+    for (Table* table = tablePool.free; table != NULL && available < count; table = table->next) {
+        available++;
+    }
+
+    // Tables come in chunks so a rush of new tables costs one allocation per TABLE_POOL_CHUNK
+    while (available < count) {
+        Table* chunk = malloc(TABLE_POOL_CHUNK * sizeof(Table));
+        if (chunk == NULL) {
+            perror("Failed to allocate memory for table");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < TABLE_POOL_CHUNK; i++) {
+            chunk[i].next = tablePool.free;
+            tablePool.free = &chunk[i];
+        }
+        tablePool.allocated += TABLE_POOL_CHUNK;
+        available += TABLE_POOL_CHUNK;
+    }
+}
+
+void lobbyInit() {
+    atomic_store(&lobby.stub.next, NULL);
+    atomic_store(&lobby.head, &lobby.stub);
+    lobby.tail = &lobby.stub;
+    atomic_store(&lobby.sleeping, false);
+    lobby.seated = 0;
+    lobby.rejected = 0;
+    lobby.tablesOpen = 0;
+    atomic_store(&admission.queued, 0);
+    admission.lagMicros = 0;
+    atomic_store(&admission.level, ADMIT_OPEN);
+    lobby.seatsHeld = 0;
+    lobby.nextSnapshot = nowMilliseconds() + LOBBY_SNAPSHOT_MS;
+
+    // Tables saved at the terminal stay there, the restored online ones are adopted by the server
+    for (int i = 0; i < STAKE_LEVELS; i++) {
+        lobby.openTables[i] = NULL;
+    }
+}
+
+// Links a ticket in as the newest one, one exchange per push whatever the number of producers
+void lobbyPush(LobbyTicket* ticket) {
+    atomic_store_explicit(&ticket->next, NULL, memory_order_relaxed);
+    LobbyTicket* previous = atomic_exchange_explicit(&lobby.head, ticket, memory_order_acq_rel);
+    atomic_store_explicit(&previous->next, ticket, memory_order_release);
+}
+
+// Unlinks the oldest ticket, NULL when the queue is empty or a push is half way through
+LobbyTicket* lobbyPop() {
+    LobbyTicket* tail = lobby.tail;
+    LobbyTicket* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &lobby.stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        lobby.tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+        lobby.tail = next;
+        return tail;
+    }
+    if (tail != atomic_load_explicit(&lobby.head, memory_order_acquire)) {
+        return NULL;
+    }
+
+    // The last ticket can only leave once the stub is behind it
+    lobbyPush(&lobby.stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+        lobby.tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+// Only the stub left with nothing behind it, a ticket the stub was pushed after still counts
+bool lobbyEmpty() {
+    LobbyTicket* tail = lobby.tail;
+
+    return tail == &lobby.stub && atomic_load_explicit(&tail->next, memory_order_acquire) == NULL &&
+           atomic_load_explicit(&lobby.head, memory_order_acquire) == tail;
+}
+
+void lobbySubmit(LobbyTicket* ticket) {
+    lobbyPush(ticket);
+
+    // Only a lobby that went to sleep costs the producer a lock
+    if (atomic_load(&lobby.sleeping)) {
+        pthread_mutex_lock(&lobby.lock);
+        pthread_cond_signal(&lobby.wakeUp);
+        pthread_mutex_unlock(&lobby.lock);
+    }
+}
+
+void lobbyJoin(LobbyTicket* ticket) {
+    ticket->kind = LOBBY_JOIN;
+    ticket->queuedAt = nowMicroseconds();
+    atomic_fetch_add_explicit(&admission.queued, 1, memory_order_relaxed);
+    atomic_store_explicit(&ticket->state, LOBBY_QUEUED, memory_order_relaxed);
+    lobbySubmit(ticket);
+}
+
+void lobbyReject(LobbyTicket* ticket, const char* reason) {
+    lobby.rejected++;
+    atomic_store_explicit(&ticket->state, LOBBY_REJECTED, memory_order_release);
+    if (lobby.reject != NULL) {
+        lobby.reject(ticket, reason);
+    }
+}
+
+void seatTicket(LobbyTicket* ticket) {
+    StakeLevel stake = ticket->stake;
+    Table* table = lobby.openTables[stake];
+    PlayerAccount* account = registryIntern(ticket->name);
+
+    // A name plays one seat at a time, or its wallet would be spent twice
+    if (account->tableId != 0 && !account->held) {
+        lobbyReject(ticket, "ERR already playing\n");
+        return;
+    }
+
+    // A player back after a restart sits down again at the table that kept the seat, whatever stake it asked for
+    if (account->held) {
+        table = findTable(account->tableId);
+        stake = table->game.stake;
+        account->held = false;
+        lobby.seatsHeld--;
+        ticket->table = table;
+    } else {
+        // A busy host keeps its CPU for the rounds already dealt, a new table would mean another thread to run
+        AdmissionLevel level = atomic_load_explicit(&admission.level, memory_order_relaxed);
+        if (level == ADMIT_SHED || (level == ADMIT_FILL && table == NULL)) {
+            metricAdd(METRIC_JOINS_SHED, 1);
+            lobbyReject(ticket, "ERR busy\n");
+            return;
+        }
+
+        // Every table at this stake is full, a new one comes out of the pool
+        if (table == NULL) {
+            table = openTable(0);
+            if (table == NULL) {
+                lobbyReject(ticket, "ERR no table free\n");
+                return;
+            }
+            table->game.stake = stake;
+            table->game.quiet = true;
+            table->online = true;
+            resetRound(&table->game);
+            lobby.openTables[stake] = table;
+            lobby.tablesOpen++;
+        }
+
+        ticket->table = table;
+        ticket->seat = table->seatsClaimed++;
+        if (table->seatsClaimed == MAX_PLAYERS) {
+            lobby.openTables[stake] = table->next;
+            table->next = NULL;
+        }
+    }
+    lobby.seated++;
+
+    // A returning player brings the wallet back, one who went broke buys in again
+    if (account->sessionId != 0 && account->balance >= STAKE_MIN_BET[stake]) {
+        ticket->chips = account->balance;
+    }
+    account->tableId = table->game.tableId;
+    account->sessionId = ++registry.nextSession;
+    ticket->playerId = account->id;
+
+    // An online table is busy with its round, its own thread fills the seat in before the next one
+    if (lobby.handOff != NULL) {
+        atomic_store_explicit(&ticket->state, LOBBY_SEATED, memory_order_release);
+        lobby.handOff(ticket);
+        return;
+    }
+
+    Player* player = &table->players[ticket->seat];
+    initializePlayer(player);
+    snprintf(player->name, MAX_NAME_LEN, "%s", ticket->name);
+    player->ChipSum = ticket->chips;
+    player->showOdds = ticket->odds;
+    player->playerId = ticket->playerId;
+    table->game.numPlayers = table->seatsClaimed;
+    atomic_store_explicit(&ticket->state, LOBBY_SEATED, memory_order_release);
+}
+
+Table* findTable(unsigned int tableId) {
+    for (int i = 0; i < liveTableCount; i++) {
+        if (liveTables[i]->game.tableId == tableId) {
+            return liveTables[i];
+        }
+    }
+    return NULL;
+}
+
+unsigned int registryNameHash(const char* name) {
+    unsigned int hash = 2166136261u;  // FNV-1a
+
+    while (*name != '\0') {
+        hash = (hash ^ (unsigned char) *name++) * 16777619u;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+unsigned int registryIdSlot(unsigned int id) {
+    return (unsigned int) ((id * 0x9E3779B97F4A7C15ULL) >> 32) & registry.slotMask;  // Fibonacci hashing spreads sequential ids
+}
+
+void registryLink(unsigned int index) {
+    PlayerAccount* account = &registry.accounts[index];
+    unsigned int slot = registryIdSlot(account->id);
+
+    while (registry.byId[slot].key != 0) {
+        slot = (slot + 1) & registry.slotMask;
+    }
+    registry.byId[slot] = (RegistrySlot) {account->id, index};
+
+    unsigned int hash = registryNameHash(registry.names + account->name);
+    slot = hash & registry.slotMask;
+    while (registry.byName[slot].key != 0) {
+        slot = (slot + 1) & registry.slotMask;
+    }
+    registry.byName[slot] = (RegistrySlot) {hash, index};
+}
+
+void registryGrow() {
+    unsigned int slots = registry.slotMask ? (registry.slotMask + 1) * 2 : REGISTRY_SLOTS;
+    RegistrySlot* byId = calloc(slots, sizeof(RegistrySlot));
+    RegistrySlot* byName = calloc(slots, sizeof(RegistrySlot));
+    PlayerAccount* accounts = realloc(registry.accounts, slots / 2 * sizeof(PlayerAccount));
+
+    if (byId == NULL || byName == NULL || accounts == NULL) {
+        perror("Failed to allocate memory for player registry");
+        exit(EXIT_FAILURE);
+    }
+    free(registry.byId);
+    free(registry.byName);
+    registry.byId = byId;
+    registry.byName = byName;
+    registry.accounts = accounts;
+    registry.capacity = slots / 2;
+    registry.slotMask = slots - 1;
+
+    // Both tables are rebuilt from the dense array, nothing but the slots moves
+    for (unsigned int i = 0; i < registry.count; i++) {
+        registryLink(i);
+    }
+}
+
+PlayerAccount* registryFind(unsigned int id) {
+    if (registry.count == 0 || id == 0) {
+        return NULL;
+    }
+    for (unsigned int slot = registryIdSlot(id); registry.byId[slot].key != 0; slot = (slot + 1) & registry.slotMask) {
+        if (registry.byId[slot].key == id) {
+            return &registry.accounts[registry.byId[slot].index];
+        }
+    }
+    return NULL;
+}
+
+PlayerAccount* registryFindName(const char* name) {
+    if (registry.count == 0) {
+        return NULL;
+    }
+    unsigned int hash = registryNameHash(name);
+    for (unsigned int slot = hash & registry.slotMask; registry.byName[slot].key != 0; slot = (slot + 1) & registry.slotMask) {
+        if (registry.byName[slot].key == hash) {
+            PlayerAccount* account = &registry.accounts[registry.byName[slot].index];
+            if (strcmp(registry.names + account->name, name) == 0) {
+                return account;
+            }
+        }
+    }
+    return NULL;
+}
+
+PlayerAccount* registryIntern(const char* name) {
+    PlayerAccount* account = registryFindName(name);
+    if (account != NULL) {
+        return account;
+    }
+
+    // The log has the name before any chips of the account, so replay can give the wallet back
+    account = registryAdd(registry.nextId + 1, name);
+    walAppendAccount(account);
+    return account;
+}
+
+PlayerAccount* registryAdd(unsigned int id, const char* name) {
+    PlayerAccount* account;
+
+    if (registry.count == registry.capacity) {
+        registryGrow();
+    }
+    size_t length = strnlen(name, MAX_NAME_LEN - 1);
+    if (registry.namesLength + length + 1 > registry.namesCapacity) {
+        registry.namesCapacity = registry.namesCapacity ? registry.namesCapacity * 2 : 16 * REGISTRY_SLOTS;
+        registry.names = realloc(registry.names, registry.namesCapacity);
+        if (registry.names == NULL) {
+            perror("Failed to allocate memory for player names");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    unsigned int index = registry.count++;
+    account = &registry.accounts[index];
+    memset(account, 0, sizeof(PlayerAccount));
+    account->id = id;
+    if (id > registry.nextId) {
+        registry.nextId = id;
+    }
+    account->name = (unsigned int) registry.namesLength;
+    memcpy(registry.names + registry.namesLength, name, length);
+    registry.names[registry.namesLength + length] = '\0';
+    registry.namesLength += length + 1;
+    registryLink(index);
+    return account;
+}
+
+const char* registryName(const PlayerAccount* account) {
+    return registry.names + account->name;
+}
+
+void releaseSeat(Table* table) {
+    StakeLevel stake = table->game.stake;
+
+    // A full table is back in the running for new players
+    if (table->seatsClaimed-- == MAX_PLAYERS) {
+        table->next = lobby.openTables[stake];
+        lobby.openTables[stake] = table;
+    }
+    if (table->seatsClaimed > 0) {
+        return;
+    }
+
+    // Nobody is left or on the way, so the table is not offered any more and its thread can stop
+    Table** link = &lobby.openTables[stake];
+    while (*link != NULL && *link != table) {
+        link = &(*link)->next;
+    }
+    if (*link == table) {
+        *link = table->next;
+    }
+    table->next = NULL;
+    if (lobby.retire != NULL) {
+        lobby.retire(table);
+    }
+}
+
+void lobbyReleaseHolds() {
+    for (unsigned int i = 0; i < registry.count && lobby.seatsHeld > 0; i++) {
+        PlayerAccount* account = &registry.accounts[i];
+        if (!account->held) {
+            continue;
+        }
+        // The chips of the seat are already in the wallet, only the seat goes
+        account->held = false;
+        lobby.seatsHeld--;
+        releaseSeat(findTable(account->tableId));
+        account->tableId = 0;
+    }
+}
+
+int lobbyDrain(int max) {
+    PlayerAccount* account;
+    int taken = 0;
+
+    while (taken < max) {
+        LobbyTicket* ticket = lobbyPop();
+        if (ticket == NULL) {
+            break;
+        }
+
+        // Only joins come from connections, leaves and closes are handed in by table threads
+        switch (ticket->kind) {
+            case LOBBY_JOIN:
+                atomic_fetch_sub_explicit(&admission.queued, 1, memory_order_relaxed);
+                admissionSample(nowMicroseconds() - ticket->queuedAt);
+                seatTicket(ticket);
+                break;
+            case LOBBY_LEAVE:
+                account = registryFind(ticket->playerId);
+                if (account != NULL) {
+                    account->balance = ticket->chips;
+                    account->tableId = 0;
+                }
+                releaseSeat(ticket->table);
+                free(ticket);
+                break;
+            case LOBBY_CLOSED:
+                free(ticket->runner);
+                closeTable(ticket->table);
+                lobby.tablesOpen--;
+                free(ticket);
+                break;
+            case LOBBY_WATCH:
+                ticket->table = findTable(ticket->tableId);
+                lobby.handOff(ticket);
+                break;
+        }
+        taken++;
+    }
+    return taken;
+}
+
+bool lobbyWait(int timeoutMs) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    // The flag goes up before the queue is checked again, so a push either is seen here or signals
+    pthread_mutex_lock(&lobby.lock);
+    atomic_store(&lobby.sleeping, true);
+    bool empty = lobbyEmpty();
+    if (empty) {
+        pthread_cond_timedwait(&lobby.wakeUp, &lobby.lock, &deadline);
+        empty = lobbyEmpty();
+    }
+    atomic_store(&lobby.sleeping, false);
+    pthread_mutex_unlock(&lobby.lock);
+    return !empty;
+}
+
+void admissionSample(unsigned long long lagMicros) {
+    // An average over the last eight or so samples, one slow wake-up does not close the doors
+    long long change = ((long long) lagMicros - (long long) admission.lagMicros) / 8;
+    admission.lagMicros += change;
+
+    AdmissionLevel level = ADMIT_OPEN;
+    if (admission.lagMicros > ADMISSION_HARD_US) {
+        level = ADMIT_SHED;
+    } else if (admission.lagMicros > ADMISSION_SOFT_US) {
+        level = ADMIT_FILL;
+    }
+    atomic_store_explicit(&admission.level, level, memory_order_relaxed);
+}
+
+bool admissionBusy() {
+    return atomic_load_explicit(&admission.level, memory_order_relaxed) == ADMIT_SHED ||
+           atomic_load_explicit(&admission.queued, memory_order_relaxed) >= ADMISSION_QUEUE;
+}
+
+void lowerThreadPriority() {
+#ifdef __linux__
+    // Linux gives every thread its own nice value and new threads inherit it,
+    // so only threads that never start a table may lower theirs
+    setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), ADMISSION_NICE);
+#endif
+}
+
+bool writeAllBytes(int fd, const void* data, size_t length) {
+    const char* bytes = data;
+
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        length -= (size_t) written;
+    }
+    return true;
+}
+
+bool writeSnapshot(const char* path, const char* tempPath, unsigned long long walLsn, unsigned int walSegment) {
+    // Only plain system calls from here on, a forked writer may not touch stdio or the heap
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.tableSize = sizeof(Table);
+    header.tableCount = liveTableCount;
+    header.walSegment = walSegment;
+    header.walLsn = walLsn;
+    header.takenAt = (long long) time(NULL);
+    header.accountCount = registry.count;
+    header.registryNextId = registry.nextId;
+    header.registryNextSession = registry.nextSession;
+    header.namesLength = registry.namesLength;
+
+    bool ok = writeAllBytes(fd, &header, sizeof(header));
+    for (int i = 0; i < liveTableCount && ok; i++) {
+        ok = writeAllBytes(fd, liveTables[i], sizeof(Table));
+    }
+    // The wallets of online players ride along, the log only has what changed since
+    ok = ok && writeAllBytes(fd, registry.accounts, (size_t) registry.count * sizeof(PlayerAccount));
+    ok = ok && writeAllBytes(fd, registry.names, registry.namesLength);
+    ok = ok && syncFile(fd) == 0;
+    ok = close(fd) == 0 && ok;
+
+    // The rename only happens once the whole file is on disk, so a crash keeps the old snapshot
+    if (!ok || rename(tempPath, path) != 0) {
+        unlink(tempPath);
+        return false;
+    }
+    return true;
+}
+
+#ifndef _WIN32
+pid_t snapshotWriter = 0;
+unsigned int snapshotWriterSegment = 0;
+
+// Reaps a finished background writer, returns false while it is still writing
+bool reapSnapshotWriter(bool wait) {
+    int status;
+
+    if (snapshotWriter <= 0) {
+        return true;
+    }
+    if (waitpid(snapshotWriter, &status, wait ? 0 : WNOHANG) == 0) {
+        return false;
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+        walDropSegmentsBefore(snapshotWriterSegment);
+    } else {
+        printf("Failed to write snapshot in the background\n");
+    }
+    snapshotWriter = 0;
+    return true;
+}
+#endif
+
+void snapshotTablesInBackground(const char* path) {
+#ifdef _WIN32
+    saveTables(path);
+#else
+    unsigned long long walLsn;
+    unsigned int walSegment;
+    char tempPath[256];
+
+    // Only one writer at a time, a snapshot still on its way is not interrupted
+    if (!reapSnapshotWriter(false)) {
+        return;
+    }
+
+    walMarkSnapshot(&walLsn, &walSegment);
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The child sees the tables frozen at the moment of the fork, but also every lock
+        // another thread held then, so it only writes and leaves
+        _exit(writeSnapshot(path, tempPath, walLsn, walSegment) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (pid < 0) {
+        if (writeSnapshot(path, tempPath, walLsn, walSegment)) {
+            walDropSegmentsBefore(walSegment);
+        } else {
+            perror("Failed to write snapshot");
+        }
+        return;
+    }
+    snapshotWriter = pid;
+    snapshotWriterSegment = walSegment;
+#endif
+}
+
+void saveTables(const char* path) {
+    unsigned long long walLsn;
+    unsigned int walSegment;
+    char tempPath[256];
+
+#ifndef _WIN32
+    reapSnapshotWriter(true);
+#endif
+    walMarkSnapshot(&walLsn, &walSegment);
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+    if (writeSnapshot(path, tempPath, walLsn, walSegment)) {
+        walDropSegmentsBefore(walSegment);
+    } else {
+        perror("Failed to write snapshot");
+    }
+}
+
+int restoreSnapshot(const char* path, unsigned long long* walLsn, unsigned int* walSegment) {
+    *walLsn = 0;
+    *walSegment = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(SnapshotHeader)) {
+        close(fd);
+        return 0;
+    }
+
+#ifdef _WIN32
+    char* data = malloc(info.st_size);
+    if (data == NULL || read(fd, data, info.st_size) != info.st_size) {
+        free(data);
+        close(fd);
+        return 0;
+    }
+#else
+    // A private mapping lets the restored tables change without touching the file
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;  // Read the file in one go instead of faulting it in table by table
+#endif
+    char* data = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+#endif
+    close(fd);
+
+    SnapshotHeader* header = (SnapshotHeader*) data;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header->version != SNAPSHOT_VERSION ||
+        header->tableSize != sizeof(Table) ||
+        info.st_size != (off_t) (sizeof(SnapshotHeader) + (size_t) header->tableCount * sizeof(Table) +
+                                 (size_t) header->accountCount * sizeof(PlayerAccount) + header->namesLength)) {
+        printf("Snapshot %s does not match this version of the game\n", path);
+#ifdef _WIN32
+        free(data);
+#else
+        munmap(data, info.st_size);
+#endif
+        return 0;
+    }
+
+    Table* tables = (Table*) (data + sizeof(SnapshotHeader));
+    int restored = 0;
+    for (unsigned int i = 0; i < header->tableCount && liveTableCount < MAX_TABLES; i++) {
+        Table* table = &tables[i];
+        attachTable(table);
+        table->fromSnapshot = true;
+        table->registryIndex = liveTableCount;
+        liveTables[liveTableCount++] = table;
+        if (table->game.tableId >= nextTableId) {
+            nextTableId = table->game.tableId + 1;
+        }
+        restored++;
+    }
+
+    // Nobody sits at an online table before the server runs again, every wallet is back with its player
+    PlayerAccount* accounts = (PlayerAccount*) (data + sizeof(SnapshotHeader) + (size_t) header->tableCount * sizeof(Table));
+    const char* names = (const char*) (accounts + header->accountCount);
+    for (unsigned int i = 0; i < header->accountCount; i++) {
+        if (accounts[i].name >= header->namesLength) {
+            continue;
+        }
+        PlayerAccount* account = registryAdd(accounts[i].id, names + accounts[i].name);
+        account->balance = accounts[i].balance;
+        account->sessionId = accounts[i].sessionId;
+    }
+    if (header->registryNextId > registry.nextId) {
+        registry.nextId = header->registryNextId;
+    }
+    registry.nextSession = header->registryNextSession;
+
+    *walLsn = header->walLsn;
+    *walSegment = header->walSegment;
+
+    // The mapping stays for the life of the process, the tables live inside it
+    return restored;
+}
+
+void recoverTables() {
+    unsigned long long walLsn;
+    unsigned int walSegment;
+
+    int restored = restoreSnapshot(SNAPSHOT_PATH, &walLsn, &walSegment);
+    unsigned int nextSegment = replayWal(walLsn, walSegment);
+    walOpen(nextSegment);
+
+    if (restored > 0) {
+        printf("Restored %d saved table(s)\n", restored);
+    }
+}
+
+Table* pickSavedTable() {
+    int choice;
+    int count = 0;
+
+    // Online tables wait for the server to start again, only the terminal ones are offered
+    for (int i = 0; i < liveTableCount; i++) {
+        Game* game = &liveTables[i]->game;
+        if (liveTables[i]->online) {
+            continue;
+        }
+        printf("%d. Table %u, %d seat(s), %s, round %llu\n", ++count, game->tableId, game->numPlayers,
+               RULES[game->rules].name, game->roundNumber);
+    }
+    if (count == 0) {
+        return NULL;
+    }
+    printf("choose the table to resume: ");
+    scanf("%d", &choice);
+
+    while (choice < 1 || choice > count) {
+        printf("Pick a table from 1 to %d, try again: ", count);
+        scanf("%d", &choice);
+    }
+
+    for (int i = 0; i < liveTableCount; i++) {
+        if (!liveTables[i]->online && --choice == 0) {
+            return liveTables[i];
+        }
+    }
+    return NULL;
+}
+
+int syncFile(int fd) {
+#if defined(_WIN32)
+    return _commit(fd);
+#elif defined(__APPLE__)
+    return fsync(fd);
+#else
+    return fdatasync(fd);  // The log only appends, the file size is the only metadata that matters
+#endif
+}
+
+unsigned int walChecksum(const WalRecord* record) {
+    // FNV-1a over everything in front of the checksum
+    const unsigned char* bytes = (const unsigned char*) record;
+    unsigned int hash = 2166136261u;
+
+    for (size_t i = 0; i < offsetof(WalRecord, checksum); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+int walOpenSegment(unsigned int segment) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s.%u", WAL_PATH, segment);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        perror("Failed to open chips log");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+bool walWriteAll(int fd, const WalRecord* records, int count) {
+    const char* data = (const char*) records;
+    size_t left = (size_t) count * sizeof(WalRecord);
+
+    while (left > 0) {
+        ssize_t written = write(fd, data, left);
+        if (written < 0) {
+            return false;
+        }
+        data += written;
+        left -= written;
+    }
+    return true;
+}
+
+void* walFlusher(void* unused) {
+    int capacity = 0;
+    WalRecord* batch = NULL;
+
+    pthread_mutex_lock(&wal.lock);
+    while (wal.running || wal.pendingCount > 0) {
+        while (wal.running && wal.pendingCount == 0 && !wal.rotatePending) {
+            pthread_cond_wait(&wal.hasWork, &wal.lock);
+        }
+
+        // Take every record appended so far, all of them share the next fsync
+        int count = wal.pendingCount;
+        WalRecord* swap = batch;
+        batch = wal.pending;
+        wal.pending = swap;
+        int swapCapacity = capacity;
+        capacity = wal.pendingCapacity;
+        wal.pendingCapacity = swapCapacity;
+        wal.pendingCount = 0;
+
+        bool rotate = wal.rotatePending;
+        unsigned long long rotateAfter = wal.rotateAfterLsn;
+        wal.rotatePending = false;
+        pthread_mutex_unlock(&wal.lock);
+
+        // Records up to the snapshot point close the old segment, the rest open the new one
+        int before = count;
+        if (rotate) {
+            before = 0;
+            while (before < count && batch[before].lsn <= rotateAfter) {
+                before++;
+            }
+        }
+
+        bool ok = walWriteAll(wal.fd, batch, before) && syncFile(wal.fd) == 0;
+        if (rotate) {
+            close(wal.fd);
+            wal.fd = walOpenSegment(wal.segment + 1);
+            ok = ok && walWriteAll(wal.fd, batch + before, count - before) && syncFile(wal.fd) == 0;
+        }
+        if (!ok) {
+            // A balance that cannot be made durable must never be acknowledged
+            perror("Failed to write chips log");
+            exit(EXIT_FAILURE);
+        }
+
+        pthread_mutex_lock(&wal.lock);
+        if (rotate) {
+            wal.segment++;
+        }
+        if (count > 0) {
+            wal.durableLsn = batch[count - 1].lsn;
+        }
+        pthread_cond_broadcast(&wal.flushed);
+    }
+    pthread_mutex_unlock(&wal.lock);
+
+    free(batch);
+    return unused;
+}
+
+void walOpen(unsigned int segment) {
+    wal.fd = walOpenSegment(segment);
+    wal.segment = segment;
+    wal.durableLsn = wal.lastLsn;
+    wal.running = true;
+
+    if (pthread_create(&wal.flusher, NULL, walFlusher, NULL) != 0) {
+        perror("Failed to start chips log flusher");
+        exit(EXIT_FAILURE);
+    }
+}
+
+WalRecord* walNewRecord() {
+    if (wal.pendingCount == wal.pendingCapacity) {
+        wal.pendingCapacity = wal.pendingCapacity ? wal.pendingCapacity * 2 : 1024;
+        wal.pending = realloc(wal.pending, wal.pendingCapacity * sizeof(WalRecord));
+        if (wal.pending == NULL) {
+            perror("Failed to allocate memory for chips log");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    WalRecord* record = &wal.pending[wal.pendingCount++];
+    memset(record, 0, sizeof(WalRecord));
+    record->lsn = ++wal.lastLsn;
+    return record;
+}
+
+void walAppendAccount(const PlayerAccount* account) {
+    const char* name = registryName(account);
+    size_t length = strlen(name) + 1;
+
+    if (!wal.running) {
+        return;
+    }
+
+    // The pieces go in under one lock, so no snapshot mark can fall between them
+    pthread_mutex_lock(&wal.lock);
+    for (size_t offset = 0; offset < length; offset += WAL_NAME_PIECE) {
+        WalRecord* record = walNewRecord();
+        record->seat = (unsigned char) (offset / WAL_NAME_PIECE);
+        record->kind = WAL_ACCOUNT;
+        record->playerId = account->id;
+        memcpy(record->name, name + offset, length - offset < WAL_NAME_PIECE ? length - offset : WAL_NAME_PIECE);
+        record->checksum = walChecksum(record);
+    }
+    pthread_cond_signal(&wal.hasWork);
+    pthread_mutex_unlock(&wal.lock);
+}
+
+unsigned long long walAppend(Game* game, Player* player, WalKind kind, double delta) {
+    // Simulated games are not real money and are never logged
+    if (game->tableId == 0 || !wal.running) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&wal.lock);
+    WalRecord* record = walNewRecord();
+    record->tableId = game->tableId;
+    record->seat = player != NULL ? (unsigned char) (player - game->players) : WAL_NO_SEAT;
+    record->kind = kind;
+    record->delta = delta;
+    record->balance = player != NULL ? player->ChipSum : 0;
+    record->playerId = player != NULL ? player->playerId : 0;
+    record->checksum = walChecksum(record);
+
+    unsigned long long lsn = record->lsn;
+    pthread_cond_signal(&wal.hasWork);
+    pthread_mutex_unlock(&wal.lock);
+    return lsn;
+}
+
+void walWaitDurable(unsigned long long lsn) {
+    if (lsn == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&wal.lock);
+    while (wal.durableLsn < lsn) {
+        pthread_cond_wait(&wal.flushed, &wal.lock);
+    }
+    pthread_mutex_unlock(&wal.lock);
+}
+
+bool walIsDurable(unsigned long long lsn) {
+    pthread_mutex_lock(&wal.lock);
+    bool durable = wal.durableLsn >= lsn;
+    pthread_mutex_unlock(&wal.lock);
+    return durable;
+}
+
+void walMarkSnapshot(unsigned long long* lsn, unsigned int* segment) {
+    pthread_mutex_lock(&wal.lock);
+    // A rotation still waiting for the flusher would be merged into this one
+    while (wal.rotatePending) {
+        pthread_cond_wait(&wal.flushed, &wal.lock);
+    }
+    *lsn = wal.lastLsn;
+    *segment = wal.segment + 1;
+    if (wal.running) {
+        wal.rotateAfterLsn = wal.lastLsn;
+        wal.rotatePending = true;
+        pthread_cond_signal(&wal.hasWork);
+    }
+    pthread_mutex_unlock(&wal.lock);
+}
+
+// Sets the chips an account had after a logged change, on its wallet and on the seat it holds at the table
+void replayChips(Table* table, unsigned int seat, unsigned int playerId, double chips) {
+    if (playerId == 0) {
+        if (table != NULL) {
+            table->players[seat].ChipSum = chips;
+        }
+        return;
+    }
+
+    PlayerAccount* account = registryFind(playerId);
+    if (account != NULL) {
+        account->balance = chips;
+        if (account->sessionId == 0) {
+            account->sessionId = ++registry.nextSession;  // The wallet is handed back to the next join under this name
+        }
+    }
+    // Online seats move when players leave, the one holding the account is looked up instead of trusted by index
+    for (int i = 0; table != NULL && i < table->game.numPlayers; i++) {
+        if (table->players[i].playerId == playerId) {
+            table->players[i].ChipSum = chips;
+        }
+    }
+}
+
+unsigned int replayWal(unsigned long long afterLsn, unsigned int segment) {
+    // Look tables up by id once instead of scanning the registry for every record
+    Table** byId = calloc(nextTableId, sizeof(Table*));
+    if (byId == NULL) {
+        perror("Failed to allocate memory for log replay");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < liveTableCount; i++) {
+        byId[liveTables[i]->game.tableId] = liveTables[i];
+    }
+
+    // Snapshots are taken between rounds, so every round replay sees open is opened in the log.
+    // Online tables may have opened after the snapshot, their rounds are followed for the wallets
+    unsigned int roundCount = nextTableId;
+    WalRound* rounds = calloc(roundCount, sizeof(WalRound));
+    if (rounds == NULL) {
+        perror("Failed to allocate memory for log replay");
+        exit(EXIT_FAILURE);
+    }
+    // The lobby snapshots online tables in the middle of their rounds, the log may not have their start any more
+    for (int i = 0; i < liveTableCount; i++) {
+        Game* game = &liveTables[i]->game;
+        if (game->phase == PHASE_WAITING) {
+            continue;
+        }
+        WalRound* round = &rounds[game->tableId];
+        round->open = true;
+        for (int seat = 0; seat < game->numPlayers; seat++) {
+            round->changed[seat] = true;
+            round->before[seat] = game->roundStartChips[seat];
+            round->players[seat] = game->players[seat].playerId;
+        }
+    }
+    char name[(MAX_NAME_LEN + WAL_NAME_PIECE - 1) / WAL_NAME_PIECE * WAL_NAME_PIECE];
+    unsigned int lastTableId = 0;
+    // Last change of every account, a player that went on at another table must not get an older round back
+    WalLastChange* lastChange = NULL;
+    unsigned int lastChangeCount = 0;
+
+    wal.lastLsn = afterLsn;
+    for (;; segment++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s.%u", WAL_PATH, segment);
+
+        FILE* file = fopen(path, "rb");
+        if (file == NULL) {
+            break;
+        }
+
+        WalRecord record;
+        while (fread(&record, sizeof(record), 1, file) == 1) {
+            // A torn record can only be the tail of the last write before a crash
+            if (record.checksum != walChecksum(&record)) {
+                break;
+            }
+            if (record.lsn <= afterLsn) {
+                continue;
+            }
+            wal.lastLsn = record.lsn;
+
+            // The pieces of a name are logged back to back, the account opens with the last one
+            if (record.kind == WAL_ACCOUNT) {
+                size_t offset = (size_t) record.seat * WAL_NAME_PIECE;
+                if (offset + WAL_NAME_PIECE > sizeof(name)) {
+                    continue;
+                }
+                memcpy(name + offset, record.name, WAL_NAME_PIECE);
+                if (memchr(record.name, '\0', WAL_NAME_PIECE) != NULL && registryFind(record.playerId) == NULL) {
+                    registryAdd(record.playerId, name);
+                }
+                continue;
+            }
+
+            Table* table = record.tableId < nextTableId ? byId[record.tableId] : NULL;
+            if (record.tableId > lastTableId) {
+                lastTableId = record.tableId;
+            }
+            // A terminal table that opened after the snapshot has no seats to apply its changes to
+            if (table == NULL && record.playerId == 0 && record.seat != WAL_NO_SEAT) {
+                continue;
+            }
+            if (record.tableId >= roundCount) {
+                unsigned int grown = roundCount * 2 > record.tableId ? roundCount * 2 : record.tableId + 1;
+                rounds = realloc(rounds, grown * sizeof(WalRound));
+                if (rounds == NULL) {
+                    perror("Failed to allocate memory for log replay");
+                    exit(EXIT_FAILURE);
+                }
+                memset(rounds + roundCount, 0, (grown - roundCount) * sizeof(WalRound));
+                roundCount = grown;
+            }
+
+            WalRound* round = &rounds[record.tableId];
+            if (record.kind == WAL_ROUND_OPEN) {
+                memset(round, 0, sizeof(WalRound));
+                round->open = true;
+            } else if (record.kind == WAL_ROUND_SETTLED) {
+                round->open = false;
+            } else if (record.seat < MAX_PLAYERS) {
+                if (round->open && !round->changed[record.seat]) {
+                    round->changed[record.seat] = true;
+                    round->before[record.seat] = record.balance - record.delta;
+                    round->players[record.seat] = record.playerId;
+                }
+                round->lsn[record.seat] = record.lsn;
+                PlayerAccount* account = registryFind(record.playerId);
+                if (account != NULL) {
+                    unsigned int index = (unsigned int) (account - registry.accounts);
+                    if (index >= lastChangeCount) {
+                        unsigned int grown = registry.capacity;
+                        lastChange = realloc(lastChange, grown * sizeof(WalLastChange));
+                        if (lastChange == NULL) {
+                            perror("Failed to allocate memory for log replay");
+                            exit(EXIT_FAILURE);
+                        }
+                        memset(lastChange + lastChangeCount, 0, (grown - lastChangeCount) * sizeof(WalLastChange));
+                        lastChangeCount = grown;
+                    }
+                    lastChange[index].lsn = record.lsn;
+                    lastChange[index].tableId = record.tableId;
+                }
+                replayChips(table, record.seat, record.playerId, record.balance);
+            }
+        }
+        fclose(file);
+    }
+
+    // The cards of a round cut short by a crash are gone, so its bets go back to the seats and wallets
+    int refunded = 0;
+    for (unsigned int id = 0; id < roundCount; id++) {
+        WalRound* round = &rounds[id];
+        if (!round->open) {
+            continue;
+        }
+        Table* table = id < nextTableId ? byId[id] : NULL;
+        bool paid = false;
+        for (int seat = 0; seat < MAX_PLAYERS; seat++) {
+            if (!round->changed[seat]) {
+                continue;
+            }
+            PlayerAccount* account = registryFind(round->players[seat]);
+            unsigned int index = account != NULL ? (unsigned int) (account - registry.accounts) : 0;
+            if (account != NULL && (index < lastChangeCount ? lastChange[index].lsn : 0) != round->lsn[seat]) {
+                continue;
+            }
+            replayChips(table, seat, round->players[seat], round->before[seat]);
+            paid = true;
+        }
+        refunded += paid;
+    }
+    if (refunded > 0) {
+        printf("Paid back the bets of %d round(s) a crash left unsettled\n", refunded);
+    }
+
+    // A player who went on at another table after the snapshot no longer has the seat it had in there
+    for (int i = 0; i < liveTableCount; i++) {
+        Table* table = liveTables[i];
+        for (int seat = 0; seat < table->game.numPlayers; seat++) {
+            PlayerAccount* account = registryFind(table->players[seat].playerId);
+            unsigned int index = account != NULL ? (unsigned int) (account - registry.accounts) : 0;
+            if (account != NULL && index < lastChangeCount && lastChange[index].tableId != 0 &&
+                lastChange[index].tableId != table->game.tableId) {
+                table->players[seat].playerId = 0;
+            }
+        }
+    }
+
+    // Ids the log already used stay taken, a later replay must not mix two tables up
+    if (lastTableId >= nextTableId) {
+        nextTableId = lastTableId + 1;
+    }
+
+    free(lastChange);
+    free(rounds);
+    free(byId);
+    return segment;
+}
+
+void walDropSegmentsBefore(unsigned int segment) {
+    // Older segments were dropped by earlier snapshots, so stop at the first one missing
+    while (segment-- > 0) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s.%u", WAL_PATH, segment);
+        if (remove(path) != 0) {
+            break;
+        }
+    }
+}
+
+unsigned long long nowMilliseconds() {
+#ifdef _WIN32
+    return (unsigned long long) clock() * 1000 / CLOCKS_PER_SEC;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
+
+int processorThreads(int most) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    long online = most;
+#endif
+    return online < 1 ? 1 : online > most ? most : (int) online;
+}
+
+void timerWheelInit(TimerWheel* wheel) {
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            Timer* head = &wheel->slots[level][slot];
+            head->next = head;
+            head->prev = head;
+        }
+    }
+    wheel->now = 0;
+    wheel->startMs = nowMilliseconds();
+    wheel->armedCount = 0;
+}
+
+// Puts an armed timer in the slot its expiry falls in, the further away the higher the level
+void timerWheelInsert(TimerWheel* wheel, Timer* timer) {
+    unsigned long long ticks = timer->expiresAt - wheel->now;
+    int level = 0;
+
+    while (level < TIMER_WHEEL_LEVELS - 1 && ticks >= (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    unsigned long long maxTicks = 1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+    if (ticks >= maxTicks) {
+        timer->expiresAt = wheel->now + maxTicks - 1;  // Past the wheel's reach, fire at the far edge
+    }
+
+    int slot = (int) ((timer->expiresAt >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+    Timer* head = &wheel->slots[level][slot];
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void timerArm(TimerWheel* wheel, Timer* timer, int delayMs) {
+    unsigned long long ticks = (delayMs + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+
+    timerCancel(wheel, timer);
+    timer->expiresAt = wheel->now + (ticks > 0 ? ticks : 1);
+    timer->expired = false;
+    timerWheelInsert(wheel, timer);
+    wheel->armedCount++;
+}
+
+void timerCancel(TimerWheel* wheel, Timer* timer) {
+    if (timer->next == NULL) {
+        return;
+    }
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+    wheel->armedCount--;
+}
+
+void timerWheelAdvance(TimerWheel* wheel, unsigned long long nowMs) {
+    unsigned long long target = (nowMs - wheel->startMs) / TIMER_TICK_MS;
+
+    // With nothing armed there is nothing to fire on the way
+    if (wheel->armedCount == 0 && target > wheel->now) {
+        wheel->now = target;
+        return;
+    }
+
+    while (wheel->now < target) {
+        wheel->now++;
+
+        // When a level wraps, the next level's slot for this tick is spread over the levels below
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            if ((wheel->now & ((1ULL << (TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            int slot = (int) ((wheel->now >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+            Timer* head = &wheel->slots[level][slot];
+            while (head->next != head) {
+                Timer* timer = head->next;
+                head->next = timer->next;
+                timer->next->prev = head;
+                timerWheelInsert(wheel, timer);
+            }
+        }
+
+        Timer* head = &wheel->slots[0][wheel->now & (TIMER_WHEEL_SLOTS - 1)];
+        while (head->next != head) {
+            Timer* timer = head->next;
+            timerCancel(wheel, timer);
+            timer->expired = true;
+            if (timer->onExpire != NULL) {
+                timer->onExpire(timer);
+            }
+        }
+    }
+}
+
+int timerWheelNextTimeout(TimerWheel* wheel) {
+    if (wheel->armedCount == 0) {
+        return -1;
+    }
+
+    // The first busy slot of the lowest level, or the next cascade when that level is empty
+    int slot = (int) (wheel->now & (TIMER_WHEEL_SLOTS - 1));
+    int ticks = 1;
+    for (; ticks < TIMER_WHEEL_SLOTS - slot; ticks++) {
+        Timer* head = &wheel->slots[0][slot + ticks];
+        if (head->next != head) {
+            break;
+        }
+    }
+
+    long long waitMs = (long long) (wheel->now + ticks) * TIMER_TICK_MS - (long long) (nowMilliseconds() - wheel->startMs);
+    return waitMs > 0 ? (int) waitMs : 0;
+}
+
+Timer* armSeatTimer(Game* game, int seat, int delayMs) {
+    if (game->seatTimers == NULL) {
+        return NULL;
+    }
+
+    Timer* timer = &game->seatTimers[seat];
+    timer->owner = game;
+    timer->seat = seat;
+    timer->onExpire = NULL;  // The waiting prompt sees the expired flag and takes the default action
+    timerWheelAdvance(&turnTimers, nowMilliseconds());
+    timerArm(&turnTimers, timer, delayMs);
+    return timer;
+}
+
+bool stdinBuffered() {
+#if defined(__GLIBC__)
+    return stdin->_IO_read_ptr < stdin->_IO_read_end;
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+    return stdin->_r > 0;
+#else
+    return false;
+#endif
+}
+
+bool readLineBefore(Timer* timer, char* line, int size) {
+    fflush(stdout);
+
+    while (true) {
+#ifndef _WIN32
+        // Sleep on the terminal until there is input or the wheel has a timer to fire,
+        // input stdio already took off the terminal is ready without asking poll
+        while (timer != NULL && !stdinBuffered()) {
+            struct pollfd input = {STDIN_FILENO, POLLIN, 0};
+            int ready = poll(&input, 1, timerWheelNextTimeout(&turnTimers));
+
+            timerWheelAdvance(&turnTimers, nowMilliseconds());
+            if (timer->expired) {
+                return false;
+            }
+            if (ready > 0) {
+                break;
+            }
+        }
+#endif
+
+        // Input that is gone for good counts as a missed deadline
+        if (fgets(line, size, stdin) == NULL) {
+            line[0] = '\0';
+            return false;
+        }
+
+        // The newline a scanf of the menu left behind is not an answer, nor is an empty line
+        if (strspn(line, " \t\r\n") != strlen(line)) {
+            return true;
+        }
+        if (timer != NULL && timer->expired) {
+            return false;
+        }
+    }
+}
+
+bool seatIsRemote(Game* game, int seat) {
+    return game->seatLinks != NULL && (game->seatLinks[seat].fd >= 0 || game->seatLinks[seat].channel != NULL);
+}
+
+void seatSend(Game* game, int seat, const char* format, ...) {
+    SeatLink* link = &game->seatLinks[seat];
+    char line[SEAT_LINK_BUFFER];
+    va_list args;
+
+    if (link->gone) {
+        return;
+    }
+
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length >= (int) sizeof(line)) {
+        length = sizeof(line) - 1;
+    }
+
+#ifndef _WIN32
+    // A client that cannot take a line any more is treated as gone
+    if (!linkWrite(link, line, length)) {
+        link->gone = true;
+    }
+#endif
+}
+
+bool readSeatLineBefore(SeatLink* link, Timer* timer, char* line, int size) {
+#ifdef _WIN32
+    return false;
+#else
+    while (!link->gone) {
+        // A line that already arrived is handed out before the socket is read again
+        char* end = memchr(link->buffer, '\n', link->buffered);
+        if (end != NULL) {
+            int length = (int) (end - link->buffer);
+            if (length >= size) {
+                length = size - 1;
+            }
+            memcpy(line, link->buffer, length);
+            line[length] = '\0';
+            link->buffered -= (int) (end - link->buffer) + 1;
+            memmove(link->buffer, end + 1, link->buffered);
+            return true;
+        }
+        if (link->buffered == SEAT_LINK_BUFFER) {
+            link->gone = true;  // No line is this long, the client does not speak the protocol
+            break;
+        }
+
+        if (link->channel != NULL) {
+            int received = localReceive(link, timer);
+            if (received < 0) {
+                link->gone = true;
+                break;
+            }
+            if (received == 0) {
+                return false;
+            }
+            link->buffered += received;
+            continue;
+        }
+
+        struct pollfd input = {link->fd, POLLIN, 0};
+        int ready = poll(&input, 1, timer != NULL ? timerWheelNextTimeout(&turnTimers) : -1);
+
+        timerWheelAdvance(&turnTimers, nowMilliseconds());
+        if (timer != NULL && timer->expired) {
+            return false;
+        }
+        if (ready > 0) {
+            ssize_t received = recv(link->fd, link->buffer + link->buffered, SEAT_LINK_BUFFER - link->buffered, 0);
+            if (received <= 0) {
+                link->gone = true;
+                break;
+            }
+            link->buffered += (int) received;
+        }
+    }
+    line[0] = '\0';
+    return false;
+#endif
+}
+
+double askRemoteBet(Game* game, int seat, Timer* timer) {
+    Player* player = &game->players[seat];
+    int minimum = STAKE_MIN_BET[game->stake];
+    char line[SEAT_LINK_BUFFER];
+
+    // Spectators catch up before the table waits on a player
+    if (game->broadcast != NULL) {
+        broadcastFlush(game->broadcast);
+    }
+    seatSend(game, seat, "BET? %.2f %d\n", player->ChipSum, minimum);
+    while (readSeatLineBefore(&game->seatLinks[seat], timer, line, sizeof(line))) {
+        double betAmount = 0;
+
+        // A player leaves between rounds by answering the bet prompt
+        if (strncmp(line, "LEAVE", 5) == 0) {
+            seatSend(game, seat, "BYE\n");
+            game->seatLinks[seat].gone = true;
+            return 0;
+        }
+        if (sscanf(line, "BET %lf", &betAmount) == 1 && betAmount >= minimum && betAmount <= player->ChipSum) {
+            return betAmount;
+        }
+        seatSend(game, seat, "ERR bet between %d and %.2f\n", minimum, player->ChipSum);
+    }
+    return 0;
+}
+
+Decision askRemoteDecision(Game* game, int seat, Hand* hand, Timer* timer, bool canDouble, bool canSplit, bool canSurrender) {
+    char line[SEAT_LINK_BUFFER];
+    char options[6] = "hs";
+    bool soft;
+    int total = calculateSoftScore(hand->card, hand->countCard, &soft);
+
+    if (canDouble) {
+        strcat(options, "d");
+    }
+    if (canSplit) {
+        strcat(options, "p");
+    }
+    if (canSurrender) {
+        strcat(options, "r");
+    }
+
+    if (game->broadcast != NULL) {
+        broadcastFlush(game->broadcast);
+    }
+    seatSend(game, seat, "ACT? %d %d %d %s\n", total, soft, cardPoints(&game->board->dealerCards[0]), options);
+    while (readSeatLineBefore(&game->seatLinks[seat], timer, line, sizeof(line))) {
+        if (strcmp(line, "HIT") == 0) {
+            return HIT;
+        } else if (strcmp(line, "STAND") == 0) {
+            return STAND;
+        } else if (strcmp(line, "DOUBLE") == 0 && canDouble) {
+            return DOUBLE;
+        } else if (strcmp(line, "SPLIT") == 0 && canSplit) {
+            return SPLIT;
+        } else if (strcmp(line, "SURRENDER") == 0 && canSurrender) {
+            return SURRENDER;
+        }
+        seatSend(game, seat, "ERR play one of %s\n", options);
+    }
+
+    // A missed deadline or a broken connection stands, like at the terminal
+    return STAND;
+}
+
+const char* cardCode(const Card* card, char* code) {
+    code[0] = VALUE_CODES[card->Value];
+    code[1] = SUIT_CODES[card->Suit];
+    code[2] = '\0';
+    return code;
+}
+
+void broadcastRelease(BroadcastBuffer* buffer) {
+    if (--buffer->refs == 0) {
+        free(buffer);
+    }
+}
+
+BroadcastBuffer* broadcastBuffer(const void* data, int length) {
+    BroadcastBuffer* buffer = malloc(sizeof(BroadcastBuffer) + length);
+    if (buffer == NULL) {
+        perror("Failed to allocate memory for broadcast");
+        exit(EXIT_FAILURE);
+    }
+    buffer->refs = 1;
+    buffer->length = length;
+    memcpy(buffer->data, data, length);
+    return buffer;
+}
+
+int formatEvent(const TableEvent* event, char* line, int size) {
+    const char* outcomes[] = {"WIN", "LOSE", "TIE", "SURRENDER"};
+    char first[3], second[3];
+
+    switch (event->kind) {
+        case EVENT_ROUND:
+            return snprintf(line, size, "ROUND\n");
+        case EVENT_SEAT:
+            return snprintf(line, size, "SEAT %d %s %.2f\n", event->seat, event->name, event->amount);
+        case EVENT_LEAVE:
+            return snprintf(line, size, "LEAVE %d\n", event->seat);
+        case EVENT_MOVE:
+            return snprintf(line, size, "MOVE %d %d\n", event->seat, event->target);
+        case EVENT_BET:
+            return snprintf(line, size, "BET %d %.2f\n", event->seat, event->amount);
+        case EVENT_DEAL:
+            return snprintf(line, size, "DEAL %d %s %s\n", event->seat, cardCode(&event->card, first), cardCode(&event->second, second));
+        case EVENT_DEALER:
+            return snprintf(line, size, "DEALER %s\n", cardCode(&event->card, first));
+        case EVENT_CARD:
+            return snprintf(line, size, "CARD %d %d %s\n", event->seat, event->hand, cardCode(&event->card, first));
+        case EVENT_DOUBLE:
+            return snprintf(line, size, "DOUBLE %d %d\n", event->seat, event->hand);
+        case EVENT_SPLIT:
+            return snprintf(line, size, "SPLIT %d %d\n", event->seat, event->hand);
+        case EVENT_STAND:
+            return snprintf(line, size, "STAND %d %d %d\n", event->seat, event->hand, event->score);
+        case EVENT_SURRENDER:
+            return snprintf(line, size, "SURRENDER %d %d\n", event->seat, event->hand);
+        case EVENT_BUST:
+            return snprintf(line, size, "BUST %d %d %d\n", event->seat, event->hand, event->score);
+        case EVENT_REVEAL:
+            return snprintf(line, size, "REVEAL %s\n", cardCode(&event->card, first));
+        case EVENT_DEALER_SCORE:
+            return snprintf(line, size, "DEALER_SCORE %d\n", event->score);
+        case EVENT_RESULT:
+            return snprintf(line, size, "RESULT %d %d %s\n", event->seat, event->hand, outcomes[event->outcome]);
+        case EVENT_BALANCE:
+            return snprintf(line, size, "BALANCE %d %.2f\n", event->seat, event->amount);
+        case EVENT_CLOSED:
+            return snprintf(line, size, "CLOSED\n");
+    }
+    return 0;
+}
+
+// LEB128, seven bits a byte with the high bit set on every byte but the last
+unsigned char* putVarint(unsigned char* out, unsigned long long value) {
+    while (value >= 0x80) {
+        *out++ = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char) value;
+    return out;
+}
+
+unsigned char* putCents(unsigned char* out, double amount) {
+    return putVarint(out, (unsigned long long) (amount * 100 + 0.5));
+}
+
+unsigned char* putCard(unsigned char* out, const Card* card) {
+    *out++ = (unsigned char) (card->Value * 4 + card->Suit);
+    return out;
+}
+
+unsigned char* putName(unsigned char* out, const char* name) {
+    int length = (int) strnlen(name, MAX_NAME_LEN - 1);
+    *out++ = (unsigned char) length;
+    memcpy(out, name, length);
+    return out + length;
+}
+
+// Puts the length in front of a record body so a client can skip kinds it does not know
+int finishFrame(unsigned char* frame, unsigned char* bodyStart, unsigned char* bodyEnd) {
+    unsigned char length[10];
+    int lengthBytes = (int) (putVarint(length, bodyEnd - bodyStart) - length);
+    int bodyBytes = (int) (bodyEnd - bodyStart);
+
+    memmove(frame + lengthBytes, bodyStart, bodyBytes);
+    memcpy(frame, length, lengthBytes);
+    return lengthBytes + bodyBytes;
+}
+
+int encodeEvent(const TableEvent* event, unsigned long long version, unsigned char* frame) {
+    unsigned char* body = frame + 10;
+    unsigned char* out = body;
+
+    *out++ = (unsigned char) (SYNC_EVENT_BASE + event->kind);
+    out = putVarint(out, version);
+    switch (event->kind) {
+        case EVENT_SEAT:
+            *out++ = (unsigned char) event->seat;
+            out = putName(out, event->name);
+            out = putCents(out, event->amount);
+            break;
+        case EVENT_LEAVE:
+            *out++ = (unsigned char) event->seat;
+            break;
+        case EVENT_MOVE:
+            *out++ = (unsigned char) event->seat;
+            *out++ = (unsigned char) event->target;
+            break;
+        case EVENT_BET:
+        case EVENT_BALANCE:
+            *out++ = (unsigned char) event->seat;
+            out = putCents(out, event->amount);
+            break;
+        case EVENT_DEAL:
+            *out++ = (unsigned char) event->seat;
+            out = putCard(out, &event->card);
+            out = putCard(out, &event->second);
+            break;
+        case EVENT_DEALER:
+        case EVENT_REVEAL:
+            out = putCard(out, &event->card);
+            break;
+        case EVENT_CARD:
+            *out++ = (unsigned char) event->seat;
+            *out++ = (unsigned char) event->hand;
+            out = putCard(out, &event->card);
+            break;
+        case EVENT_DOUBLE:
+        case EVENT_SPLIT:
+        case EVENT_SURRENDER:
+            *out++ = (unsigned char) event->seat;
+            *out++ = (unsigned char) event->hand;
+            break;
+        case EVENT_STAND:
+        case EVENT_BUST:
+            *out++ = (unsigned char) event->seat;
+            *out++ = (unsigned char) event->hand;
+            *out++ = (unsigned char) event->score;
+            break;
+        case EVENT_DEALER_SCORE:
+            *out++ = (unsigned char) event->score;
+            break;
+        case EVENT_RESULT:
+            *out++ = (unsigned char) event->seat;
+            *out++ = (unsigned char) event->hand;
+            *out++ = (unsigned char) event->outcome;
+            break;
+        case EVENT_ROUND:
+        case EVENT_CLOSED:
+            break;
+    }
+    return finishFrame(frame, body, out);
+}
+
+void viewApply(TableView* view, const TableEvent* event) {
+    ViewSeat* seat = &view->seats[event->seat];
+    ViewHand* hand = &seat->hands[event->hand];
+
+    // Chips move exactly as placeBet, splitHand and the surrender move them in the game
+    switch (event->kind) {
+        case EVENT_ROUND:
+            view->dealerCount = 0;
+            for (int i = 0; i < view->seatCount; i++) {
+                view->seats[i].handCount = 0;
+            }
+            break;
+        case EVENT_SEAT:
+            memset(seat, 0, sizeof(ViewSeat));
+            snprintf(seat->name, MAX_NAME_LEN, "%s", event->name);
+            seat->balance = event->amount;
+            if (event->seat >= view->seatCount) {
+                view->seatCount = event->seat + 1;
+            }
+            break;
+        case EVENT_LEAVE:
+            // The last seat moves into the hole, the MOVE that follows only names it
+            *seat = view->seats[--view->seatCount];
+            break;
+        case EVENT_BET:
+            memset(&seat->hands[0], 0, sizeof(ViewHand));
+            seat->hands[0].bet = event->amount;
+            seat->handCount = 1;
+            seat->balance -= event->amount;
+            break;
+        case EVENT_DEAL:
+            seat->hands[0].cards[0] = event->card;
+            seat->hands[0].cards[1] = event->second;
+            seat->hands[0].cardCount = 2;
+            break;
+        case EVENT_DEALER:
+        case EVENT_REVEAL:
+            view->dealerCards[view->dealerCount++] = event->card;
+            break;
+        case EVENT_CARD:
+            hand->cards[hand->cardCount++] = event->card;
+            break;
+        case EVENT_DOUBLE:
+            seat->balance -= hand->bet;
+            hand->bet *= 2;
+            hand->flags |= VIEW_DOUBLED;
+            break;
+        case EVENT_SPLIT: {
+            ViewHand* newHand = &seat->hands[seat->handCount++];
+            memset(newHand, 0, sizeof(ViewHand));
+            newHand->cards[0] = hand->cards[1];
+            newHand->cardCount = 1;
+            newHand->bet = hand->bet;
+            hand->cardCount = 1;
+            seat->balance -= hand->bet;
+            break;
+        }
+        case EVENT_SURRENDER:
+            seat->balance += hand->bet / 2.0;
+            hand->flags |= VIEW_LOST;
+            break;
+        case EVENT_BUST:
+            hand->flags |= VIEW_LOST;
+            break;
+        case EVENT_RESULT:
+            if (event->outcome == OUTCOME_LOSE) {
+                hand->flags |= VIEW_LOST;
+            } else if (event->outcome == OUTCOME_TIE) {
+                hand->flags |= VIEW_TIE;
+            }
+            break;
+        case EVENT_BALANCE:
+            seat->balance = event->amount;
+            break;
+        case EVENT_MOVE:
+        case EVENT_STAND:
+        case EVENT_DEALER_SCORE:
+        case EVENT_CLOSED:
+            break;
+    }
+}
+
+int encodeSnapshot(const TableView* view, unsigned long long version, unsigned char* frame) {
+    unsigned char* body = frame + 10;
+    unsigned char* out = body;
+
+    *out++ = SYNC_SNAPSHOT;
+    out = putVarint(out, version);
+    *out++ = (unsigned char) view->dealerCount;
+    for (int i = 0; i < view->dealerCount; i++) {
+        out = putCard(out, &view->dealerCards[i]);
+    }
+
+    *out++ = (unsigned char) view->seatCount;
+    for (int i = 0; i < view->seatCount; i++) {
+        const ViewSeat* seat = &view->seats[i];
+        out = putName(out, seat->name);
+        out = putCents(out, seat->balance);
+        *out++ = (unsigned char) seat->handCount;
+        for (int h = 0; h < seat->handCount; h++) {
+            const ViewHand* hand = &seat->hands[h];
+            out = putCents(out, hand->bet);
+            *out++ = hand->flags;
+            *out++ = (unsigned char) hand->cardCount;
+            for (int c = 0; c < hand->cardCount; c++) {
+                out = putCard(out, &hand->cards[c]);
+            }
+        }
+    }
+    return finishFrame(frame, body, out);
+}
+
+void tableEvent(Game* game, const TableEvent* event) {
+    Broadcast* broadcast = game->broadcast;
+    unsigned char frame[SYNC_FRAME_MAX];
+
+    // Every event is a new version, its binary delta is kept so clients can resume from it
+    unsigned long long version = ++broadcast->version;
+    BroadcastBuffer** slot = &broadcast->history[version % DELTA_HISTORY];
+    if (*slot != NULL) {
+        broadcastRelease(*slot);
+    }
+    *slot = NULL;
+
+    // Without a sync client the delta is not encoded, one joining later starts from a snapshot
+    if (broadcast->count > broadcast->textCount) {
+        *slot = broadcastBuffer(frame, encodeEvent(event, version, frame));
+    } else {
+        broadcast->deltasFrom = version + 1;
+    }
+    viewApply(&broadcast->view, event);
+
+    // Text is only formatted when somebody reads it
+    if (broadcast->textCount > 0) {
+        char line[SEAT_LINK_BUFFER];
+        int length = formatEvent(event, line, sizeof(line));
+        if (length >= (int) sizeof(line)) {
+            length = sizeof(line) - 1;
+        }
+        broadcast->batch[broadcast->batchCount++] = broadcastBuffer(line, length);
+    }
+
+    if (broadcast->batchCount == BROADCAST_BATCH || version - broadcast->flushedVersion >= BROADCAST_BATCH) {
+        broadcastFlush(broadcast);
+    }
+}
+
+// Lets go of every queued event that has not started on the wire, a started one has to finish
+void spectatorDiscard(Spectator* spectator) {
+    int keep = spectator->offset > 0 ? 1 : 0;
+
+    for (int i = keep; i < spectator->count; i++) {
+        broadcastRelease(spectator->queue[(spectator->head + i) % SPECTATOR_QUEUE]);
+    }
+    spectator->count = keep;
+}
+
+void spectatorDrop(Broadcast* broadcast, int index) {
+    Spectator* spectator = &broadcast->spectators[index];
+
+    spectator->offset = 0;
+    spectatorDiscard(spectator);
+    close(spectator->fd);
+    if (!spectator->binary) {
+        broadcast->textCount--;
+    }
+    broadcast->spectators[index] = broadcast->spectators[--broadcast->count];
+}
+
+void spectatorQueue(Spectator* spectator, BroadcastBuffer* buffer) {
+    buffer->refs++;
+    spectator->queue[(spectator->head + spectator->count++) % SPECTATOR_QUEUE] = buffer;
+}
+
+// Hands every queued event of one spectator to the kernel in a single call, returns false if the spectator is gone
+bool spectatorWrite(Spectator* spectator) {
+#ifdef _WIN32
+    return false;
+#else
+    struct iovec parts[SPECTATOR_QUEUE];
+
+    if (spectator->count == 0) {
+        return true;
+    }
+    for (int i = 0; i < spectator->count; i++) {
+        BroadcastBuffer* buffer = spectator->queue[(spectator->head + i) % SPECTATOR_QUEUE];
+        int skip = i == 0 ? spectator->offset : 0;
+        parts[i].iov_base = buffer->data + skip;
+        parts[i].iov_len = buffer->length - skip;
+    }
+
+    // sendmsg rather than writev, a spectator that hung up must not raise SIGPIPE
+    struct msghdr message = {.msg_iov = parts, .msg_iovlen = spectator->count};
+    ssize_t written = sendmsg(spectator->fd, &message, MSG_NOSIGNAL);
+    if (written < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    // Events written in full leave the queue, a slow socket keeps the rest for the next flush
+    while (spectator->count > 0) {
+        BroadcastBuffer* buffer = spectator->queue[spectator->head];
+        ssize_t left = buffer->length - spectator->offset;
+        if (written < left) {
+            spectator->offset += (int) written;
+            break;
+        }
+        written -= left;
+        spectator->offset = 0;
+        spectator->head = (spectator->head + 1) % SPECTATOR_QUEUE;
+        spectator->count--;
+        broadcastRelease(buffer);
+    }
+    return true;
+#endif
+}
+
+// Brings a sync client to the current version with the deltas it misses, or with one snapshot when they are too many
+void syncCatchUp(Broadcast* broadcast, Spectator* spectator) {
+    unsigned long long missing = broadcast->version - spectator->sentVersion;
+
+    if (missing == 0) {
+        return;
+    }
+    if (spectator->sentVersion == 0 || missing >= DELTA_HISTORY || spectator->count + missing > SPECTATOR_QUEUE ||
+        spectator->sentVersion + 1 < broadcast->deltasFrom) {
+        if (broadcast->snapshot == NULL || broadcast->snapshotVersion != broadcast->version) {
+            unsigned char frame[SYNC_FRAME_MAX];
+            if (broadcast->snapshot != NULL) {
+                broadcastRelease(broadcast->snapshot);
+            }
+            broadcast->snapshot = broadcastBuffer(frame, encodeSnapshot(&broadcast->view, broadcast->version, frame));
+            broadcast->snapshotVersion = broadcast->version;
+        }
+        spectatorDiscard(spectator);
+        spectatorQueue(spectator, broadcast->snapshot);
+    } else {
+        for (unsigned long long v = spectator->sentVersion + 1; v <= broadcast->version; v++) {
+            spectatorQueue(spectator, broadcast->history[v % DELTA_HISTORY]);
+        }
+    }
+    spectator->sentVersion = broadcast->version;
+}
+
+void broadcastFlush(Broadcast* broadcast) {
+    for (int i = broadcast->count - 1; i >= 0; i--) {
+        Spectator* spectator = &broadcast->spectators[i];
+
+        if (spectator->binary) {
+            syncCatchUp(broadcast, spectator);
+        } else if (spectator->count + broadcast->batchCount > SPECTATOR_QUEUE) {
+            // A text spectator that cannot keep up is let go rather than slowing the table down
+            spectatorDrop(broadcast, i);
+            continue;
+        } else {
+            for (int b = 0; b < broadcast->batchCount; b++) {
+                spectatorQueue(spectator, broadcast->batch[b]);
+            }
+        }
+        if (!spectatorWrite(spectator)) {
+            spectatorDrop(broadcast, i);
+        }
+    }
+
+    for (int b = 0; b < broadcast->batchCount; b++) {
+        broadcastRelease(broadcast->batch[b]);
+    }
+    broadcast->batchCount = 0;
+    broadcast->flushedVersion = broadcast->version;
+}
+
+void broadcastAdd(Broadcast* broadcast, int fd, bool binary, unsigned long long version) {
+    Game* game = broadcast->game;
+
+    if (broadcast->count == broadcast->capacity) {
+        int capacity = broadcast->capacity > 0 ? broadcast->capacity * 2 : 16;
+        Spectator* spectators = realloc(broadcast->spectators, capacity * sizeof(Spectator));
+        if (spectators == NULL) {
+            perror("Failed to allocate memory for spectators");
+            exit(EXIT_FAILURE);
+        }
+        broadcast->spectators = spectators;
+        broadcast->capacity = capacity;
+    }
+
+    // Earlier events go out first so the newcomer's greeting lands after them
+    broadcastFlush(broadcast);
+
+    Spectator* spectator = &broadcast->spectators[broadcast->count++];
+    spectator->fd = fd;
+    spectator->head = 0;
+    spectator->count = 0;
+    spectator->offset = 0;
+    spectator->binary = binary;
+    spectator->sentVersion = version <= broadcast->version ? version : 0;  // A version from the future gets a snapshot
+#ifndef _WIN32
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
+
+    if (binary) {
+        syncCatchUp(broadcast, spectator);
+    } else {
+        // The greeting is the only text formatted for one spectator alone
+        char greeting[SEAT_LINK_BUFFER * (MAX_PLAYERS + 1)];
+        int length = snprintf(greeting, SEAT_LINK_BUFFER, "WATCHING %u\n", game->tableId);
+        for (int i = 0; i < game->numPlayers; i++) {
+            length += snprintf(greeting + length, SEAT_LINK_BUFFER, "SEAT %d %s %.2f\n", i, game->players[i].name, game->players[i].ChipSum);
+        }
+        spectator->queue[0] = broadcastBuffer(greeting, length);
+        spectator->count = 1;
+        broadcast->textCount++;
+    }
+    if (!spectatorWrite(spectator)) {
+        spectatorDrop(broadcast, broadcast->count - 1);
+    }
+}
+
+void broadcastClose(Broadcast* broadcast) {
+    tableEvent(broadcast->game, &(TableEvent) {.kind = EVENT_CLOSED});
+    broadcastFlush(broadcast);
+    while (broadcast->count > 0) {
+        spectatorDrop(broadcast, broadcast->count - 1);
+    }
+    for (int i = 0; i < DELTA_HISTORY; i++) {
+        if (broadcast->history[i] != NULL) {
+            broadcastRelease(broadcast->history[i]);
+        }
+    }
+    if (broadcast->snapshot != NULL) {
+        broadcastRelease(broadcast->snapshot);
+    }
+    free(broadcast->spectators);
+    memset(broadcast, 0, sizeof(Broadcast));
+}
+
+off_t historyWholeEnd(int fd) {
+    Move* moves = malloc(HISTORY_BATCH * sizeof(Move));
+    size_t capacity = HISTORY_BATCH * HISTORY_RECORD_MAX;
+    unsigned char* bytes = malloc(capacity);
+    if (moves == NULL || bytes == NULL) {
+        perror("Failed to allocate memory for hand history");
+        exit(EXIT_FAILURE);
+    }
+
+    // Read in chunks like the review does, the first record that does not decode whole is where the file ends
+    off_t end = sizeof(HistoryHeader);
+    size_t length = 0, used;
+    ssize_t got;
+    lseek(fd, end, SEEK_SET);
+    while ((got = read(fd, bytes + length, capacity - length)) > 0) {
+        length += got;
+        while (decodeMoves(bytes, length, moves, HISTORY_BATCH, &used) > 0) {
+            memmove(bytes, bytes + used, length - used);
+            length -= used;
+            end += used;
+        }
+    }
+    free(bytes);
+    free(moves);
+    return end;
+}
+
+void historyOpen(const char* path) {
+    struct stat info;
+
+    // No O_APPEND, every buffer is written at the offset it was handed off with, so writes may finish in any order
+    handHistory.fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (handHistory.fd < 0 || fstat(handHistory.fd, &info) != 0) {
+        perror("Failed to open hand history");
+        exit(EXIT_FAILURE);
+    }
+
+    // A crash can leave half a round at the end, or a hole where a later buffer landed first,
+    // new rounds go after the last whole one so the file never has a broken record in the middle
+    off_t end = info.st_size >= (off_t) sizeof(HistoryHeader) ? historyWholeEnd(handHistory.fd) : 0;
+    if (end < info.st_size) {
+        if (ftruncate(handHistory.fd, end) != 0) {
+            perror("Failed to cut the torn end off the hand history");
+            exit(EXIT_FAILURE);
+        }
+        printf("Cut %lld bytes of a round a crash left unfinished off %s\n", (long long) (info.st_size - end), path);
+        info.st_size = end;
+    }
+    handHistory.end = info.st_size;
+
+    // A new file starts with the header, an old one keeps appending after its last record
+    if (info.st_size == 0) {
+        HistoryHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+        header.version = HISTORY_VERSION;
+        if (write(handHistory.fd, &header, sizeof(header)) != (ssize_t) sizeof(header)) {
+            perror("Failed to write hand history header");
+            exit(EXIT_FAILURE);
+        }
+        handHistory.end = sizeof(header);
+    }
+
+    for (int i = 0; i < HISTORY_BUFFERS; i++) {
+        handHistory.buffers[i].bytes = aligned_alloc(HISTORY_ALIGN, HISTORY_FLUSH);
+        if (handHistory.buffers[i].bytes == NULL) {
+            perror("Failed to allocate memory for hand history");
+            exit(EXIT_FAILURE);
+        }
+        handHistory.idle[i] = &handHistory.buffers[i];
+    }
+    handHistory.idleCount = HISTORY_BUFFERS;
+
+#ifdef HISTORY_URING
+    handHistory.uring = historyRingOpen(&handHistory.ring);
+    if (!handHistory.uring) {
+        handHistory.ring.fd = -1;
+    }
+#endif
+    if (pthread_create(&handHistory.writer, NULL, historyWriter, NULL) != 0) {
+        perror("Failed to start hand history writer");
+        exit(EXIT_FAILURE);
+    }
+}
+
+#ifdef HISTORY_URING
+bool historyRingOpen(HistoryRing* ring) {
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int) syscall(__NR_io_uring_setup, HISTORY_BUFFERS, &params);
+    if (ring->fd < 0) {
+        return false;  // Old kernels, seccomp filters and io_uring_disabled all end up on pwrite
+    }
+
+    // Kernels since 5.4 keep both rings in one mapping
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        sqSize = cqSize = sqSize > cqSize ? sqSize : cqSize;
+    }
+    char* sq = mmap(NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    char* cq = single ? sq : mmap(NULL, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+        close(ring->fd);
+        return false;
+    }
+
+    ring->sqTail = (_Atomic unsigned int*) (sq + params.sq_off.tail);
+    ring->sqMask = *(unsigned int*) (sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned int*) (sq + params.sq_off.array);
+    ring->sqes = sqes;
+    ring->cqHead = (_Atomic unsigned int*) (cq + params.cq_off.head);
+    ring->cqTail = (_Atomic unsigned int*) (cq + params.cq_off.tail);
+    ring->cqMask = *(unsigned int*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    // Pinning the buffers can go over a small RLIMIT_MEMLOCK, the writes then map them every time
+    struct iovec buffers[HISTORY_BUFFERS];
+    for (int i = 0; i < HISTORY_BUFFERS; i++) {
+        buffers[i].iov_base = handHistory.buffers[i].bytes;
+        buffers[i].iov_len = HISTORY_FLUSH;
+    }
+    ring->fixed = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, buffers, HISTORY_BUFFERS) == 0;
+    return true;
+}
+
+void historyRingSubmit(HistoryRing* ring, HistoryBuffer* buffer) {
+    unsigned int tail = atomic_load_explicit(ring->sqTail, memory_order_relaxed);
+    unsigned int slot = tail & ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[slot];
+    int index = (int) (buffer - handHistory.buffers);
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = ring->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = handHistory.fd;
+    sqe->addr = (unsigned long long) (size_t) (buffer->bytes + buffer->written);
+    sqe->len = (unsigned int) (buffer->length - buffer->written);
+    sqe->off = (unsigned long long) (buffer->offset + buffer->written);
+    sqe->buf_index = (unsigned short) index;
+    sqe->user_data = (unsigned long long) index;
+    ring->sqArray[slot] = slot;
+    // The kernel must see the whole entry before it sees the new tail
+    atomic_store_explicit(ring->sqTail, tail + 1, memory_order_release);
+}
+
+int historyRingReap(HistoryRing* ring, HistoryBuffer** finished, int* resubmitted) {
+    unsigned int head = atomic_load_explicit(ring->cqHead, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(ring->cqTail, memory_order_acquire);
+    int done = 0;
+
+    for (; head != tail; head++) {
+        struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+        HistoryBuffer* buffer = &handHistory.buffers[cqe->user_data];
+
+        if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+            // The kernel has a ring but not this write, the rest of the history goes through pwrite
+            handHistory.uring = false;
+            historyWriteAll(buffer);
+        } else if (cqe->res <= 0) {
+            errno = cqe->res < 0 ? -cqe->res : EIO;
+            perror("Failed to write hand history");  // The rounds are only history, the chips log still has every balance
+        } else {
+            buffer->written += cqe->res;
+            if (buffer->written < buffer->length) {
+                historyRingSubmit(ring, buffer);  // A short write goes straight back with the rest
+                (*resubmitted)++;
+                continue;
+            }
+        }
+        finished[done++] = buffer;
+    }
+    atomic_store_explicit(ring->cqHead, head, memory_order_release);
+    return done;
+}
+#endif
+
+void historyWriteAll(HistoryBuffer* buffer) {
+    while (buffer->written < buffer->length) {
+#ifdef _WIN32
+        lseek(handHistory.fd, buffer->offset + buffer->written, SEEK_SET);
+        ssize_t n = write(handHistory.fd, buffer->bytes + buffer->written, buffer->length - buffer->written);
+#else
+        ssize_t n = pwrite(handHistory.fd, buffer->bytes + buffer->written, buffer->length - buffer->written,
+                           buffer->offset + buffer->written);
+#endif
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("Failed to write hand history");
+            break;  // The rounds are only history, the chips log still has every balance
+        }
+        buffer->written += n;
+    }
+}
+
+void historySubmit(HistoryBuffer* buffer) {
+    // Offsets are given out in submit order, so the file stays in hand off order however the writes finish
+    buffer->offset = handHistory.end;
+    handHistory.end += buffer->length;
+#ifdef HISTORY_URING
+    if (handHistory.uring) {
+        historyRingSubmit(&handHistory.ring, buffer);
+        handHistory.inRing++;
+        handHistory.unsubmitted++;
+        return;
+    }
+#endif
+    historyWriteAll(buffer);
+    buffer->length = 0;
+    buffer->written = 0;
+    handHistory.idle[handHistory.idleCount++] = buffer;
+}
+
+void historyAwaitWrites(int minComplete) {
+#ifdef HISTORY_URING
+    HistoryBuffer* finished[HISTORY_BUFFERS];
+
+    if (handHistory.inRing == 0) {
+        return;
+    }
+    // One call submits every new write and sleeps until enough have finished
+    long entered = syscall(__NR_io_uring_enter, handHistory.ring.fd, handHistory.unsubmitted, minComplete,
+                           IORING_ENTER_GETEVENTS, NULL, 0);
+    if (entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        perror("Failed to submit hand history");
+        exit(EXIT_FAILURE);
+    }
+    if (entered > 0) {
+        handHistory.unsubmitted -= (int) entered;
+    }
+    int resubmitted = 0;
+    int done = historyRingReap(&handHistory.ring, finished, &resubmitted);
+    handHistory.inRing -= done;
+    handHistory.unsubmitted += resubmitted;
+    for (int i = 0; i < done; i++) {
+        finished[i]->length = 0;
+        finished[i]->written = 0;
+        handHistory.idle[handHistory.idleCount++] = finished[i];
+    }
+#else
+    (void) minComplete;
+#endif
+}
+
+int historyTakeIn(HistoryStage* stages) {
+    // The stack has the newest stage on top, turned around the rounds of every table are in the order it played them
+    HistoryStage* ordered = NULL;
+    while (stages != NULL) {
+        HistoryStage* next = atomic_load_explicit(&stages->next, memory_order_relaxed);
+        atomic_store_explicit(&stages->next, ordered, memory_order_relaxed);
+        ordered = stages;
+        stages = next;
+    }
+
+    int taken = 0;
+    while (ordered != NULL) {
+        HistoryStage* stage = ordered;
+        ordered = atomic_load_explicit(&stage->next, memory_order_relaxed);
+
+        HistoryBuffer* buffer = handHistory.filling;
+        if (buffer != NULL && buffer->length + stage->length > HISTORY_FLUSH) {
+            historySubmit(buffer);
+            buffer = NULL;
+        }
+        // Every buffer is in the ring only when the disk is behind, the writer waits for one to come back
+        while (buffer == NULL) {
+            if (handHistory.idleCount > 0) {
+                buffer = handHistory.idle[--handHistory.idleCount];
+            } else {
+                historyAwaitWrites(1);
+            }
+        }
+        memcpy(buffer->bytes + buffer->length, stage->bytes, stage->length);
+        buffer->length += stage->length;
+        handHistory.filling = buffer;
+        free(stage);
+        taken++;
+    }
+    return taken;
+}
+
+void* historyWriter(void* unused) {
+    for (;;) {
+        pthread_mutex_lock(&handHistory.lock);
+        atomic_store(&handHistory.sleeping, true);
+        // While writes are in the ring the writer waits on the kernel instead, new stages join the next pass
+        while (atomic_load(&handHistory.stages) == NULL && handHistory.inRing == 0 &&
+               handHistory.flushDone == handHistory.flushAsked && !handHistory.closing) {
+            pthread_cond_wait(&handHistory.hasWork, &handHistory.lock);
+        }
+        atomic_store(&handHistory.sleeping, false);
+        unsigned long long asked = handHistory.flushAsked;
+        bool closing = handHistory.closing;
+        pthread_mutex_unlock(&handHistory.lock);
+
+        // Read after the flush was asked, so the stack holds every stage handed off before it
+        int taken = historyTakeIn(atomic_exchange_explicit(&handHistory.stages, NULL, memory_order_acquire));
+        if (taken > 0) {
+            atomic_fetch_sub(&handHistory.stagesPending, taken);
+            pthread_mutex_lock(&handHistory.lock);
+            pthread_cond_broadcast(&handHistory.emptied);
+            pthread_mutex_unlock(&handHistory.lock);
+        }
+
+        if (asked == handHistory.flushDone && !closing) {
+            historyAwaitWrites(1);
+            continue;
+        }
+        // A flush writes the buffer being filled as it is and waits for every write
+        if (handHistory.filling != NULL && handHistory.filling->length > 0) {
+            historySubmit(handHistory.filling);
+            handHistory.filling = NULL;
+        }
+        while (handHistory.inRing > 0) {
+            historyAwaitWrites(handHistory.inRing);
+        }
+        pthread_mutex_lock(&handHistory.lock);
+        handHistory.flushDone = asked;
+        pthread_cond_broadcast(&handHistory.emptied);
+        pthread_mutex_unlock(&handHistory.lock);
+        if (closing && atomic_load(&handHistory.stages) == NULL) {
+            return unused;
+        }
+    }
+}
+
+void captureMove(Game* game, Move* move) {
+    Board* board = game->board;
+
+    move->tableId = game->tableId;
+    move->roundNumber = game->roundNumber;
+    move->dealerCount = (unsigned char) board->dealCardCount;
+    memcpy(move->dealerCards, board->dealerCards, move->dealerCount * sizeof(Card));
+    move->seatCount = 0;
+
+    for (int i = 0; i < game->numPlayers; i++) {
+        Player* player = &game->players[i];
+        if (player->handCount == 0) {
+            continue;
+        }
+
+        SeatMove* seat = &move->seats[move->seatCount++];
+        seat->seat = (unsigned char) i;
+        seat->handCount = player->handCount;
+        seat->playCount = game->playCount[i];
+        for (int p = 0; p < seat->playCount; p++) {
+            seat->plays[p] = (Decision) game->plays[i][p];
+        }
+        bool surrendered = seat->playCount > 0 && seat->plays[seat->playCount - 1] == SURRENDER;
+
+        for (int h = 0; h < player->handCount; h++) {
+            Hand* hand = &player->hands[h];
+            seat->cardCount[h] = hand->countCard;
+            memcpy(seat->cards[h], hand->card, hand->countCard * sizeof(Card));
+            if (surrendered) {
+                seat->outcomes[h] = OUTCOME_SURRENDER;
+            } else if (hand->isLost) {
+                seat->outcomes[h] = OUTCOME_LOSE;
+            } else if (hand->isTie) {
+                seat->outcomes[h] = OUTCOME_TIE;
+            } else {
+                seat->outcomes[h] = OUTCOME_WIN;
+            }
+        }
+        seat->balanceChange = player->ChipSum - game->roundStartChips[i];
+    }
+}
+
+// Body: varint table, varint round, dealer card count and cards, seat count, then every seat as
+// seat | hands << 4, play count, the plays two bits each low bits first, for every hand
+// cards | outcome << 4 and its cards, and last the zigzag varint balance change in cents
+int encodeMove(const Move* move, unsigned char* record) {
+    unsigned char* body = record + 10;
+    unsigned char* out = body;
+
+    out = putVarint(out, move->tableId);
+    out = putVarint(out, move->roundNumber);
+    *out++ = move->dealerCount;
+    for (int c = 0; c < move->dealerCount; c++) {
+        out = putCard(out, &move->dealerCards[c]);
+    }
+    *out++ = move->seatCount;
+
+    for (int i = 0; i < move->seatCount; i++) {
+        const SeatMove* seat = &move->seats[i];
+        *out++ = (unsigned char) (seat->seat | seat->handCount << 4);
+        *out++ = seat->playCount;
+
+        memset(out, 0, (seat->playCount + 3) / 4);
+        for (int p = 0; p < seat->playCount; p++) {
+            out[p / 4] |= (unsigned char) (HISTORY_PLAY_CODES[seat->plays[p]] << (p % 4 * 2));
+        }
+        out += (seat->playCount + 3) / 4;
+
+        for (int h = 0; h < seat->handCount; h++) {
+            *out++ = (unsigned char) (seat->cardCount[h] | seat->outcomes[h] << 4);
+            for (int c = 0; c < seat->cardCount[h]; c++) {
+                out = putCard(out, &seat->cards[h][c]);
+            }
+        }
+
+        long long cents = llround(seat->balanceChange * 100);
+        out = putVarint(out, ((unsigned long long) cents << 1) ^ (unsigned long long) (cents >> 63));
+    }
+    return finishFrame(record, body, out);
+}
+
+size_t encodeMoves(const Move* moves, int count, unsigned char* out) {
+    unsigned char* start = out;
+
+    // Each record is moved down to the end of the one before, so out needs HISTORY_RECORD_MAX of room for the last
+    for (int i = 0; i < count; i++) {
+        out += encodeMove(&moves[i], out);
+    }
+    return (size_t) (out - start);
+}
+
+const unsigned char* getVarint(const unsigned char* in, const unsigned char* end, unsigned long long* value) {
+    *value = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        unsigned char byte = *in++;
+        *value |= (unsigned long long) (byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return in;
+        }
+    }
+    return NULL;
+}
+
+void getCard(unsigned char code, Card* card) {
+    card->Value = (VALUE) (code / 4);
+    card->Suit = (SUIT) (code % 4);
+    card->Color = (card->Suit == HEARTS || card->Suit == DIAMONDS) ? RED : BLACK;
+}
+
+const unsigned char* decodeMove(const unsigned char* in, const unsigned char* end, Move* move) {
+    unsigned long long length, value;
+
+    in = getVarint(in, end, &length);
+    if (in == NULL || length > (unsigned long long) (end - in)) {
+        return NULL;
+    }
+    end = in + length;  // Reading stays inside the record even when it is broken
+
+    if ((in = getVarint(in, end, &value)) == NULL) {
+        return NULL;
+    }
+    move->tableId = (unsigned int) value;
+    if ((in = getVarint(in, end, &move->roundNumber)) == NULL || in >= end) {
+        return NULL;
+    }
+    move->dealerCount = *in++;
+    if (move->dealerCount > MAX_CARDS || end - in < move->dealerCount + 1) {
+        return NULL;
+    }
+    for (int c = 0; c < move->dealerCount; c++) {
+        getCard(*in++, &move->dealerCards[c]);
+    }
+    move->seatCount = *in++;
+    if (move->seatCount > MAX_PLAYERS) {
+        return NULL;
+    }
+
+    for (int i = 0; i < move->seatCount; i++) {
+        SeatMove* seat = &move->seats[i];
+        if (end - in < 2) {
+            return NULL;
+        }
+        seat->seat = *in & 0x0F;
+        seat->handCount = *in++ >> 4;
+        seat->playCount = *in++;
+        if (seat->handCount > MAX_HANDS || seat->playCount > HISTORY_PLAYS || end - in < (seat->playCount + 3) / 4) {
+            return NULL;
+        }
+        for (int p = 0; p < seat->playCount; p++) {
+            seat->plays[p] = HISTORY_CODE_PLAYS[(in[p / 4] >> (p % 4 * 2)) & 3];
+        }
+        in += (seat->playCount + 3) / 4;
+
+        for (int h = 0; h < seat->handCount; h++) {
+            if (in >= end) {
+                return NULL;
+            }
+            seat->cardCount[h] = *in & 0x0F;
+            seat->outcomes[h] = (HandOutcome) (*in++ >> 4);
+            if (seat->outcomes[h] > OUTCOME_SURRENDER || seat->cardCount[h] > MAX_HAND_CARDS || end - in < seat->cardCount[h]) {
+                return NULL;
+            }
+            for (int c = 0; c < seat->cardCount[h]; c++) {
+                getCard(*in++, &seat->cards[h][c]);
+            }
+        }
+        if (seat->handCount == 1 && seat->outcomes[0] == OUTCOME_SURRENDER && seat->playCount > 0) {
+            seat->plays[seat->playCount - 1] = SURRENDER;
+        }
+
+        if ((in = getVarint(in, end, &value)) == NULL) {
+            return NULL;
+        }
+        seat->balanceChange = (double) ((long long) (value >> 1) ^ -(long long) (value & 1)) / 100.0;
+    }
+    return end;  // Fields a newer writer added at the end are skipped
+}
+
+int decodeMoves(const unsigned char* bytes, size_t length, Move* moves, int max, size_t* used) {
+    const unsigned char* in = bytes;
+    const unsigned char* end = bytes + length;
+    int count = 0;
+
+    while (count < max && in < end) {
+        const unsigned char* next = decodeMove(in, end, &moves[count]);
+        if (next == NULL) {
+            break;
+        }
+        in = next;
+        count++;
+    }
+    *used = (size_t) (in - bytes);
+    return count;
+}
+
+HistoryStage* historyStageNew() {
+    // Tables only wait here when the writer is HISTORY_STAGES_MAX stages behind, that is when the disk cannot keep up
+    if (atomic_load(&handHistory.stagesPending) >= HISTORY_STAGES_MAX) {
+        pthread_mutex_lock(&handHistory.lock);
+        while (atomic_load(&handHistory.stagesPending) >= HISTORY_STAGES_MAX) {
+            pthread_cond_wait(&handHistory.emptied, &handHistory.lock);
+        }
+        pthread_mutex_unlock(&handHistory.lock);
+    }
+
+    HistoryStage* stage = malloc(sizeof(HistoryStage));
+    if (stage == NULL) {
+        perror("Failed to allocate memory for hand history");
+        exit(EXIT_FAILURE);
+    }
+    stage->length = 0;
+    stage->startedAt = nowMilliseconds();
+    return stage;
+}
+
+void historyHandOff(HistoryStage* stage) {
+    atomic_fetch_add(&handHistory.stagesPending, 1);
+    HistoryStage* head = atomic_load_explicit(&handHistory.stages, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&stage->next, head, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak(&handHistory.stages, &head, stage));
+
+    // Only a writer that went to sleep costs the lock
+    if (atomic_load(&handHistory.sleeping)) {
+        pthread_mutex_lock(&handHistory.lock);
+        pthread_cond_signal(&handHistory.hasWork);
+        pthread_mutex_unlock(&handHistory.lock);
+    }
+}
+
+void historyRelease() {
+    HistoryStage* stage = historyStage;
+
+    if (stage != NULL) {
+        historyStage = NULL;
+        historyHandOff(stage);
+    }
+}
+
+void historyFlush() {
+    if (handHistory.fd < 0) {
+        return;
+    }
+    historyRelease();
+
+    // Other tables keep the stages they are still filling until they record another round or run out of players
+    pthread_mutex_lock(&handHistory.lock);
+    unsigned long long ticket = ++handHistory.flushAsked;
+    pthread_cond_signal(&handHistory.hasWork);
+    while (handHistory.flushDone < ticket) {
+        pthread_cond_wait(&handHistory.emptied, &handHistory.lock);
+    }
+    pthread_mutex_unlock(&handHistory.lock);
+}
+
+void historyClose() {
+    if (handHistory.fd < 0) {
+        return;
+    }
+    historyFlush();
+    pthread_mutex_lock(&handHistory.lock);
+    handHistory.closing = true;
+    pthread_cond_signal(&handHistory.hasWork);
+    pthread_mutex_unlock(&handHistory.lock);
+    pthread_join(handHistory.writer, NULL);
+    handHistory.closing = false;
+
+#ifdef HISTORY_URING
+    if (handHistory.ring.fd >= 0) {
+        close(handHistory.ring.fd);  // The ring mappings stay until the process ends
+        handHistory.ring.fd = -1;
+    }
+#endif
+    for (int i = 0; i < HISTORY_BUFFERS; i++) {
+        free(handHistory.buffers[i].bytes);
+        handHistory.buffers[i].bytes = NULL;
+    }
+    handHistory.filling = NULL;
+    close(handHistory.fd);
+    handHistory.fd = -1;
+}
+
+void historyRecord(Game* game) {
+    Move move;
+
+    // Simulated rounds are not kept, like their chips
+    if (game->tableId == 0 || handHistory.fd < 0) {
+        return;
+    }
+    captureMove(game, &move);
+
+    // encodeMove writes past the end of a short record before moving it down, so a stage keeps room for the longest
+    HistoryStage* stage = historyStage;
+    if (stage != NULL && stage->length + HISTORY_RECORD_MAX > HISTORY_STAGE) {
+        historyRelease();
+        stage = NULL;
+    }
+    if (stage == NULL) {
+        stage = historyStageNew();
+        historyStage = stage;
+    }
+    stage->length += encodeMove(&move, stage->bytes + stage->length);
+    atomic_fetch_add_explicit(&handHistory.rounds, 1, memory_order_relaxed);
+
+    // A quiet table still gets its rounds to the writer
+    if (nowMilliseconds() - stage->startedAt >= HISTORY_HOLD_MS) {
+        historyRelease();
+    }
+}
+
+void reviewHandHistory() {
+    const char* playNames[] = {"Hit", "Stand", "Surrender", "Double", "Split"};
+    const char* outcomeNames[] = {"Won", "Lost", "Tied", "Surrendered"};
+    long long plays[5] = {0}, outcomes[4] = {0};
+    long long rounds = 0, seats = 0;
+    double net = 0;
+    HistoryHeader header;
+
+    historyFlush();
+    int fd = open(HISTORY_PATH, O_RDONLY);
+    if (fd < 0) {
+        printf("There is no hand history yet.\n");
+        return;
+    }
+    if (read(fd, &header, sizeof(header)) != (ssize_t) sizeof(header) ||
+        memcmp(header.magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) != 0 || header.version != HISTORY_VERSION) {
+        printf("%s is not a hand history this version can read.\n", HISTORY_PATH);
+        close(fd);
+        return;
+    }
+
+    Move* moves = malloc(HISTORY_BATCH * sizeof(Move));
+    size_t capacity = HISTORY_BATCH * HISTORY_RECORD_MAX;
+    unsigned char* bytes = malloc(capacity);
+    if (moves == NULL || bytes == NULL) {
+        perror("Failed to allocate memory for hand history");
+        exit(EXIT_FAILURE);
+    }
+
+    // The file is read in chunks, a record cut by the end of a chunk is carried into the next
+    size_t length = 0, packed = sizeof(header);
+    ssize_t got;
+    unsigned long long started = nowMicroseconds();
+    while ((got = read(fd, bytes + length, capacity - length)) > 0) {
+        length += got;
+        packed += got;
+        size_t used;
+        int count;
+        while ((count = decodeMoves(bytes, length, moves, HISTORY_BATCH, &used)) > 0) {
+            for (int m = 0; m < count; m++) {
+                for (int i = 0; i < moves[m].seatCount; i++) {
+                    SeatMove* seat = &moves[m].seats[i];
+                    for (int p = 0; p < seat->playCount; p++) {
+                        plays[seat->plays[p]]++;
+                    }
+                    for (int h = 0; h < seat->handCount; h++) {
+                        outcomes[seat->outcomes[h]]++;
+                    }
+                    net += seat->balanceChange;
+                }
+                seats += moves[m].seatCount;
+            }
+            rounds += count;
+            memmove(bytes, bytes + used, length - used);
+            length -= used;
+        }
+    }
+    unsigned long long elapsed = nowMicroseconds() - started;
+    close(fd);
+    free(bytes);
+    free(moves);
+
+    printf("\n****** HAND HISTORY (%s) ******\n", HISTORY_PATH);
+    printf("Rounds: %lld, seats played: %lld, net to the players: %.2f\n", rounds, seats, net);
+    for (int p = 0; p < 5; p++) {
+        printf("%-10s %lld\n", playNames[p], plays[p]);
+    }
+    for (int o = 0; o < 4; o++) {
+        printf("%-12s %lld hands\n", outcomeNames[o], outcomes[o]);
+    }
+    if (rounds > 0) {
+        printf("Packed size: %zu bytes, %.1f a round against %zu unpacked, read in %.1f ms\n",
+               packed, (double) (packed - sizeof(header)) / rounds, sizeof(Move), elapsed / 1000.0);
+    }
+    if (length > 0) {
+        printf("The last %zu bytes read do not hold a whole round and were left out.\n", length);
+    }
+    printf("*********************************************\n\n");
+}
+
+#ifndef _WIN32
+// Takes the seats of players who left out of the table, the last seat moves into each hole
+void dropLeavers(TableRunner* runner) {
+    Game* game = &runner->table->game;
+
+    for (int i = game->numPlayers - 1; i >= 0; i--) {
+        SeatLink* link = &game->seatLinks[i];
+        if (!link->gone && server.running) {
+            continue;
+        }
+        if (!link->gone) {
+            seatSend(game, i, "BYE\n");  // The server is closing
+        }
+        linkClose(link);
+
+        LobbyTicket* ticket = runner->tickets[i];
+        ticket->chips = game->players[i].ChipSum;  // Goes back to the wallet of the player
+        int last = --game->numPlayers;
+        GAME_EVENT(game, .kind = EVENT_LEAVE, .seat = i);
+        if (i != last) {
+            GAME_EVENT(game, .kind = EVENT_MOVE, .seat = last, .target = i);
+        }
+        game->players[i] = game->players[last];
+        game->seatLinks[i] = game->seatLinks[last];
+        runner->tickets[i] = runner->tickets[last];
+        game->seatLinks[last].fd = -1;
+        game->seatLinks[last].channel = NULL;
+        game->seatLinks[last].gone = false;
+        game->seatLinks[last].buffered = 0;
+
+        // The player who moved into the hole learns the new seat
+        if (i != last) {
+            runner->tickets[i]->seat = i;
+            seatSend(game, i, "SEATED %u %d\n", game->tableId, i);
+        }
+
+        ticket->kind = LOBBY_LEAVE;
+        lobbySubmit(ticket);
+    }
+}
+
+void* runTable(void* argument) {
+    TableRunner* runner = argument;
+    Table* table = runner->table;
+    Game* game = &table->game;
+
+    timerWheelInit(&turnTimers);
+    while (true) {
+        pthread_mutex_lock(&runner->lock);
+        while (runner->arrivals == NULL && game->numPlayers == 0 && !runner->closing) {
+            pthread_cond_wait(&runner->arrived, &runner->lock);
+        }
+        LobbyTicket* arrivals = runner->arrivals;
+        runner->arrivals = NULL;
+        bool closing = runner->closing;
+        pthread_mutex_unlock(&runner->lock);
+
+        // The lobby hands players over newest first, they sit down in the order they joined
+        LobbyTicket* ordered = NULL;
+        while (arrivals != NULL) {
+            LobbyTicket* next = atomic_load_explicit(&arrivals->next, memory_order_relaxed);
+            atomic_store_explicit(&arrivals->next, ordered, memory_order_relaxed);
+            ordered = arrivals;
+            arrivals = next;
+        }
+        while (ordered != NULL) {
+            LobbyTicket* ticket = ordered;
+            ordered = atomic_load_explicit(&ticket->next, memory_order_relaxed);
+
+            if (ticket->kind == LOBBY_WATCH) {
+                broadcastAdd(&runner->broadcast, ticket->fd, ticket->binary, ticket->version);
+                free(ticket);
+                continue;
+            }
+            int seat = game->numPlayers++;
+
+            initializePlayer(&game->players[seat]);
+            snprintf(game->players[seat].name, MAX_NAME_LEN, "%s", ticket->name);
+            game->players[seat].ChipSum = ticket->chips;
+            game->players[seat].showOdds = ticket->odds;
+            game->players[seat].playerId = ticket->playerId;
+            game->seatLinks[seat].fd = ticket->fd;
+            game->seatLinks[seat].channel = ticket->channel;
+            game->seatLinks[seat].gone = false;
+            game->seatLinks[seat].buffered = 0;
+            runner->tickets[seat] = ticket;
+            ticket->seat = seat;
+
+            // Only the table thread knows the seat, the lobby counts claims that may still be on their way
+            seatSend(game, seat, "SEATED %u %d\n", game->tableId, seat);
+            GAME_EVENT(game, .kind = EVENT_SEAT, .seat = seat, .name = game->players[seat].name, .amount = game->players[seat].ChipSum);
+            if (GAME_ANALYZED(game)) {
+                analyzeSit(game, seat);
+            }
+        }
+
+        if (game->numPlayers == 0) {
+            historyRelease();  // Nobody is left to play, the rounds this table packed go before it waits
+            if (closing) {
+                break;
+            }
+            continue;
+        }
+
+        playRound(game);
+        dropLeavers(runner);
+        broadcastFlush(&runner->broadcast);
+        resetRound(game);
+    }
+
+    broadcastClose(&runner->broadcast);
+    table->game.broadcast = NULL;
+    pthread_mutex_destroy(&runner->lock);
+    pthread_cond_destroy(&runner->arrived);
+
+    // From here on the table belongs to the lobby again, and so does the runner to free
+    LobbyTicket* closed = malloc(sizeof(LobbyTicket));
+    if (closed == NULL) {
+        perror("Failed to allocate memory for lobby ticket");
+        exit(EXIT_FAILURE);
+    }
+    closed->kind = LOBBY_CLOSED;
+    closed->table = table;
+    closed->runner = runner;
+    lobbySubmit(closed);
+    return NULL;
+}
+
+// Runs on the lobby thread for every online player it seated
+void serverHandOff(LobbyTicket* ticket) {
+    Table* table = ticket->table;
+
+    // Only tables played online have a thread that can feed spectators, a retired one has none any more
+    if (ticket->kind == LOBBY_WATCH && (table == NULL || table->runner == NULL)) {
+        send(ticket->fd, "ERR no such table\n", 18, MSG_NOSIGNAL);
+        close(ticket->fd);
+        free(ticket);
+        return;
+    }
+
+    if (table->runner == NULL) {
+        serverStartRunner(table);
+    }
+
+    TableRunner* runner = table->runner;
+    pthread_mutex_lock(&runner->lock);
+    atomic_store_explicit(&ticket->next, runner->arrivals, memory_order_relaxed);
+    runner->arrivals = ticket;
+    pthread_cond_signal(&runner->arrived);
+    pthread_mutex_unlock(&runner->lock);
+}
+
+void serverReject(LobbyTicket* ticket, const char* reason) {
+    SeatLink link = {.fd = ticket->fd, .channel = ticket->channel};
+
+    linkWrite(&link, reason, (int) strlen(reason));
+    linkClose(&link);
+    free(ticket);
+}
+
+void serverRetire(Table* table) {
+    TableRunner* runner = table->runner;
+
+    // The lobby lets go of the runner here, its thread frees nothing the lobby still reaches
+    table->runner = NULL;
+    pthread_mutex_lock(&runner->lock);
+    runner->closing = true;
+    pthread_cond_signal(&runner->arrived);
+    pthread_mutex_unlock(&runner->lock);
+}
+
+void serverStartRunner(Table* table) {
+    TableRunner* runner = calloc(1, sizeof(TableRunner));
+    pthread_t thread;
+    if (runner == NULL) {
+        perror("Failed to allocate memory for table runner");
+        exit(EXIT_FAILURE);
+    }
+    runner->table = table;
+    pthread_mutex_init(&runner->lock, NULL);
+    pthread_cond_init(&runner->arrived, NULL);
+    table->game.seatTimers = table->seatTimers;
+    runner->broadcast.game = &table->game;
+    table->game.broadcast = &runner->broadcast;
+    table->runner = runner;
+    if (pthread_create(&thread, NULL, runTable, runner) != 0) {
+        perror("Failed to start table thread");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread);
+}
+
+void serverAdoptTables() {
+    int adopted = 0;
+
+    for (int i = liveTableCount - 1; i >= 0; i--) {
+        Table* table = liveTables[i];
+        Game* game = &table->game;
+        if (!table->online || table->runner != NULL) {
+            continue;
+        }
+
+        // The cards of a round the restart cut short are gone, replay already paid its bets back
+        resetRound(game);
+        table->seatsClaimed = 0;
+        for (int seat = 0; seat < game->numPlayers; seat++) {
+            PlayerAccount* account = registryFind(game->players[seat].playerId);
+            // A snapshot taken while a leaver's seat was being filled can hold the same player twice
+            if (account == NULL || account->held) {
+                continue;
+            }
+            account->balance = game->players[seat].ChipSum;
+            account->tableId = game->tableId;
+            account->held = true;
+            if (account->sessionId == 0) {
+                account->sessionId = ++registry.nextSession;
+            }
+            table->seatsClaimed++;
+            lobby.seatsHeld++;
+        }
+        // Players come back one by one and sit down again through the lobby
+        game->numPlayers = 0;
+        serverStartRunner(table);
+        lobby.tablesOpen++;
+        adopted++;
+
+        if (table->seatsClaimed == 0) {
+            serverRetire(table);
+        } else if (table->seatsClaimed < MAX_PLAYERS) {
+            table->next = lobby.openTables[game->stake];
+            lobby.openTables[game->stake] = table;
+        }
+    }
+    lobby.holdUntil = nowMilliseconds() + SEAT_HOLD_MS;
+
+    if (adopted > 0) {
+        printf("Reopened %d online table(s), %d seat(s) wait for their players\n", adopted, lobby.seatsHeld);
+    }
+}
+
+// Reads the first line of a new connection, JOIN for a player or WATCH for a spectator
+bool gatewayJoin(SeatLink* link) {
+    char line[SEAT_LINK_BUFFER];
+    char name[MAX_NAME_LEN];
+    char option[8] = "";
+    int stake;
+    unsigned int tableId;
+
+    char* end = memchr(link->buffer, '\n', link->buffered);
+    if (end == NULL) {
+        return false;
+    }
+    *end = '\0';
+    snprintf(line, sizeof(line), "%s", link->buffer);
+
+    // Turned away before it costs the lobby anything, the client may try again later
+    if (admissionBusy()) {
+        metricAdd(METRIC_JOINS_SHED, 1);
+        linkWrite(link, "ERR busy\n", 9);
+        linkClose(link);
+        return true;
+    }
+
+    LobbyTicket* ticket = malloc(sizeof(LobbyTicket));
+    if (ticket == NULL) {
+        perror("Failed to allocate memory for lobby ticket");
+        exit(EXIT_FAILURE);
+    }
+    ticket->fd = link->fd;
+    ticket->channel = link->channel;
+    ticket->binary = false;
+    ticket->odds = false;
+    ticket->version = 0;
+
+    // The overlay is asked for by its own token after the stake, a name that starts with ODDS does not count
+    if (sscanf(line, "JOIN %49s %d %7s", name, &stake, option) >= 2 && stake >= STAKE_LOW && stake <= STAKE_HIGH) {
+        snprintf(ticket->name, MAX_NAME_LEN, "%s", name);
+        ticket->stake = (StakeLevel) stake;
+        ticket->chips = (double) STAKE_MIN_BET[stake] * BUY_IN_BETS;
+        ticket->odds = strcmp(option, "ODDS") == 0;
+        if (link->channel == NULL) {
+            int bound = SEAT_SEND_BUFFER;
+            setsockopt(link->fd, SOL_SOCKET, SO_SNDBUF, &bound, sizeof(bound));
+        }
+        lobbyJoin(ticket);
+    } else if (link->channel == NULL && sscanf(line, "WATCH %u", &tableId) == 1) {
+        ticket->kind = LOBBY_WATCH;
+        ticket->tableId = tableId;
+        lobbySubmit(ticket);
+    } else if (link->channel == NULL && sscanf(line, "SYNC %u %llu", &tableId, &ticket->version) == 2) {
+        // A sync client resumes from the last version it applied
+        ticket->kind = LOBBY_WATCH;
+        ticket->tableId = tableId;
+        ticket->binary = true;
+        lobbySubmit(ticket);
+    } else {
+        const char* usage = "ERR JOIN <name> <stake 0-2>, WATCH <table> or SYNC <table> <version>\n";
+        linkWrite(link, usage, strlen(usage));
+        linkClose(link);
+        free(ticket);
+    }
+    return true;
+}
+
+void* runGateway(void* unused) {
+    SeatLink* pending = malloc(GATEWAY_PENDING * sizeof(SeatLink));
+    struct pollfd* fds = malloc((GATEWAY_PENDING + 1) * sizeof(struct pollfd));
+    int count = 0;
+
+    lowerThreadPriority();
+
+    if (pending == NULL || fds == NULL) {
+        perror("Failed to allocate memory for gateway");
+        exit(EXIT_FAILURE);
+    }
+
+    while (atomic_load(&server.running)) {
+        // A full gateway stops accepting until some connection has joined
+        fds[0].fd = count < GATEWAY_PENDING ? server.listenFd : -1;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < count; i++) {
+            fds[i + 1].fd = pending[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        if (poll(fds, count + 1, 100) <= 0) {
+            continue;
+        }
+
+        // Connections still on their JOIN line, walked backwards so a joined one can be swapped out
+        for (int i = count - 1; i >= 0; i--) {
+            if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            SeatLink* link = &pending[i];
+            ssize_t received = recv(link->fd, link->buffer + link->buffered, SEAT_LINK_BUFFER - link->buffered, 0);
+            if (received > 0) {
+                link->buffered += (int) received;
+            }
+            if (received <= 0 || link->buffered == SEAT_LINK_BUFFER) {
+                close(link->fd);
+            } else if (!gatewayJoin(link)) {
+                continue;
+            }
+            pending[i] = pending[--count];
+        }
+
+        if (fds[0].revents & POLLIN) {
+            while (count < GATEWAY_PENDING) {
+                int fd = accept(server.listenFd, NULL, NULL);
+                if (fd < 0) {
+                    break;  // Another gateway took it, or nothing is left to accept
+                }
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                pending[count].fd = fd;
+                pending[count].channel = NULL;
+                pending[count].gone = false;
+                pending[count].buffered = 0;
+                count++;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        close(pending[i].fd);
+    }
+    free(pending);
+    free(fds);
+    return unused;
+}
+
+void* runLobby(void* unused) {
+    // Once the gateways are gone the lobby stays up until every table has given its seats back
+    while (atomic_load(&server.running) || lobby.tablesOpen > 0) {
+        unsigned long long now = nowMilliseconds();
+        if (lobby.seatsHeld > 0 && (!atomic_load(&server.running) || now >= lobby.holdUntil)) {
+            lobbyReleaseHolds();
+        }
+        // The lobby owns the tables registry and the wallets, so the forked writer sees both whole
+        if (atomic_load(&server.running) && now >= lobby.nextSnapshot) {
+            snapshotTablesInBackground(SNAPSHOT_PATH);
+            lobby.nextSnapshot = now + LOBBY_SNAPSHOT_MS;
+        }
+
+        if (lobbyDrain(LOBBY_BATCH) == 0) {
+            // An idle lobby still measures, by how late it wakes up, so a host that sheds every join can open again
+            unsigned long long started = nowMicroseconds();
+            if (!lobbyWait(100)) {
+                unsigned long long slept = nowMicroseconds() - started;
+                admissionSample(slept > 100000 ? slept - 100000 : 0);
+            }
+        }
+    }
+    return unused;
+}
+
+bool ringWrite(LocalRing* ring, const char* data, int length) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (LOCAL_RING_SIZE - (tail - head) < (unsigned int) length) {
+        return false;
+    }
+    unsigned int start = tail & (LOCAL_RING_SIZE - 1);
+    int first = LOCAL_RING_SIZE - (int) start < length ? LOCAL_RING_SIZE - (int) start : length;
+    memcpy(ring->data + start, data, first);
+    memcpy(ring->data, data + first, length - first);
+
+    // The reader sees the new tail only after the bytes behind it
+    atomic_store_explicit(&ring->tail, tail + length, memory_order_release);
+    ringWake(ring);
+    return true;
+}
+
+int ringRead(LocalRing* ring, char* out, int room) {
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    int length = (int) (tail - head) < room ? (int) (tail - head) : room;
+
+    if (length == 0) {
+        return 0;
+    }
+    unsigned int start = head & (LOCAL_RING_SIZE - 1);
+    int first = LOCAL_RING_SIZE - (int) start < length ? LOCAL_RING_SIZE - (int) start : length;
+    memcpy(out, ring->data + start, first);
+    memcpy(out + first, ring->data, length - first);
+
+    // The writer may reuse the bytes once the new head is visible
+    atomic_store_explicit(&ring->head, head + length, memory_order_release);
+    return length;
+}
+
+bool linkWrite(SeatLink* link, const char* data, int length) {
+    if (link->channel != NULL) {
+        return ringWrite(&link->channel->toClient, data, length);  // A client that lets its ring fill up is not reading
+    }
+
+    // A table thread never waits on one slow client, a line that does not fit whole drops it
+    return send(link->fd, data, length, MSG_NOSIGNAL | MSG_DONTWAIT) == length;
+}
+
+void linkClose(SeatLink* link) {
+    if (link->channel != NULL) {
+        localRelease(link->channel);
+        link->channel = NULL;
+    } else {
+        close(link->fd);
+    }
+}
+
+int localReceive(SeatLink* link, Timer* timer) {
+    LocalChannel* channel = link->channel;
+    char* out = link->buffer + link->buffered;
+    int room = SEAT_LINK_BUFFER - link->buffered;
+    unsigned long long checkedAt = nowMilliseconds();
+
+    // Spinning keeps a quick client off the syscall path, a slow one sleeps until the client writes
+    for (long polls = 0; ; polls++) {
+        int received = ringRead(&channel->toGame, out, room);
+        if (received > 0) {
+            return received;
+        }
+        if (polls < localSpins) {
+            CPU_RELAX();
+            continue;
+        }
+
+        // A dead client never wakes the table, so the sleep is cut short to look after it
+        int timeoutMs = timerWheelNextTimeout(&turnTimers);
+        ringSleep(channel, &channel->toGame, timeoutMs >= 0 && timeoutMs < LOCAL_CHECK_MS ? timeoutMs : LOCAL_CHECK_MS);
+        timerWheelAdvance(&turnTimers, nowMilliseconds());
+        if (timer != NULL && timer->expired) {
+            return 0;
+        }
+        if (atomic_load_explicit(&channel->hangUps, memory_order_acquire) > 0) {
+            received = ringRead(&channel->toGame, out, room);  // The last lines before the hang up still count
+            return received > 0 ? received : -1;
+        }
+        if (nowMilliseconds() - checkedAt >= LOCAL_CHECK_MS) {
+            checkedAt = nowMilliseconds();
+            if (!localClientAlive(channel)) {
+                return -1;
+            }
+        }
+    }
+}
+
+void ringSleep(LocalChannel* channel, LocalRing* ring, int timeoutMs) {
+    unsigned int seen = atomic_load_explicit(&ring->head, memory_order_relaxed);  // Only the reader moves head
+
+#ifdef LOCAL_FUTEX
+    struct timespec timeout = {timeoutMs / 1000, (long) (timeoutMs % 1000) * 1000000L};
+
+    // The flag goes up before the ring is looked at again, so a write either is seen here or wakes the futex
+    atomic_store(&ring->sleeping, 1);
+    if (atomic_load(&ring->tail) == seen && atomic_load(&channel->hangUps) == 0) {
+        syscall(SYS_futex, &ring->tail, FUTEX_WAIT, seen, timeoutMs >= 0 ? &timeout : NULL, NULL, 0);
+    }
+    atomic_store_explicit(&ring->sleeping, 0, memory_order_relaxed);
+#else
+    (void) channel;
+    (void) timeoutMs;
+    if (atomic_load_explicit(&ring->tail, memory_order_acquire) == seen) {
+        sched_yield();
+    }
+#endif
+}
+
+void ringWake(LocalRing* ring) {
+#ifdef LOCAL_FUTEX
+    // Pairs with the flag the reader raises before it looks at tail one last time
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->sleeping, memory_order_relaxed) != 0) {
+        syscall(SYS_futex, &ring->tail, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+#else
+    (void) ring;
+#endif
+}
+
+bool localClientAlive(LocalChannel* channel) {
+    return kill(channel->clientPid, 0) == 0 || errno != ESRCH;
+}
+
+void localHangUp(LocalChannel* channel) {
+    if (atomic_fetch_add(&channel->hangUps, 1) == 1) {
+        atomic_store_explicit(&channel->state, LOCAL_FREE, memory_order_release);
+    }
+
+    // A side asleep on its ring learns of the hang up now rather than at its next check
+    ringWake(&channel->toGame);
+    ringWake(&channel->toClient);
+}
+
+void localRelease(LocalChannel* channel) {
+    atomic_store(&channel->gameDone, true);
+    if (atomic_fetch_add(&channel->hangUps, 1) == 1) {
+        atomic_store_explicit(&channel->state, LOCAL_FREE, memory_order_release);
+    } else if (!localClientAlive(channel)) {
+        int state = atomic_load(&channel->state);
+        atomic_compare_exchange_strong(&channel->state, &state, LOCAL_FREE);  // The client will never hang up
+    } else {
+        ringWake(&channel->toClient);
+    }
+}
+
+void localReap() {
+    for (int i = 0; i < LOCAL_CHANNELS; i++) {
+        LocalChannel* channel = &localTransport->channels[i];
+        int state = atomic_load_explicit(&channel->state, memory_order_acquire);
+
+        // An open channel belongs to the gateway, a playing one only once its table let go of it
+        bool unowned = state == LOCAL_OPEN || (state == LOCAL_PLAYING && atomic_load(&channel->gameDone));
+        if (unowned && !localClientAlive(channel)) {
+            atomic_compare_exchange_strong(&channel->state, &state, LOCAL_FREE);
+        }
+    }
+}
+
+// Tells whether the shared memory name is held by a process that is gone, or by nothing this build can read
+bool localStale() {
+    int fd = shm_open(LOCAL_SHM_NAME, O_RDWR, 0);
+    struct stat info;
+
+    if (fd < 0) {
+        return errno == ENOENT;  // Unlinked in the meantime
+    }
+    bool stale = fstat(fd, &info) == 0 && info.st_size < (off_t) offsetof(LocalTransport, channels);
+    if (!stale) {
+        LocalTransport* old = mmap(NULL, offsetof(LocalTransport, channels), PROT_READ, MAP_SHARED, fd, 0);
+        if (old != MAP_FAILED) {
+            stale = old->serverPid <= 0 || (kill(old->serverPid, 0) != 0 && errno == ESRCH);
+            munmap(old, offsetof(LocalTransport, channels));
+        }
+    }
+    close(fd);
+    return stale;
+}
+
+bool localOpen() {
+    // Another game on this machine keeps its clients, only an object its creator left behind is replaced
+    int fd = shm_open(LOCAL_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST && localStale()) {
+        shm_unlink(LOCAL_SHM_NAME);
+        fd = shm_open(LOCAL_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (fd < 0 && errno == EEXIST) {
+        printf("Another game serves the local clients of this machine, this one only takes connections.\n");
+        return false;
+    }
+    if (fd < 0 || ftruncate(fd, sizeof(LocalTransport)) != 0) {
+        perror("Failed to create shared memory for local clients");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    localTransport = mmap(NULL, sizeof(LocalTransport), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (localTransport == MAP_FAILED) {
+        perror("Failed to map shared memory for local clients");
+        localTransport = NULL;
+        return false;
+    }
+
+    localSpins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? LOCAL_SPINS : 0;
+
+    // A fresh object is all zeros, so every channel starts out free
+    localTransport->version = LOCAL_VERSION;
+    localTransport->serverPid = (int) getpid();
+    memcpy(localTransport->magic, LOCAL_MAGIC, sizeof(LOCAL_MAGIC));
+    return true;
+}
+
+void localClose() {
+    if (localTransport == NULL) {
+        return;
+    }
+    shm_unlink(LOCAL_SHM_NAME);  // Clients still attached keep their mapping until they let go of it
+    munmap(localTransport, sizeof(LocalTransport));
+    localTransport = NULL;
+}
+
+// Hands the JOIN line of every newly opened channel to the same parser as the sockets
+void* runLocalGateway(void* unused) {
+    SeatLink* pending = calloc(LOCAL_CHANNELS, sizeof(SeatLink));
+
+    if (pending == NULL) {
+        perror("Failed to allocate memory for local gateway");
+        exit(EXIT_FAILURE);
+    }
+    lowerThreadPriority();
+    unsigned long long reapedAt = nowMilliseconds();
+
+    while (atomic_load(&server.running)) {
+        bool busy = false;
+
+        for (int i = 0; i < LOCAL_CHANNELS; i++) {
+            LocalChannel* channel = &localTransport->channels[i];
+            SeatLink* link = &pending[i];
+
+            if (atomic_load_explicit(&channel->state, memory_order_acquire) != LOCAL_OPEN) {
+                continue;
+            }
+            if (link->channel != channel) {
+                link->fd = -1;
+                link->channel = channel;
+                link->gone = false;
+                link->buffered = 0;
+            }
+            if (atomic_load_explicit(&channel->hangUps, memory_order_acquire) > 0) {
+                localRelease(channel);  // Gone before it joined
+                link->channel = NULL;
+                continue;
+            }
+
+            int received = ringRead(&channel->toGame, link->buffer + link->buffered, SEAT_LINK_BUFFER - link->buffered);
+            if (received == 0) {
+                continue;
+            }
+            busy = true;
+            link->buffered += received;
+            if (link->buffered == SEAT_LINK_BUFFER) {
+                linkClose(link);
+            } else if (gatewayJoin(link)) {
+                atomic_store_explicit(&channel->state, LOCAL_PLAYING, memory_order_release);
+                link->channel = NULL;
+            }
+        }
+
+        // Joining is not on the fast path, an idle gateway sleeps between sweeps
+        if (!busy) {
+            Sleep(1);
+        }
+        if (nowMilliseconds() - reapedAt >= LOCAL_CHECK_MS) {
+            localReap();
+            reapedAt = nowMilliseconds();
+        }
+    }
+
+    // Clients that never got to join are told the tables closed
+    for (int i = 0; i < LOCAL_CHANNELS; i++) {
+        LocalChannel* channel = &localTransport->channels[i];
+        if (atomic_load_explicit(&channel->state, memory_order_acquire) == LOCAL_OPEN) {
+            localRelease(channel);
+        }
+    }
+    free(pending);
+    return unused;
+}
+
+LocalChannel* localConnect() {
+    int fd = shm_open(LOCAL_SHM_NAME, O_RDWR, 0);
+    if (fd < 0) {
+        printf("No online tables are open on this machine.\n");
+        return NULL;
+    }
+    localTransport = mmap(NULL, sizeof(LocalTransport), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (localTransport == MAP_FAILED) {
+        perror("Failed to map shared memory of the online tables");
+        localTransport = NULL;
+        return NULL;
+    }
+    if (memcmp(localTransport->magic, LOCAL_MAGIC, sizeof(LOCAL_MAGIC)) != 0 || localTransport->version != LOCAL_VERSION) {
+        printf("The online tables on this machine run another version.\n");
+        munmap(localTransport, sizeof(LocalTransport));
+        localTransport = NULL;
+        return NULL;
+    }
+
+    localSpins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? LOCAL_SPINS : 0;
+    for (int i = 0; i < LOCAL_CHANNELS; i++) {
+        LocalChannel* channel = &localTransport->channels[i];
+        int expected = LOCAL_FREE;
+        if (!atomic_compare_exchange_strong(&channel->state, &expected, LOCAL_CLAIMING)) {
+            continue;
+        }
+
+        // Nobody else looks at a claiming channel, so plain resets are safe before it opens
+        atomic_store_explicit(&channel->toGame.head, 0, memory_order_relaxed);
+        atomic_store_explicit(&channel->toGame.tail, 0, memory_order_relaxed);
+        atomic_store_explicit(&channel->toClient.head, 0, memory_order_relaxed);
+        atomic_store_explicit(&channel->toClient.tail, 0, memory_order_relaxed);
+        atomic_store_explicit(&channel->hangUps, 0, memory_order_relaxed);
+        atomic_store_explicit(&channel->gameDone, false, memory_order_relaxed);
+        channel->clientPid = (int) getpid();
+        atomic_store_explicit(&channel->state, LOCAL_OPEN, memory_order_release);
+        return channel;
+    }
+
+    printf("Every local seat is taken.\n");
+    munmap(localTransport, sizeof(LocalTransport));
+    localTransport = NULL;
+    return NULL;
+}
+
+// Reads one line the game sent, false once the game hung up and nothing is left
+bool localReadLine(LocalChannel* channel, SeatLink* link, char* line, int size) {
+    while (true) {
+        char* end = memchr(link->buffer, '\n', link->buffered);
+        if (end != NULL) {
+            int length = (int) (end - link->buffer) < size - 1 ? (int) (end - link->buffer) : size - 1;
+            memcpy(line, link->buffer, length);
+            line[length] = '\0';
+            link->buffered -= (int) (end - link->buffer) + 1;
+            memmove(link->buffer, end + 1, link->buffered);
+            return true;
+        }
+
+        char* out = link->buffer + link->buffered;
+        int room = SEAT_LINK_BUFFER - link->buffered;
+        int received;
+        for (long polls = 1; (received = ringRead(&channel->toClient, out, room)) == 0; polls++) {
+            if (polls < localSpins) {
+                CPU_RELAX();
+                continue;
+            }
+            // The last lines before a hang up are still read
+            if (atomic_load_explicit(&channel->hangUps, memory_order_acquire) > 0) {
+                received = ringRead(&channel->toClient, out, room);
+                if (received == 0) {
+                    return false;
+                }
+                break;
+            }
+            ringSleep(channel, &channel->toClient, -1);
+        }
+        link->buffered += received;
+    }
+}
+
+bool localSendLine(LocalChannel* channel, const char* line) {
+    int length = (int) strlen(line);
+
+    // The game drains its ring on every read, a full ring only means it has not got to it yet
+    while (!ringWrite(&channel->toGame, line, length)) {
+        if (atomic_load_explicit(&channel->hangUps, memory_order_acquire) > 0) {
+            return false;
+        }
+        sched_yield();
+    }
+    return true;
+}
+#endif
+
+void playLocalKiosk() {
+#ifdef _WIN32
+    printf("Local tables need a POSIX system.\n");
+#else
+    char name[MAX_NAME_LEN];
+    char line[SEAT_LINK_BUFFER];
+    char request[SEAT_LINK_BUFFER];
+    SeatLink link = {.fd = -1};
+    int stake;
+    char odds = 'n';
+
+    LocalChannel* channel = localConnect();
+    if (channel == NULL) {
+        return;
+    }
+    printf("insert your name: ");
+    scanf("%49s", name);
+    printf("insert the stake (0 Low, 1 Mid, 2 High): ");
+    scanf("%d", &stake);
+    printf("show the odds overlay before every decision? (y/n): ");
+    scanf(" %c", &odds);
+    snprintf(request, sizeof(request), "JOIN %s %d%s\n", name, stake, odds == 'y' || odds == 'Y' ? " ODDS" : "");
+    localSendLine(channel, request);
+
+    // The kiosk shows each prompt of the protocol and answers it from the keyboard
+    while (localReadLine(channel, &link, line, sizeof(line))) {
+        double balance;
+        int minimum, total, soft, upcard, seat;
+        unsigned int tableId;
+        char options[8];
+        HandOdds shown;
+
+        if (sscanf(line, "SEATED %u %d", &tableId, &seat) == 2) {
+            printf("Seated at table %u, seat %d.\n", tableId, seat + 1);
+        } else if (sscanf(line, "BET? %lf %d", &balance, &minimum) == 2) {
+            double bet = 0;
+            printf("Balance: %.2f. Enter your bet (smallest %d, 0 to leave): ", balance, minimum);
+            scanf("%lf", &bet);
+            if (bet <= 0) {
+                snprintf(request, sizeof(request), "LEAVE\n");
+            } else {
+                snprintf(request, sizeof(request), "BET %.2f\n", bet);
+            }
+            localSendLine(channel, request);
+        } else if (sscanf(line, "ACT? %d %d %d %7s", &total, &soft, &upcard, options) == 4) {
+            const char* plays[] = {"HIT", "STAND", "DOUBLE", "SPLIT", "SURRENDER"};
+            const char* letters = "hsdpr";
+            char choice = 's';
+            printf("Your %s %d against the dealer's %d. Play (%s): ", soft ? "soft" : "hard", total, upcard, options);
+            scanf(" %c", &choice);
+            const char* letter = strchr(letters, choice);
+            snprintf(request, sizeof(request), "%s\n", letter != NULL && *letter != '\0' ? plays[letter - letters] : "STAND");
+            localSendLine(channel, request);
+        } else if (sscanf(line, "ODDS %lf %lf %lf %lf %lf %lf %lf %lf", &shown.bust, &shown.dealer[DEALER_17], &shown.dealer[DEALER_18],
+                          &shown.dealer[DEALER_19], &shown.dealer[DEALER_20], &shown.dealer[DEALER_21],
+                          &shown.dealer[DEALER_BLACKJACK], &shown.dealer[DEALER_BUST]) == 8) {
+            printOdds(&shown);
+        } else if (sscanf(line, "DONE %d", &total) == 1) {
+            printf("Hand over with %d.\n", total);
+        } else if (sscanf(line, "RESULT %lf", &balance) == 1) {
+            printf("Round settled, balance %.2f.\n", balance);
+        } else if (strncmp(line, "BYE", 3) == 0) {
+            break;
+        } else {
+            printf("%s\n", line);  // OK and ERR lines
+        }
+    }
+
+    printf("You left the table.\n");
+    localHangUp(channel);
+    munmap(localTransport, sizeof(LocalTransport));
+    localTransport = NULL;
+#endif
+}
+
+bool startServer(int port, bool everyInterface) {
+#ifdef _WIN32
+    printf("Online tables need a POSIX system.\n");
+    return false;
+#else
+    struct sockaddr_in address;
+    int on = 1;
+
+    server.listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server.listenFd < 0) {
+        perror("Failed to open server socket");
+        return false;
+    }
+    setsockopt(server.listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    fcntl(server.listenFd, F_SETFL, fcntl(server.listenFd, F_GETFL) | O_NONBLOCK);
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    // Nothing proves who sends a name, so the port stays on this machine unless the host opens it up
+    address.sin_addr.s_addr = htonl(everyInterface ? INADDR_ANY : INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (bind(server.listenFd, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(server.listenFd, 4096) != 0) {
+        perror("Failed to open server port");
+        close(server.listenFd);
+        server.listenFd = -1;
+        return false;
+    }
+
+    // The analyzer is up before the first table can push to it
+    analyzerStart(ALERT_PATH);
+
+    // While the server runs the lobby thread owns the live tables registry
+    lobbyInit();
+    lobby.handOff = serverHandOff;
+    lobby.retire = serverRetire;
+    lobby.reject = serverReject;
+    server.port = port;
+    atomic_store(&server.running, true);
+    serverAdoptTables();
+
+    if (pthread_create(&server.lobbyThread, NULL, runLobby, NULL) != 0) {
+        perror("Failed to start lobby thread");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < SERVER_GATEWAYS; i++) {
+        if (pthread_create(&server.gateways[i], NULL, runGateway, NULL) != 0) {
+            perror("Failed to start gateway thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Clients on this machine can skip the sockets, the tables stay open over TCP without them
+    if (localOpen() && pthread_create(&server.localGateway, NULL, runLocalGateway, NULL) != 0) {
+        perror("Failed to start local gateway thread");
+        exit(EXIT_FAILURE);
+    }
+
+    // The tables play on without a dashboard if the metrics port is taken
+    metricsStart(METRICS_PORT);
+    return true;
+#endif
+}
+
+void stopServer() {
+#ifndef _WIN32
+    if (server.listenFd < 0) {
+        return;
+    }
+
+    atomic_store(&server.running, false);
+    for (int i = 0; i < SERVER_GATEWAYS; i++) {
+        pthread_join(server.gateways[i], NULL);
+    }
+    if (localTransport != NULL) {
+        pthread_join(server.localGateway, NULL);
+    }
+
+    // Idle tables have nobody to drop, wake their threads so they see the server is closing
+    pthread_mutex_lock(&lobby.lock);
+    pthread_cond_signal(&lobby.wakeUp);
+    pthread_mutex_unlock(&lobby.lock);
+    pthread_join(server.lobbyThread, NULL);
+
+    close(server.listenFd);
+    server.listenFd = -1;
+    localClose();
+    analyzerStop();  // No table is left to push
+    metricsStop();
+    historyFlush();  // Every table has played its last round
+    saveTables(SNAPSHOT_PATH);  // The wallets of everyone who just left
+    lobby.handOff = NULL;
+    lobby.retire = NULL;
+    lobby.reject = NULL;
+#endif
+}
+
+void metricsDetach(void* block) {
+    atomic_store_explicit(&((EngineMetrics*) block)->inUse, false, memory_order_release);
+}
+
+void metricsCreateKey() {
+    pthread_key_create(&metrics.threadKey, metricsDetach);
+}
+
+EngineMetrics* metricsAttach() {
+    EngineMetrics* block;
+
+    pthread_once(&metrics.once, metricsCreateKey);
+    pthread_mutex_lock(&metrics.lock);
+    for (block = metrics.blocks; block != NULL; block = block->next) {
+        if (!atomic_load_explicit(&block->inUse, memory_order_acquire)) {
+            break;  // A thread that ended left its counters here, they keep adding up
+        }
+    }
+    if (block == NULL) {
+        block = aligned_alloc(64, sizeof(EngineMetrics));
+        if (block == NULL) {
+            perror("Failed to allocate memory for metrics");
+            exit(EXIT_FAILURE);
+        }
+        memset(block, 0, sizeof(EngineMetrics));
+        block->next = metrics.blocks;
+        metrics.blocks = block;
+    }
+    atomic_store_explicit(&block->inUse, true, memory_order_relaxed);
+    pthread_mutex_unlock(&metrics.lock);
+
+    pthread_setspecific(metrics.threadKey, block);
+    threadMetrics = block;
+    return block;
+}
+
+void metricAdd(MetricId metric, unsigned long long amount) {
+    EngineMetrics* block = threadMetrics != NULL ? threadMetrics : metricsAttach();
+    _Atomic unsigned long long* counter = &block->counters[metric];
+
+    // One writer per block, so a plain load and store are enough and the scrape never sees a torn value
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+void metricDecision(unsigned long long micros) {
+    EngineMetrics* block = threadMetrics != NULL ? threadMetrics : metricsAttach();
+    int bucket = 0;
+
+    while (bucket < DECISION_BUCKETS - 1 && micros > DECISION_BOUNDS[bucket]) {
+        bucket++;
+    }
+    atomic_store_explicit(&block->decisions[bucket], atomic_load_explicit(&block->decisions[bucket], memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&block->decisionMicros, atomic_load_explicit(&block->decisionMicros, memory_order_relaxed) + micros, memory_order_relaxed);
+}
+
+int metricsRender(char* out, int size) {
+    static const char* names[METRIC_COUNT] = {
+#define METRIC_NAME(id, name, ...) name,
+        METRIC_LIST(METRIC_NAME)
+    };
+    static const char* helps[METRIC_COUNT] = {
+#define METRIC_HELP(id, name, help, ...) help,
+        METRIC_LIST(METRIC_HELP)
+    };
+    static const int divisors[METRIC_COUNT] = {
+#define METRIC_DIVISOR(id, name, help, divisor) divisor,
+        METRIC_LIST(METRIC_DIVISOR)
+    };
+    unsigned long long totals[METRIC_COUNT] = {0};
+    unsigned long long decisions[DECISION_BUCKETS] = {0};
+    unsigned long long decisionMicros = 0;
+    int length = 0;
+
+    pthread_mutex_lock(&metrics.lock);
+    for (EngineMetrics* block = metrics.blocks; block != NULL; block = block->next) {
+        for (int m = 0; m < METRIC_COUNT; m++) {
+            totals[m] += atomic_load_explicit(&block->counters[m], memory_order_relaxed);
+        }
+        for (int b = 0; b < DECISION_BUCKETS; b++) {
+            decisions[b] += atomic_load_explicit(&block->decisions[b], memory_order_relaxed);
+        }
+        decisionMicros += atomic_load_explicit(&block->decisionMicros, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&metrics.lock);
+
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        length += snprintf(out + length, size - length, "# HELP %s %s\n# TYPE %s counter\n", names[m], helps[m], names[m]);
+        if (divisors[m] == 1) {
+            length += snprintf(out + length, size - length, "%s %llu\n", names[m], totals[m]);
+        } else {
+            length += snprintf(out + length, size - length, "%s %.2f\n", names[m], (double) totals[m] / divisors[m]);
+        }
+    }
+
+    // Prometheus buckets count everything at or below their bound
+    unsigned long long cumulative = 0;
+    length += snprintf(out + length, size - length,
+                       "# HELP blackjack_decision_seconds Time a seat took to choose a play\n# TYPE blackjack_decision_seconds histogram\n");
+    for (int b = 0; b < DECISION_BUCKETS; b++) {
+        cumulative += decisions[b];
+        if (b < DECISION_BUCKETS - 1) {
+            length += snprintf(out + length, size - length, "blackjack_decision_seconds_bucket{le=\"%g\"} %llu\n", DECISION_BOUNDS[b] / 1e6, cumulative);
+        } else {
+            length += snprintf(out + length, size - length, "blackjack_decision_seconds_bucket{le=\"+Inf\"} %llu\n", cumulative);
+        }
+    }
+    length += snprintf(out + length, size - length, "blackjack_decision_seconds_sum %.6f\nblackjack_decision_seconds_count %llu\n",
+                       decisionMicros / 1e6, cumulative);
+    return length < size ? length : size - 1;
+}
+
+#ifndef _WIN32
+void metricsServe(int fd) {
+    char request[1024];
+    char body[8192];
+    char header[256];
+    int received = 0;
+    struct pollfd input = {fd, POLLIN, 0};
+
+    // A scraper sends its whole request at once, one that dawdles is dropped
+    while (received < (int) sizeof(request) - 1 && poll(&input, 1, 1000) > 0) {
+        ssize_t got = recv(fd, request + received, sizeof(request) - 1 - received, 0);
+        if (got <= 0) {
+            break;
+        }
+        received += (int) got;
+        request[received] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) {
+            break;
+        }
+    }
+    request[received] = '\0';
+
+    int length;
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0) {
+        length = metricsRender(body, sizeof(body));
+        int headerLength = snprintf(header, sizeof(header),
+                                    "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", length);
+        send(fd, header, headerLength, MSG_NOSIGNAL);
+        send(fd, body, length, MSG_NOSIGNAL);
+    } else {
+        const char* notFound = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        send(fd, notFound, strlen(notFound), MSG_NOSIGNAL);
+    }
+    close(fd);
+}
+
+void* runMetricsServer(void* unused) {
+    while (atomic_load(&metrics.running)) {
+        struct pollfd input = {metrics.listenFd, POLLIN, 0};
+        if (poll(&input, 1, 100) <= 0) {
+            continue;
+        }
+        int fd = accept(metrics.listenFd, NULL, NULL);
+        if (fd >= 0) {
+            metricsServe(fd);
+        }
+    }
+    return unused;
+}
+#endif
+
+bool metricsStart(int port) {
+#ifdef _WIN32
+    return false;
+#else
+    struct sockaddr_in address;
+    int on = 1;
+
+    metrics.listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (metrics.listenFd < 0) {
+        perror("Failed to open metrics socket");
+        return false;
+    }
+    setsockopt(metrics.listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // Dashboards scrape it from this machine
+    address.sin_port = htons(port);
+    if (bind(metrics.listenFd, (struct sockaddr*) &address, sizeof(address)) != 0 || listen(metrics.listenFd, 16) != 0) {
+        perror("Failed to open metrics port");
+        close(metrics.listenFd);
+        metrics.listenFd = -1;
+        return false;
+    }
+
+    atomic_store(&metrics.running, true);
+    if (pthread_create(&metrics.thread, NULL, runMetricsServer, NULL) != 0) {
+        perror("Failed to start metrics thread");
+        exit(EXIT_FAILURE);
+    }
+    return true;
+#endif
+}
+
+void metricsStop() {
+#ifndef _WIN32
+    if (metrics.listenFd < 0) {
+        return;
+    }
+    atomic_store(&metrics.running, false);
+    pthread_join(metrics.thread, NULL);
+    close(metrics.listenFd);
+    metrics.listenFd = -1;
+#endif
+}
+
+// Claims the next slot with one compare and swap, a full ring drops the record rather than hold up a round
+void analyzerPush(const AnalyzerRecord* record) {
+    unsigned long long position = atomic_load_explicit(&analyzer.tail, memory_order_relaxed);
+
+    while (true) {
+        AnalyzerSlot* slot = &analyzer.ring[position & (ANALYZER_RING - 1)];
+        unsigned long long sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+
+        if (sequence == position) {
+            if (atomic_compare_exchange_weak_explicit(&analyzer.tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                slot->record = *record;
+                atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+                return;
+            }
+        } else if (sequence < position) {
+            metricAdd(METRIC_ANALYZER_LOST, 1);  // The analyzer is a whole ring behind
+            return;
+        } else {
+            position = atomic_load_explicit(&analyzer.tail, memory_order_relaxed);
+        }
+    }
+}
+
+bool analyzerPop(AnalyzerRecord* record) {
+    AnalyzerSlot* slot = &analyzer.ring[analyzer.head & (ANALYZER_RING - 1)];
+
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != analyzer.head + 1) {
+        return false;
+    }
+    *record = slot->record;
+    atomic_store_explicit(&slot->sequence, analyzer.head + ANALYZER_RING, memory_order_release);
+    analyzer.head++;
+    return true;
+}
+
+void analyzeSit(Game* game, int seat) {
+    AnalyzerRecord record = {.kind = ANALYZE_SIT, .tableId = game->tableId};
+
+    record.key = registryNameHash(game->players[seat].name);
+    snprintf(record.name, MAX_NAME_LEN, "%s", game->players[seat].name);
+    for (int i = 0; i < game->numPlayers; i++) {
+        if (i != seat) {
+            record.mates[record.mateCount++] = registryNameHash(game->players[i].name);
         }
-        deck->deckSize--;  // Reduce the logical size of the deck
     }
+    analyzerPush(&record);
 }
 
-void InsertToDeck(Game* game, Card* card) {
-    Deck* deck = game->board->deck;
+void analyzeBet(Game* game, Player* player, double betAmount) {
+    AnalyzerRecord record = {.kind = ANALYZE_BET, .tableId = game->tableId};
 
-    // Insert card at the end of the current deck size
-    deck->cards[deck->deckSize] = *card;
-    deck->deckSize++;  // Increase the logical size of the deck
+    record.key = registryNameHash(player->name);
+    record.trueCount = (signed char) getTrueCount(game->board);
+    record.units = (float) (betAmount / STAKE_MIN_BET[game->stake]);
+    analyzerPush(&record);
 }
 
-void printCard(Card* card){
-    // Check if the card is red or black
-    if (card->Color == RED) {
-        printf(ANSI_COLOR_RED);  // Set text color to red for red cards
+void analyzePlay(Game* game, Player* player, Hand* hand, bool canSplit, Decision action) {
+    AnalyzerRecord record = {.kind = ANALYZE_PLAY, .tableId = game->tableId, .play = (unsigned char) action};
+    bool soft;
+
+    // The same lookup a house bot makes, so the analyzer can tell which chart the play came from
+    record.key = registryNameHash(player->name);
+    record.trueCount = (signed char) getTrueCount(game->board);
+    record.upcard = (unsigned char) cardPoints(&game->board->dealerCards[0]);
+    if (canSplit) {
+        record.handKind = HAND_PAIR;
+        record.total = (unsigned char) cardPoints(&hand->card[0]);
+    } else {
+        record.total = (unsigned char) calculateSoftScore(hand->card, hand->countCard, &soft);
+        record.handKind = soft ? HAND_SOFT : HAND_HARD;
     }
-
-    // Print card information in a box with regular characters
-    printf("+---------------+\n");
-    printf("| %-13s |\n", VALUE_NAMES[card->Value]);
-    printf("| %-13s |\n", SUIT_NAMES[card->Suit]);
-    printf("| Color: %-6s |\n", COLOR_NAMES[card->Color]);
-    printf("+---------------+\n");
-
-    // Reset the color for subsequent text
-    printf(ANSI_COLOR_RESET);
+    analyzerPush(&record);
 }
 
-int calculateScore(Card* cards, int cardCount) {
-    int score = 0;
-    int aces = 0;  // Track number of Aces to adjust value as 1 or 11
+void analyzeResults(Game* game) {
+    for (int i = 0; i < game->numPlayers; i++) {
+        AnalyzerRecord record = {.kind = ANALYZE_RESULT, .tableId = game->tableId};
 
-    for (int i = 0; i < cardCount; i++) {
-        if (cards[i].Value >= TWO && cards[i].Value <= TEN) {
-            score += cards[i].Value + 1;  // Add face value of cards (TWO is 1, etc.)
-        } else if (cards[i].Value >= JACK && cards[i].Value <= KING) {
-            score += 10;  // Face cards are worth 10 points
-        } else if (cards[i].Value == ACE) {
-            score += 11;  // Initially, count Ace as 11
-            aces++;
+        record.key = registryNameHash(game->players[i].name);
+        for (int h = 0; h < game->players[i].handCount; h++) {
+            Hand* hand = &game->players[i].hands[h];
+            record.play = hand->isTie ? OUTCOME_TIE : hand->isLost ? OUTCOME_LOSE : OUTCOME_WIN;
+            analyzerPush(&record);
         }
     }
+}
 
-    // Adjust score for Aces if score > 21
-    while (score > 21 && aces > 0) {
-        score -= 10;  // Reduce 11 to 1 for an Ace
-        aces--;
+PlayerProfile* analyzerProfile(unsigned int key) {
+    unsigned int first = (unsigned int) (mixSeed(key) >> 32) & (ANALYZER_PROFILES - 1);
+    PlayerProfile* oldest = NULL;
+
+    for (int probe = 0; probe < ANALYZER_PROBES; probe++) {
+        PlayerProfile* profile = &analyzer.profiles[(first + probe) & (ANALYZER_PROFILES - 1)];
+        if (profile->key == key) {
+            profile->lastSeen = analyzer.clock;
+            return profile;
+        }
+        if (profile->key == 0) {
+            oldest = profile;
+            break;
+        }
+        if (oldest == NULL || profile->lastSeen < oldest->lastSeen) {
+            oldest = profile;
+        }
     }
 
-    return score;
+    // Memory stays fixed, the player unseen the longest is forgotten
+    memset(oldest, 0, sizeof(PlayerProfile));
+    oldest->key = key;
+    oldest->lastSeen = analyzer.clock;
+    return oldest;
 }
 
-void DetermineWinner(Game* game) {
-
-    int dealerScore = calculateScore(game->board->dealerCards, game->board->dealCardCount);  // Using dealer's actual card count
-    printf("Dealer Score: %d\n", dealerScore);
-
-    bool dealerBust = (dealerScore > 21);
+void hllAdd(unsigned char* registers, unsigned int key) {
+    unsigned long long hash = mixSeed(key);
+    int index = (int) (hash >> 58);  // The top six bits pick one of the 64 registers
+    unsigned long long rest = hash << 6;
+    unsigned char rank = rest == 0 ? 59 : (unsigned char) (__builtin_clzll(rest) + 1);
 
-    if(dealerScore > 21)
-        {
-            printf("Dealer Busts!!! \n");
-        }
+    if (rank > registers[index]) {
+        registers[index] = rank;
+    }
+}
 
-    // Loop through each player to calculate their scores and determine the result
-    for (int i = 0; i < game->numPlayers; i++) {
+double hllEstimate(const unsigned char* registers) {
+    double sum = 0;
+    int zeros = 0;
 
-        // Use the actual card count for each player
-        int playerScore = calculateScore(game->players[i].card, game->players[i].countCard);
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -registers[i]);
+        zeros += registers[i] == 0;
+    }
+    double estimate = 0.709 * HLL_REGISTERS * HLL_REGISTERS / sum;
 
-        printf("%s Score: %d\n", game->players[i].name, playerScore);
+    // Few tablemates leave registers empty, counting those is more exact there
+    if (estimate <= 2.5 * HLL_REGISTERS && zeros > 0) {
+        estimate = HLL_REGISTERS * log((double) HLL_REGISTERS / zeros);
+    }
+    return estimate;
+}
 
-        bool playerBust = (playerScore > 21);
+// Adds one to the pair in every row and returns the smallest of its counters, the count-min estimate
+unsigned int pairAdd(unsigned int a, unsigned int b) {
+    unsigned long long hash = mixSeed(a < b ? ((unsigned long long) a << 32) | b : ((unsigned long long) b << 32) | a);
+    unsigned int step = (unsigned int) (hash >> 32) | 1;
+    unsigned int estimate = ~0u;
 
-        // Determine the result for the player against the dealer
-        if (playerBust) {
-            printf("%s busts!\n", game->players[i].name);
-        } else if (dealerBust || playerScore > dealerScore) {
-            printf("%s wins against Dealer!\n", game->players[i].name);
-        } else if (playerScore == dealerScore) {
-            printf("%s ties with Dealer!\n", game->players[i].name);
-            game->players[i].isTie = true;
-        } else {
-            printf("Dealer wins against %s!\n", game->players[i].name);
+    for (int row = 0; row < CMS_DEPTH; row++) {
+        unsigned int* counter = &analyzer.pairs[row * CMS_WIDTH + (((unsigned int) hash + row * step) & (CMS_WIDTH - 1))];
+        if (++*counter < estimate) {
+            estimate = *counter;
         }
-
-        // Update the player's lost status
-        game->players[i].isLost = playerBust || (!dealerBust && dealerScore > playerScore);
     }
+    return estimate;
 }
 
-void placeBet(Player* player, double betAmount) {
-    player->bet = betAmount;
-    player->ChipSum -= betAmount;
+const char* analyzerName(const PlayerProfile* profile, char* buffer) {
+    if (profile->name[0] != '\0') {
+        return profile->name;
+    }
+    snprintf(buffer, MAX_NAME_LEN, "#%08x", profile->key);  // Forgotten and met again before sitting down
+    return buffer;
 }
 
-void acceptBets(Game* game) {
-    for (int i = 0; i < game->numPlayers; i++) {
-        double betAmount;
+void analyzerAlert(const char* format, ...) {
+    va_list args;
 
-        printf("%s Balance: %.2f\n",game->players[i].name,game->players[i].ChipSum);
+    fprintf(analyzer.alerts, "%lld ", (long long) time(NULL));
+    va_start(args, format);
+    vfprintf(analyzer.alerts, format, args);
+    va_end(args);
+    fflush(analyzer.alerts);
+    metricAdd(METRIC_FRAUD_ALERTS, 1);
+}
 
-        // Continuously ask for a valid bet
-        printf("Player %d, enter your bet: ", i + 1);
-        scanf("%lf", &betAmount);
+void analyzerCheckCounter(PlayerProfile* profile) {
+    char buffer[MAX_NAME_LEN];
 
-        while (betAmount > game->players[i].ChipSum || betAmount <= 0) {
-            if (betAmount > game->players[i].ChipSum) {
-                printf("Bet is higher than your chip amount, lower the bet.\n");
-            } else if (betAmount <= 0) {
-                printf("Bet must be greater than zero.\n");
-            }
-            printf("Player %d, enter your bet: ", i + 1);
-            scanf("%lf", &betAmount);
-        }
+    if ((profile->alerts & ALERT_COUNTER) || profile->bets < ANALYZER_MIN_BETS) {
+        return;
+    }
 
-        placeBet(&game->players[i], betAmount);
-        printf("Bet Placed: %.2f\n", betAmount);
-        printf("Balance Left After The Bet: %.2f \n",game->players[i].ChipSum);
+    // A flat bettor has no spread in units and so no correlation at all
+    float w = profile->weight;
+    float covariance = w * profile->sumCountUnits - profile->sumCount * profile->sumUnits;
+    float countSpread = w * profile->sumCount2 - profile->sumCount * profile->sumCount;
+    float unitSpread = w * profile->sumUnits2 - profile->sumUnits * profile->sumUnits;
+    float correlation = countSpread > 0 && unitSpread > 0 ? covariance / sqrtf(countSpread * unitSpread) : 0;
+    float spread = profile->highWeight > 0.5f && profile->lowWeight > 0.5f ?
+                   (profile->highUnits / profile->highWeight) / (profile->lowUnits / profile->lowWeight) : 0;
+    bool ramp = correlation >= ANALYZER_CORRELATION && spread >= ANALYZER_SPREAD;
+    bool indexPlays = profile->deviations >= ANALYZER_INDEX_PLAYS && profile->deviations * 4 >= profile->opportunities * 3;
+
+    // Standing on every stiff hand also looks like an index play, so the plays only count with bets that lean on the count
+    if (ramp || (indexPlays && correlation >= ANALYZER_CORRELATION / 2)) {
+        profile->alerts |= ALERT_COUNTER;
+        analyzerAlert("COUNTER %s bets %u correlation %.2f spread %.1f index plays %u of %u won %.0f%% of recent hands\n",
+                      analyzerName(profile, buffer), profile->bets, correlation, spread, profile->deviations,
+                      profile->opportunities, profile->hands > 0 ? 100 * profile->wins / profile->hands : 0);
     }
 }
 
-void resolveBets(Game* game){
-
-
-    for(int i=0; i<game->numPlayers; i++)
-    {
-        if(!game->players[i].isLost)
-        {
-            if(game->players[i].isTie)
-            {
-            game->players[i].ChipSum += game->players[i].bet;
-            printf("Player %s Tie And Split Amount Of: %d \n",game->players[i].name, game->players[i].bet);
-
+void analyzeRecord(const AnalyzerRecord* record) {
+    const float keep = 1.0f - 1.0f / ANALYZER_WINDOW;
+    PlayerProfile* profile = analyzerProfile(record->key);
+    char buffer[MAX_NAME_LEN];
+    char partnerBuffer[MAX_NAME_LEN];
+
+    switch ((AnalyzeKind) record->kind) {
+        case ANALYZE_SIT:
+            snprintf(profile->name, MAX_NAME_LEN, "%s", record->name);
+            profile->sittings++;
+            for (int i = 0; i < record->mateCount; i++) {
+                PlayerProfile* mate = analyzerProfile(record->mates[i]);
+                unsigned int together = pairAdd(record->key, record->mates[i]);
+                unsigned int fewest = profile->sittings < mate->sittings ? profile->sittings : mate->sittings;
+
+                hllAdd(profile->tablemates, record->mates[i]);
+                hllAdd(mate->tablemates, record->key);
+
+                // The lobby seats players in the order they join, sitting down together again and again is no chance
+                if (together >= ANALYZER_SITTINGS && together * 4 >= fewest * 3 && !(profile->alerts & ALERT_COLLUSION)) {
+                    profile->alerts |= ALERT_COLLUSION;
+                    mate->alerts |= ALERT_COLLUSION;
+                    profile->partner = mate->key;
+                    mate->partner = profile->key;
+                    analyzerAlert("COLLUSION %s %s sat down together %u times in %u sittings, about %.0f distinct tablemates\n",
+                                  analyzerName(profile, buffer), analyzerName(mate, partnerBuffer), together,
+                                  profile->sittings, hllEstimate(profile->tablemates));
+                }
             }
-            else
-            {
-            game->players[i].ChipSum += 2 * game->players[i].bet;
-            printf("Player %s Wins Amount Of: %d \n",game->players[i].name, game->players[i].bet * 2);
-
+            break;
+        case ANALYZE_BET: {
+            float count = record->trueCount;
+            float units = record->units;
+
+            profile->bets++;
+            profile->weight = profile->weight * keep + 1;
+            profile->sumCount = profile->sumCount * keep + count;
+            profile->sumUnits = profile->sumUnits * keep + units;
+            profile->sumCountUnits = profile->sumCountUnits * keep + count * units;
+            profile->sumCount2 = profile->sumCount2 * keep + count * count;
+            profile->sumUnits2 = profile->sumUnits2 * keep + units * units;
+            profile->highWeight *= keep;
+            profile->highUnits *= keep;
+            profile->lowWeight *= keep;
+            profile->lowUnits *= keep;
+            if (record->trueCount >= 2) {
+                profile->highWeight += 1;
+                profile->highUnits += units;
+            } else if (record->trueCount <= 0) {
+                profile->lowWeight += 1;
+                profile->lowUnits += units;
             }
+            analyzerCheckCounter(profile);
+            break;
         }
-        else
-        {
-            printf("Player %s loses their bet of %d.\n", game->players[i].name, game->players[i].bet);
+        case ANALYZE_PLAY: {
+            if (record->total > 21 || record->upcard < 2 || record->upcard > 11) {
+                break;
+            }
+            Decision basic = PLAY_PREFERRED(strategyDecide(&strategies[STRATEGY_BASIC], record->total, (HandKind) record->handKind,
+                                                           record->upcard, record->trueCount));
+            Decision index = PLAY_PREFERRED(strategyDecide(&strategies[STRATEGY_HILO], record->total, (HandKind) record->handKind,
+                                                           record->upcard, record->trueCount));
+            if (basic != index) {
+                profile->opportunities++;
+                profile->deviations += record->play == index;
+                analyzerCheckCounter(profile);
+            }
+            break;
         }
-        PrintBalance(&game->players[i]);
+        case ANALYZE_RESULT:
+            profile->hands = profile->hands * keep + 1;
+            profile->wins = profile->wins * keep + (record->play == OUTCOME_WIN);
+            break;
     }
 }
 
-void playerTurn(Player* player, Game* game) {
-    // Initialize player score with the initial card count (assumed to be 2)
+void* runAnalyzer(void* unused) {
+    AnalyzerRecord record;
 
-    int playerScore = calculateScore(player->card, player->countCard);
-    char choice;
+    // Stopping waits for the tables, so once running drops the ring only holds what they left behind
+    while (true) {
+        bool any = false;
+        while (analyzerPop(&record)) {
+            analyzer.clock++;
+            analyzeRecord(&record);
+            any = true;
+        }
+        if (!any) {
+            if (!atomic_load(&analyzer.running)) {
+                break;
+            }
+            Sleep(1);
+        }
+    }
+    return unused;
+}
 
-    printf("%s's turn:\n", player->name);
-    printf("Initial hand:\n");
-    for (int i = 0; i < player->countCard; i++) {
-        printCard(&player->card[i]);
+bool analyzerStart(const char* path) {
+    analyzer.alerts = fopen(path, "a");
+    if (analyzer.alerts == NULL) {
+        perror("Failed to open fraud alert log");
+        return false;
     }
-    printf("%s's initial score: %d\n", player->name, playerScore);
 
-    // Player decides to hit, stand, or surrender
-    while (playerScore < 21) {
-        printf("Choose an action: (h)it, (s)tand, or (r)surrender: ");
-        scanf(" %c", &choice);
+    analyzer.ring = malloc(ANALYZER_RING * sizeof(AnalyzerSlot));
+    analyzer.profiles = calloc(ANALYZER_PROFILES, sizeof(PlayerProfile));
+    analyzer.pairs = calloc((size_t) CMS_DEPTH * CMS_WIDTH, sizeof(unsigned int));
+    if (analyzer.ring == NULL || analyzer.profiles == NULL || analyzer.pairs == NULL) {
+        perror("Failed to allocate memory for fraud analyzer");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < ANALYZER_RING; i++) {
+        atomic_init(&analyzer.ring[i].sequence, (unsigned long long) i);
+    }
+    atomic_store(&analyzer.tail, 0);
+    analyzer.head = 0;
+    analyzer.clock = 0;
 
-        if (choice == 'h') {  // Hit
-            printf("%s hits.\n", player->name);
-            player->card[player->countCard] = game->board->deck->cards[0];  // Add a new card
-            RemoveFromDeck(game, &game->board->deck->cards[0]);             // Remove that card from the deck
-            printCard(&player->card[player->countCard]);
-            player->countCard++;  // Increment countCard to reflect new card
-            playerScore = calculateScore(player->card, player->countCard);  // Update player score with new card count
-            printf("%s's new score: %d\n", player->name, playerScore);
+    atomic_store(&analyzer.running, true);
+    if (pthread_create(&analyzer.thread, NULL, runAnalyzer, NULL) != 0) {
+        perror("Failed to start fraud analyzer thread");
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
 
-            // Debugging output
-            printf("player card count: %d\n", player->countCard);
+// Only called once no table is left to push, so the ring can go with the thread
+void analyzerStop() {
+    if (analyzer.alerts == NULL) {
+        return;
+    }
+    atomic_store(&analyzer.running, false);
+    pthread_join(analyzer.thread, NULL);
+    fclose(analyzer.alerts);
+    analyzer.alerts = NULL;
+    free(analyzer.ring);
+    free(analyzer.profiles);
+    free(analyzer.pairs);
+    analyzer.ring = NULL;
+    analyzer.profiles = NULL;
+    analyzer.pairs = NULL;
+}
 
-        } else if (choice == 's') {  // Stand
-            printf("%s stands with a score of %d.\n", player->name, playerScore);
-            break;
+unsigned long long nowMicroseconds() {
+#ifdef _WIN32
+    return (unsigned long long) clock() * 1000000 / CLOCKS_PER_SEC;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
 
-        } else if (choice == 'r') {  // Surrender
-            printf("%s surrenders.\n", player->name);
-            player->isLost = true;
-            player->ChipSum -= player->bet / 2;  // Lose half of the bet
-            break;
+void histogramRecord(LatencyHistogram* histogram, long long valueUs) {
+    int index;
 
-        } else {
-            printf("Invalid choice. Please choose again.\n");
+    if (valueUs < 0) {
+        valueUs = 0;
+    }
+    if (valueUs < 2 * HIST_SUB) {
+        index = (int) valueUs;
+    } else {
+        // Keep the top HIST_SUB_BITS + 1 bits of the value, the power of two picks the group
+        int shift = 63 - __builtin_clzll((unsigned long long) valueUs) - HIST_SUB_BITS;
+        index = HIST_SUB * (shift + 1) + (int) ((valueUs >> shift) - HIST_SUB);
+        if (index >= HIST_BUCKETS) {
+            index = HIST_BUCKETS - 1;
         }
     }
 
-    if (playerScore > 21) {
-        printf("%s busts with a score of %d!\n", player->name, playerScore);
-        player->isLost = true;
+    histogram->counts[index]++;
+    histogram->total++;
+    if (valueUs > histogram->max) {
+        histogram->max = valueUs;
     }
 }
 
-void dealerTurn(Game *game) {
-    int dealerScore = calculateScore(game->board->dealerCards, 2);
-    int cardCount = 2;
+// Highest latency that falls in the same bucket as the value
+long long histogramBucketTop(int index) {
+    if (index < 2 * HIST_SUB) {
+        return index;
+    }
+    int shift = index / HIST_SUB - 1;
+    long long sub = index % HIST_SUB + HIST_SUB;
+    return ((sub + 1) << shift) - 1;
+}
 
-    // Dealer reveals their hidden card
-    printf("Dealer's cards:\n");
-    for (int i = 0; i < cardCount; i++) {
-        printCard(&game->board->dealerCards[i]);
+long long histogramPercentile(LatencyHistogram* histogram, double percentile) {
+    long long rank = (long long) (percentile / 100.0 * histogram->total + 0.999999);
+    long long seen = 0;
+
+    if (rank < 1) {
+        rank = 1;
+    }
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            long long top = histogramBucketTop(i);
+            return top < histogram->max ? top : histogram->max;
+        }
     }
-    printf("Dealer's initial score: %d\n", dealerScore);
+    return histogram->max;
+}
 
-    // Dealer hits until reaching at least 17
-    while (dealerScore < 17) {
-        printf("Dealer hits.\n");
-        game->board->dealCardCount = 3;
-        // Draw a new card
-        game->board->dealerCards[cardCount] = game->board->deck->cards[0];
-        RemoveFromDeck(game, &game->board->deck->cards[0]);
+#ifndef _WIN32
+bool loadClientSend(LoadClient* client, LoadAction action, const char* line, unsigned long long sentAt) {
+    int length = (int) strlen(line);
 
-        printCard(&game->board->dealerCards[cardCount]);
-        cardCount++;
+    client->waiting = action;
+    client->sentAt = sentAt;
+    return send(client->link.fd, line, length, MSG_NOSIGNAL) == length;
+}
 
-        // Recalculate dealer's score with new card
-        dealerScore = calculateScore(game->board->dealerCards, cardCount);
-        if(dealerScore<=21)
-            {
-                printf("Dealer's new score: %d\n", dealerScore);
-            }
-    }
+bool loadClientStart(LoadClient* client, int id, StakeLevel stake, unsigned long long plannedAt) {
+    struct sockaddr_in address;
+    char line[SEAT_LINK_BUFFER];
+    int on = 1;
 
-    // Dealer stands if score is 17 or higher
-    if (dealerScore >= 17) {
-        int dealerScoreAfter = calculateScore(game->board->dealerCards, cardCount);
-            if(dealerScore<=21)
-                {
-                    printf("Dealer stands with a score of %d.\n", dealerScore);
-                }
+    client->link.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (client->link.fd < 0) {
+        return false;
+    }
+    setsockopt(client->link.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(loadTest.port);
+    if (connect(client->link.fd, (struct sockaddr*) &address, sizeof(address)) != 0) {
+        close(client->link.fd);
+        return false;
     }
+
+    client->link.buffered = 0;
+    client->link.gone = false;
+    client->active = true;
+    client->roundsLeft = loadTest.roundsPerSession;
+    snprintf(line, sizeof(line), "JOIN load%d %d\n", id, stake);
+    return loadClientSend(client, LOAD_JOIN, line, plannedAt);
 }
 
-void startGame(Game* game) {
-    bool gameOver = false;
+// Plays what a simple basic strategy would, using only hit, stand and surrender
+LoadAction loadClientDecide(int total, int soft, int upcard, const char* options) {
+    if (strchr(options, 'r') != NULL && upcard >= 10 && (total == 16 || (total == 15 && upcard == 10))) {
+        return LOAD_SURRENDER;
+    }
+    if (total <= 11 || (soft && total <= 17) || (total <= 16 && upcard >= 7) || (total == 12 && upcard <= 3)) {
+        return LOAD_HIT;
+    }
+    return LOAD_STAND;
+}
 
-    while (!gameOver) {
-        ClearConsole();
-        // 1. Accept player bets
-        printf("Starting a new round!\n");
-        acceptBets(game);
+// Handles one line from the server, returns false once the session is over
+bool loadClientOnLine(LoadWorker* worker, LoadClient* client, const char* line, unsigned long long now) {
+    double balance;
+    int minimum, total, soft, upcard;
+    char options[8];
 
-        // 2. Deal initial cards to players and dealer
-        dealCards(game);
+    // Every request gets exactly one line back, that line ends its round trip
+    if (client->waiting != LOAD_NONE) {
+        histogramRecord(&worker->histograms[client->waiting], (long long) (now - client->sentAt));
+        client->waiting = LOAD_NONE;
+    }
 
-        // 3. Player turns
-        for (int i = 0; i < game->numPlayers; i++) {
-            if (!game->players[i].isLost) {
-                playerTurn(&game->players[i], game);
-            }
+    if (sscanf(line, "BET? %lf %d", &balance, &minimum) == 2) {
+        char bet[32];
+        if (client->roundsLeft <= 0 || balance < minimum || now >= loadTest.stopAt) {
+            return loadClientSend(client, LOAD_LEAVE, "LEAVE\n", now);
         }
+        snprintf(bet, sizeof(bet), "BET %d\n", minimum);
+        return loadClientSend(client, LOAD_BET, bet, now);
+    }
+    if (sscanf(line, "ACT? %d %d %d %7s", &total, &soft, &upcard, options) == 4) {
+        LoadAction action = loadClientDecide(total, soft, upcard, options);
+        const char* lines[LOAD_ACTIONS] = {NULL, NULL, "HIT\n", "STAND\n", "SURRENDER\n", NULL};
+        return loadClientSend(client, action, lines[action], now);
+    }
+    if (strncmp(line, "RESULT", 6) == 0) {
+        worker->rounds++;
+        client->roundsLeft--;
+    } else if (strncmp(line, "BYE", 3) == 0) {
+        worker->sessions++;
+        return false;
+    } else if (strncmp(line, "ERR busy", 8) == 0) {
+        worker->busy++;
+        client->retryAt = now + LOADGEN_BACKOFF_US;  // Coming straight back would only add to the overload
+        return false;
+    } else if (strncmp(line, "ERR", 3) == 0) {
+        worker->errors++;
+    }
+    return true;
+}
 
-        // 4. Dealer turn
-        printf("Dealer's turn:\n");
-        dealerTurn(game);
-
-        // 5. Determine the winner(s)
-        DetermineWinner(game);
+void* runLoadWorker(void* argument) {
+    LoadWorker* worker = argument;
+    struct pollfd* fds = malloc(worker->clientCount * sizeof(struct pollfd));
+    int* polled = malloc(worker->clientCount * sizeof(int));
+    int id = worker->firstClientId;
+    unsigned long long nextArrival = loadTest.startAt;
+    int active = 0;
 
-        // 6. Resolve bets
-        resolveBets(game);
+    if (fds == NULL || polled == NULL) {
+        perror("Failed to allocate memory for load worker");
+        exit(EXIT_FAILURE);
+    }
 
-        // 7. Check if players want to continue or end the game
-        printf("Do you want to play another round? (y/n): ");
-        char choice;
-        scanf(" %c", &choice);
-        if (choice == 'n' || choice == 'N') {
-            gameOver = true;
+    while (true) {
+        unsigned long long now = nowMicroseconds();
+        bool stopping = now >= loadTest.stopAt;
+
+        // Closed loop keeps every client busy, open loop starts sessions on a fixed schedule
+        if (!loadTest.openLoop) {
+            for (int i = 0; i < worker->clientCount && !stopping; i++) {
+                if (!worker->clients[i].active && worker->clients[i].retryAt <= now) {
+                    if (loadClientStart(&worker->clients[i], id++, (StakeLevel) (i % STAKE_LEVELS), now)) {
+                        active++;
+                    } else {
+                        worker->errors++;
+                    }
+                }
+            }
         } else {
-            // Reset player states and game board for the next round
-            for (int i = 0; i < game->numPlayers; i++) {
-                game->players[i].bet = 0;
-                game->players[i].isLost = false;
+            int slot = 0;
+            while (nextArrival <= now && !stopping) {
+                while (slot < worker->clientCount && worker->clients[slot].active) {
+                    slot++;
+                }
+                if (slot == worker->clientCount) {
+                    worker->dropped++;
+                } else if (loadClientStart(&worker->clients[slot], id++, (StakeLevel) (slot % STAKE_LEVELS), nextArrival)) {
+                    active++;  // The JOIN latency counts from the planned arrival, not from when it got sent
+                } else {
+                    worker->errors++;
+                }
+                nextArrival += (unsigned long long) worker->arrivalIntervalUs;
             }
-            initializeDeck(game->board->deck);
-            shuffleDeck(game->board->deck);
         }
-    }
 
+        if (active == 0) {
+            if (stopping) {
+                break;
+            }
+            Sleep(1);
+            continue;
+        }
 
-    printf("Game Over! Thanks for playing.\n");
-}
-
-void handleBetting(Game *game) {
-    for (int i = 0; i < game->numPlayers; i++) {
-        int betAmount;
-        printf("%s, enter your bet amount (Balance: %d): ", game->players[i].name, game->players[i].ChipSum);
-        scanf("%d", &betAmount);
+        int count = 0;
+        for (int i = 0; i < worker->clientCount; i++) {
+            if (worker->clients[i].active) {
+                fds[count].fd = worker->clients[i].link.fd;
+                fds[count].events = POLLIN;
+                polled[count++] = i;
+            }
+        }
+        if (poll(fds, count, 1) <= 0) {
+            continue;
+        }
 
-        // Validate bet
-        while (betAmount <= 0 || betAmount > game->players[i].ChipSum) {
-            if (betAmount <= 0) {
-                printf("Bet must be a positive amount. Try again: ");
+        now = nowMicroseconds();
+        for (int k = 0; k < count; k++) {
+            if (!(fds[k].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            LoadClient* client = &worker->clients[polled[k]];
+            SeatLink* link = &client->link;
+            bool alive = true;
+
+            ssize_t received = recv(link->fd, link->buffer + link->buffered, SEAT_LINK_BUFFER - link->buffered, 0);
+            if (received <= 0) {
+                worker->errors++;
+                alive = false;
             } else {
-                printf("Bet exceeds available balance. Try again: ");
+                link->buffered += (int) received;
             }
-            scanf("%d", &betAmount);
-        }
 
-        // Place the bet and update balance
-        placeBet(&game->players[i], betAmount);
-        printf("%s placed a bet of %d. Remaining balance: %d\n", game->players[i].name, betAmount, game->players[i].ChipSum);
-    }
-}
+            char* end;
+            while (alive && (end = memchr(link->buffer, '\n', link->buffered)) != NULL) {
+                *end = '\0';
+                alive = loadClientOnLine(worker, client, link->buffer, now);
+                link->buffered -= (int) (end - link->buffer) + 1;
+                memmove(link->buffer, end + 1, link->buffered);
+            }
 
-int getPlayersCount(){
-    int playerAmount;
+            if (!alive) {
+                close(link->fd);
+                client->active = false;
+                active--;
+            }
+        }
+    }
 
-    printf("insert the number of players: ");
-    scanf("%d",&playerAmount);
+    free(fds);
+    free(polled);
+    return NULL;
+}
+#endif
+
+void runLoadTest() {
+#ifdef _WIN32
+    printf("The load test needs a POSIX system.\n");
+#else
+    int clients, seconds;
+    double rate = 0;
+    char mode;
+    LoadWorker workers[LOADGEN_THREADS];
+    LatencyHistogram* merged = calloc(LOAD_ACTIONS, sizeof(LatencyHistogram));
+
+    if (merged == NULL) {
+        perror("Failed to allocate memory for histograms");
+        exit(EXIT_FAILURE);
+    }
 
-    return playerAmount;
+    printf("insert the number of concurrent clients: ");
+    scanf("%d", &clients);
+    printf("closed loop or open loop (c/o): ");
+    scanf(" %c", &mode);
+    loadTest.openLoop = mode == 'o' || mode == 'O';
+    if (loadTest.openLoop) {
+        printf("insert the number of new sessions per second: ");
+        scanf("%lf", &rate);
+    }
+    printf("insert the number of rounds per session: ");
+    scanf("%d", &loadTest.roundsPerSession);
+    printf("insert the number of seconds to run: ");
+    scanf("%d", &seconds);
+    if (clients < LOADGEN_THREADS || seconds <= 0 || (loadTest.openLoop && rate <= 0)) {
+        printf("Nothing to run.\n");
+        free(merged);
+        return;
+    }
 
-}
+    // Both ends of every connection live in this process
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
 
-void getPlayersDetails(Game *game) {
-    for (int i = 0; i < game->numPlayers; i++) {
-        printf("Player %d, please enter your name: ", i + 1);
+    bool ownServer = server.listenFd < 0;
+    if (ownServer && !startServer(SERVER_PORT, false)) {
+        free(merged);
+        return;
+    }
+    loadTest.port = server.port;
+    loadTest.startAt = nowMicroseconds();
+    loadTest.stopAt = loadTest.startAt + (unsigned long long) seconds * 1000000;
+
+    for (int i = 0; i < LOADGEN_THREADS; i++) {
+        LoadWorker* worker = &workers[i];
+        memset(worker, 0, sizeof(LoadWorker));
+        worker->clientCount = clients / LOADGEN_THREADS + (i < clients % LOADGEN_THREADS ? 1 : 0);
+        worker->clients = calloc(worker->clientCount, sizeof(LoadClient));
+        worker->arrivalIntervalUs = loadTest.openLoop ? 1e6 * LOADGEN_THREADS / rate : 0;
+        worker->firstClientId = i * 1000000;
+        if (worker->clients == NULL) {
+            perror("Failed to allocate memory for load clients");
+            exit(EXIT_FAILURE);
+        }
+        if (pthread_create(&worker->thread, NULL, runLoadWorker, worker) != 0) {
+            perror("Failed to start load worker");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-        // Limit input to MAX_NAME_LEN-1 to leave space for null terminator
-        if (scanf("%49s", game->players[i].name) != 1) {
-            printf("Error reading name for player %d\n", i + 1);
-            game->players[i].name[0] = '\0';  // Set an empty name in case of error
+    long rounds = 0, sessions = 0, errors = 0, busy = 0, dropped = 0;
+    for (int i = 0; i < LOADGEN_THREADS; i++) {
+        pthread_join(workers[i].thread, NULL);
+        for (int a = 0; a < LOAD_ACTIONS; a++) {
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                merged[a].counts[b] += workers[i].histograms[a].counts[b];
+            }
+            merged[a].total += workers[i].histograms[a].total;
+            if (workers[i].histograms[a].max > merged[a].max) {
+                merged[a].max = workers[i].histograms[a].max;
+            }
         }
+        rounds += workers[i].rounds;
+        sessions += workers[i].sessions;
+        errors += workers[i].errors;
+        busy += workers[i].busy;
+        dropped += workers[i].dropped;
+        free(workers[i].clients);
+    }
+    double elapsed = (nowMicroseconds() - loadTest.startAt) / 1e6;
 
-        // Clear remaining input buffer in case the name was too long
-        int ch;
-        while ((ch = getchar()) != '\n' && ch != EOF) {}
+    if (ownServer) {
+        stopServer();
+    }
+
+    printf("\n****** LOAD TEST (%s loop, %d clients, %.1f s) ******\n", loadTest.openLoop ? "open" : "closed", clients, elapsed);
+    printf("%-10s %10s %10s %10s %10s %10s\n", "action", "count", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (int a = 0; a < LOAD_ACTIONS; a++) {
+        printf("%-10s %10lld %10lld %10lld %10lld %10lld\n", LOAD_ACTION_NAMES[a], merged[a].total,
+               histogramPercentile(&merged[a], 50.0), histogramPercentile(&merged[a], 99.0),
+               histogramPercentile(&merged[a], 99.9), merged[a].max);
     }
+    printf("rounds: %ld (%.0f rounds/s)  sessions: %ld  errors: %ld  turned away busy: %ld  dropped arrivals: %ld\n",
+           rounds, rounds / elapsed, sessions, errors, busy, dropped);
+    printf("*****************************************************\n\n");
+    free(merged);
+#endif
 }
 
 void ClearConsole() {
@@ -689,13 +9443,25 @@ void printRules() {
     printf("8. Players who exceed 21 points lose automatically (bust).\n");
     printf("9. If the player's total is higher than the dealer's without busting, they win.\n");
     printf("10. If the dealer has a higher total, the dealer wins.\n");
+    printf("11. On the first two cards a player can 'Double' the bet and take exactly one more card.\n");
+    printf("12. A pair can be 'Split' into two hands with equal bets, up to four hands. Split Aces get one card each.\n");
+    printf("13. A player can 'Surrender' the first two cards of an unsplit hand and get half the bet back.\n");
+    printf("14. A player who does not bet within %d seconds sits the round out, a hand that does not act within %d seconds stands.\n",
+           BET_TIMEOUT_MS / 1000, ACTION_TIMEOUT_MS / 1000);
+    printf("15. A first two card 21 is a 'Blackjack'. It beats any other 21 and pays as the table rules say.\n");
+    printf("16. Every table plays one rule set:\n");
+    for (int r = 0; r < RULE_SET_COUNT; r++) {
+        printf("    - %s, %s\n", RULES[r].name, RULES[r].surrender ? "surrender allowed" : "no surrender");
+    }
     printf("*************************************\n\n");
 }
 
 void displayMenu() {
     int choice;
     int count;
-    Game game;
+    int bots;
+    char answer;
+    Table* table;
 
 
     void printCardLogo() {
@@ -742,22 +9508,104 @@ void displayMenu() {
         printf("\n\n\t\t\t\t\t********** BLACKJACK GAME **********\n");
         printf("\t\t\t\t\t* 1. Start a New Game              *\n");
         printf("\t\t\t\t\t* 2. View Game Rules               *\n");
+        printf("\t\t\t\t\t* 3. Simulate House Bots           *\n");
+        printf("\t\t\t\t\t* 4. Resume Saved Game             *\n");
+        printf("\t\t\t\t\t* 5. Host Online Tables            *\n");
+        printf("\t\t\t\t\t* 6. Load Test Online Tables       *\n");
+        printf("\t\t\t\t\t* 7. Compare Strategies (Paired)   *\n");
+        printf("\t\t\t\t\t* 8. Bankroll Risk of Ruin         *\n");
+        printf("\t\t\t\t\t* 9. Review Hand History           *\n");
+        printf("\t\t\t\t\t* 10. Join Local Table             *\n");
+        printf("\t\t\t\t\t* 11. Run a Tournament             *\n");
+        printf("\t\t\t\t\t* 12. Exact House Edge             *\n");
         printf("\t\t\t\t\t************************************\n");
-        printf("\t\t\t\t\tPlease choose an option (1 or 2): ");
+        printf("\t\t\t\t\tPlease choose an option (1-12): ");
         scanf("%d", &choice);
 
         switch (choice) {
             case 1:
                 ClearConsole();
                 count = getPlayersCount();
-                initializeGame(&game,count);
-                getPlayersDetails(&game);
-                startGame(&game);
+                printf("insert the number of house bots: ");
+                scanf("%d", &bots);
+                table = openTable(count + bots);
+                if (table == NULL) {
+                    break;
+                }
+                table->game.numPlayers = count < MAX_PLAYERS ? count : MAX_PLAYERS;  // Only the human seats give their names
+                getPlayersDetails(&table->game);
+                table->game.numPlayers = count + bots < MAX_PLAYERS ? count + bots : MAX_PLAYERS;
+                addHouseBots(&table->game, table->game.numPlayers < count ? table->game.numPlayers : count);
+                table->game.rules = getRuleSet();
+                resetRound(&table->game);
+                snapshotTablesInBackground(SNAPSHOT_PATH);  // The log can only replay onto tables the snapshot knows
+                startGame(&table->game);
+                closeTable(table);
+                saveTables(SNAPSHOT_PATH);
                break;
             case 2:
                 ClearConsole();
                 printRules();
                 break;
+            case 3:
+                ClearConsole();
+                simulateStrategies();
+                break;
+            case 4:
+                ClearConsole();
+                // Saved tables were restored on start up, the terminal plays the one the user picks
+                table = pickSavedTable();
+                if (table == NULL) {
+                    printf("There is no saved game to resume.\n");
+                    break;
+                }
+                startGame(&table->game);
+                closeTable(table);
+                saveTables(SNAPSHOT_PATH);
+                break;
+            case 5:
+                ClearConsole();
+                printf("Players join by name alone and whoever uses a name gets its wallet.\n");
+                printf("Let players on other machines join (y/n)? ");
+                answer = 'n';
+                scanf(" %c", &answer);
+                if (!startServer(SERVER_PORT, answer == 'y' || answer == 'Y')) {
+                    break;
+                }
+                printf("Online tables are open on port %d%s, press Enter to close them.\n", SERVER_PORT,
+                       answer == 'y' || answer == 'Y' ? " to every network" : " to this machine only");
+                while (getchar() != '\n') {}  // The newline left after the menu choice
+                getchar();
+                stopServer();
+                break;
+            case 6:
+                ClearConsole();
+                runLoadTest();
+                break;
+            case 7:
+                ClearConsole();
+                compareStrategies();
+                break;
+            case 8:
+                ClearConsole();
+                simulateBankrolls();
+                break;
+            case 9:
+                ClearConsole();
+                reviewHandHistory();
+                break;
+            case 10:
+                ClearConsole();
+                playLocalKiosk();
+                break;
+            case 11:
+                ClearConsole();
+                runTournament();
+                break;
+            case 12:
+                ClearConsole();
+                calculateHouseEdge();
+                break;
             default:
                 printf("\nInvalid choice. Please try again.\n");
         }